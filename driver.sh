@@ -40,6 +40,22 @@ CACHE_LIST="tiny.c
 # The file we will fetch for various tests
 FETCH_FILE="home.html"
 
+# Sizes of the origin server's objects that push FETCH_FILE out of a
+# small cache (to the disk tier)
+SPILL_SIZES="16000 16001 16002 16003 16004 16005 16006 16007 16008 16009"
+
+# Size of the origin server's object bigger than MAX_OBJECT_SIZE
+BIG_SIZE=300000
+
+# Size of the origin server's objects fetched in ranges (see pfetch.c)
+SPLIT_SIZE=1048576
+
+# Freshness (seconds) given to tiny's files in the HTTP tests
+HTTP_TTL=5
+
+# Seconds a 404 is kept in the HTTP tests (-e)
+NEG_TTL=2
+
 #####
 # Helper functions
 #
@@ -66,6 +82,37 @@ function download_noproxy {
     cd $HOME_DIR
 }
 
+#
+# fetch_status - fetch a file via the proxy & print the HTTP status only
+# usage: fetch_status <origin_url> <proxy_url> [curl options]
+#
+function fetch_status {
+    curl --max-time ${TIMEOUT} --silent --proxy $2 --output /dev/null \
+        --write-out "%{http_code}" "${@:3}" $1
+}
+
+#
+# fetch_body - fetch a file via the proxy & print it
+# usage: fetch_body <origin_url> <proxy_url> [curl options]
+#
+function fetch_body {
+    curl --max-time ${TIMEOUT} --silent --proxy $2 "${@:3}" $1
+}
+
+#
+# http_check - count an HTTP check & report whether it passed
+# usage: http_check <description> <result> <expected result>
+#
+function http_check {
+    numHttpRun=`expr $numHttpRun + 1`
+    if [ "$2" == "$3" ]; then
+        numHttpSucceeded=`expr ${numHttpSucceeded} + 1`
+        echo "   Success: $1"
+    else
+        echo "   Failure: $1 (got '$2', expected '$3')"
+    fi
+}
+
 #
 # clear_dirs - Clear the download directories
 #
@@ -142,7 +189,7 @@ function free_port {
 #
 
 # Kill any stray proxies or tiny servers owned by this user
-killall -q proxy tiny nop-server.py 2> /dev/null
+killall -q proxy tiny nop-server.py origin-server.py 2> /dev/null
 
 # Make sure we have a Tiny directory
 if [ ! -d ./tiny ]
@@ -188,6 +235,13 @@ then
     exit
 fi
 
+# Make sure we have an existing executable origin-server.py file
+if [ ! -x ./origin-server.py ]
+then 
+    echo "Error: ./origin-server.py not found or not an executable file."
+    exit
+fi
+
 # Create the test directories if needed
 if [ ! -d ${PROXY_DIR} ]
 then
@@ -399,6 +453,362 @@ wait $proxy_pid 2> /dev/null
 
 echo "Cache: $cacheScore / ${MAX_CACHE}"
 
+#####
+# HTTP caching (reported, not graded)
+#
+echo ""
+echo "*** HTTP ***"
+numHttpRun=0
+numHttpSucceeded=0
+clear_dirs
+
+# Every size class of the default slab can have a page of its own
+echo "Slab pages (default budget)"
+proxy_port=$(free_port)
+./proxy ${proxy_port} 2> ${PROXY_DIR}/stats &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+kill -USR1 $proxy_pid
+sleep 1
+pages=$(sed -n 's/^pages: .* \([0-9]*\) total.*/\1/p' ${PROXY_DIR}/stats)
+classes=$(sed -n 's/^pages: .* \([0-9]*\) classes.*/\1/p' ${PROXY_DIR}/stats)
+http_check "${pages:-no} pages for ${classes:-no} classes" \
+    $([ "${pages:-0}" -ge "${classes:-1}" ] && echo enough) enough
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# Tiny sends no Date & no Cache-Control, so its files are fresh for as
+# long as -t says; a copy kept in a snapshot or on disk is no fresher
+echo "Snapshot and disk tier expiry (-t ${HTTP_TTL})"
+tiny_port=$(free_port)
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny_port}"
+
+# A proxy that caches ./tiny/${FETCH_FILE} & snapshots it on the way out
+proxy_port=$(free_port)
+./proxy -t ${HTTP_TTL} -s ${PROXY_DIR}/cache.snap ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+download_proxy $PROXY_DIR ${FETCH_FILE} "http://localhost:${tiny_port}/${FETCH_FILE}" "http://localhost:${proxy_port}"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# The next one starts from the snapshot, with tiny gone
+proxy_port=$(free_port)
+./proxy -t ${HTTP_TTL} -s ${PROXY_DIR}/cache.snap ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+download_proxy $NOPROXY_DIR ${FETCH_FILE} "http://localhost:${tiny_port}/${FETCH_FILE}" "http://localhost:${proxy_port}"
+cmp -s ./tiny/${FETCH_FILE} ${NOPROXY_DIR}/${FETCH_FILE}
+http_check "fresh copy served from the snapshot" $? 0
+sleep `expr ${HTTP_TTL} + 1`
+http_check "expired snapshot copy not served" \
+    $(fetch_status "http://localhost:${tiny_port}/${FETCH_FILE}" "http://localhost:${proxy_port}") 502
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# A proxy with a log of two segments spills ./tiny/${FETCH_FILE} to disk
+# as the origin server's objects come in (see origin-server.py)
+tiny_port=$(free_port)
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny_port}"
+origin_port=$(free_port)
+./origin-server.py ${origin_port} &> /dev/null &
+origin_pid=$!
+wait_for_port_use "${origin_port}"
+proxy_port=$(free_port)
+./proxy -t ${HTTP_TTL} -l -m 64K -o 16K -d ${PROXY_DIR}/cache.disk -D 1M ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+download_proxy $PROXY_DIR ${FETCH_FILE} "http://localhost:${tiny_port}/${FETCH_FILE}" "http://localhost:${proxy_port}"
+for size in ${SPILL_SIZES}
+do
+    fetch_body http://localhost:${origin_port}/big/${size}.bin "http://localhost:${proxy_port}" > /dev/null
+done
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+kill $origin_pid 2> /dev/null
+wait $origin_pid 2> /dev/null
+sleep 1
+rm -f ${NOPROXY_DIR}/${FETCH_FILE}
+download_proxy $NOPROXY_DIR ${FETCH_FILE} "http://localhost:${tiny_port}/${FETCH_FILE}" "http://localhost:${proxy_port}"
+cmp -s ./tiny/${FETCH_FILE} ${NOPROXY_DIR}/${FETCH_FILE}
+http_check "fresh copy served from the disk tier" $? 0
+sleep ${HTTP_TTL}
+http_check "expired disk copy not served" \
+    $(fetch_status "http://localhost:${tiny_port}/${FETCH_FILE}" "http://localhost:${proxy_port}") 502
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# The origin server counts requests in its bodies (see origin-server.py)
+origin_port=$(free_port)
+echo "Starting the origin server on port ${origin_port}"
+./origin-server.py ${origin_port} &> /dev/null &
+origin_pid=$!
+wait_for_port_use "${origin_port}"
+origin="http://localhost:${origin_port}"
+
+# A snapshot keeps the records of the one before that no one asked for
+echo "Snapshot carry-over"
+for i in 1 2 3
+do
+    proxy_port=$(free_port)
+    ./proxy -s ${PROXY_DIR}/kept.snap ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+    wait_for_port_use "${proxy_port}"
+    proxy="http://localhost:${proxy_port}"
+    # Only the first proxy is asked for it (the client has the body
+    # before the proxy has filled its copy, so give it a moment)
+    if [ $i -eq 1 ]; then
+        fetch_body ${origin}/kept.html ${proxy} > /dev/null
+        sleep 1
+    fi
+    if [ $i -eq 3 ]; then
+        http_check "copy kept by a proxy that didn't serve it" \
+            "$(fetch_body ${origin}/kept.html ${proxy})" "/kept.html #1"
+    fi
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+# Workers share one cache, and a worker killed is replaced without it
+echo "Worker restart (-w 2)"
+proxy_port=$(free_port)
+./proxy -w 2 ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+proxy="http://localhost:${proxy_port}"
+for i in 1 2 3 4
+do
+    fetch_body ${origin}/shared.html ${proxy} > /dev/null
+done
+kill -9 $(pgrep -P ${proxy_pid} | head -1) 2> /dev/null
+sleep 1
+http_check "worker replaced" $(pgrep -P ${proxy_pid} | wc -l) 2
+hits=""
+for i in 1 2 3 4
+do
+    hits="${hits}$(fetch_body ${origin}/shared.html ${proxy})"
+done
+http_check "cached copy served after the kill" "${hits}" \
+    "/shared.html #1/shared.html #1/shared.html #1/shared.html #1"
+http_check "origin asked once" \
+    "$(curl --max-time ${TIMEOUT} --silent ${origin}/shared.html)" "/shared.html #2"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# An object bigger than a slab chunk is cached whole, and a client that
+# asks for it while it's coming in gets all of it from the same fill
+echo "Large objects (-o 1M)"
+proxy_port=$(free_port)
+./proxy -m 4M -o 1M ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+proxy="http://localhost:${proxy_port}"
+fetch_body ${origin}/slow/${BIG_SIZE}.bin ${proxy} > ${PROXY_DIR}/first &
+first_pid=$!
+sleep 0.1
+fetch_body ${origin}/slow/${BIG_SIZE}.bin ${proxy} > ${PROXY_DIR}/second
+wait $first_pid
+fetch_body ${origin}/slow/${BIG_SIZE}.bin ${proxy} > ${PROXY_DIR}/cached
+http_check "first copy whole" \
+    "$(head -1 ${PROXY_DIR}/first) $(stat -c %s ${PROXY_DIR}/first)" \
+    "/slow/${BIG_SIZE}.bin #1 ${BIG_SIZE}"
+cmp -s ${PROXY_DIR}/first ${PROXY_DIR}/second
+http_check "whole copy served while filling" $? 0
+cmp -s ${PROXY_DIR}/first ${PROXY_DIR}/cached
+http_check "cached copy served intact" $? 0
+http_check "origin asked once" \
+    "$(curl --max-time ${TIMEOUT} --silent ${origin}/slow/${BIG_SIZE}.bin \
+       | head -1)" "/slow/${BIG_SIZE}.bin #2"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# An object sent in ranges is fetched over several connections at once
+# and put back together; one that changes meanwhile isn't mixed up with
+# its new version: the client's connection is reset instead
+echo "Split fetch (-o 2M)"
+proxy_port=$(free_port)
+./proxy -m 8M -o 2M ${proxy_port} 2> ${PROXY_DIR}/stats &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+proxy="http://localhost:${proxy_port}"
+fetch_body ${origin}/ranges/${SPLIT_SIZE}.bin ${proxy} > ${PROXY_DIR}/split
+curl --max-time ${TIMEOUT} --silent ${origin}/ranges/${SPLIT_SIZE}.bin \
+    > ${NOPROXY_DIR}/split
+kill -USR1 $proxy_pid
+sleep 1
+http_check "fetch split" \
+    "$(sed -n 's/^split fetches: \([0-9]*\),.*/\1/p' ${PROXY_DIR}/stats)" 1
+cmp -s ${PROXY_DIR}/split ${NOPROXY_DIR}/split
+http_check "split copy byte-identical" $? 0
+fetch_body ${origin}/ranges/${SPLIT_SIZE}.bin ${proxy} > ${PROXY_DIR}/split
+cmp -s ${PROXY_DIR}/split ${NOPROXY_DIR}/split
+http_check "cached split copy byte-identical" $? 0
+fetch_body ${origin}/changing/${SPLIT_SIZE}.bin ${proxy} > ${PROXY_DIR}/split
+status=$?
+http_check "changed object reset" \
+    $([ $status -ne 0 ] && \
+      [ $(stat -c %s ${PROXY_DIR}/split) -lt ${SPLIT_SIZE} ] && echo reset) \
+    reset
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+# A copy gone stale is served while it's refreshed (or while its origin
+# is down) only as long as its response says, or -W (or -E) allows when
+# it doesn't; never if it must be revalidated
+echo "Stale copies"
+stale_port=$(free_port)
+./origin-server.py ${stale_port} &> /dev/null &
+stale_pid=$!
+wait_for_port_use "${stale_port}"
+stale="http://localhost:${stale_port}"
+proxy_port=$(free_port)
+./proxy ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+proxy="http://localhost:${proxy_port}"
+for file in short.html swr.html sie.html
+do
+    fetch_body ${stale}/${file} ${proxy} > /dev/null
+done
+sleep 2
+http_check "stale-while-revalidate copy served" \
+    "$(fetch_body ${stale}/swr.html ${proxy})" "/swr.html #1"
+sleep 1
+http_check "stale-while-revalidate copy refreshed" \
+    "$(fetch_body ${stale}/swr.html ${proxy})" "/swr.html #2"
+http_check "stale copy not served while refreshed without -W" \
+    "$(fetch_body ${stale}/short.html ${proxy})" "/short.html #2"
+kill $stale_pid 2> /dev/null
+wait $stale_pid 2> /dev/null
+sleep 2
+http_check "stale-if-error copy served" \
+    "$(fetch_body ${stale}/sie.html ${proxy})" "/sie.html #1"
+http_check "stale copy refused on error without -E" \
+    $(fetch_status ${stale}/short.html ${proxy}) 502
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+echo "Stale copies (-W 30 -E 30)"
+stale_port=$(free_port)
+./origin-server.py ${stale_port} &> /dev/null &
+stale_pid=$!
+wait_for_port_use "${stale_port}"
+stale="http://localhost:${stale_port}"
+proxy_port=$(free_port)
+./proxy -W 30 -E 30 ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+proxy="http://localhost:${proxy_port}"
+for file in short.html mustrev.html
+do
+    fetch_body ${stale}/${file} ${proxy} > /dev/null
+done
+sleep 2
+http_check "stale copy served while refreshed" \
+    "$(fetch_body ${stale}/short.html ${proxy})" "/short.html #1"
+http_check "must-revalidate copy fetched again" \
+    "$(fetch_body ${stale}/mustrev.html ${proxy})" "/mustrev.html #2"
+sleep 1
+kill $stale_pid 2> /dev/null
+wait $stale_pid 2> /dev/null
+sleep 2
+http_check "stale copy served on error" \
+    "$(fetch_body ${stale}/short.html ${proxy})" "/short.html #2"
+http_check "must-revalidate copy refused on error" \
+    $(fetch_status ${stale}/mustrev.html ${proxy}) 502
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+proxy_port=$(free_port)
+echo "Starting proxy on port ${proxy_port}"
+./proxy -e ${NEG_TTL} ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+proxy="http://localhost:${proxy_port}"
+
+# An expired copy with an ETag is revalidated: the origin's 304 renews
+# it, so the cached body is served again
+echo "Revalidation"
+fetch_body ${origin}/etag.html ${proxy} > /dev/null
+sleep 2
+http_check "revalidated copy served" \
+    "$(fetch_body ${origin}/etag.html ${proxy})" "/etag.html #1"
+http_check "origin asked once more" \
+    "$(curl --max-time ${TIMEOUT} --silent ${origin}/etag.html)" "/etag.html #3"
+
+# Ranges of a cached copy are cut from it: a 206 with the bytes asked
+# for, or a 416 for a range past its end
+echo "Ranges"
+fetch_body ${origin}/range.html ${proxy} > /dev/null
+http_check "range served" \
+    "$(fetch_body ${origin}/range.html ${proxy} --range 1-5)" "range"
+http_check "range status" \
+    $(fetch_status ${origin}/range.html ${proxy} --range 1-5) 206
+http_check "unsatisfiable range status" \
+    $(fetch_status ${origin}/range.html ${proxy} --range 100-) 416
+http_check "origin asked once" \
+    "$(curl --max-time ${TIMEOUT} --silent ${origin}/range.html)" "/range.html #2"
+
+# A POST goes through to the origin & drops the cached copy, unless its
+# body is chunked
+echo "POST invalidation"
+fetch_body ${origin}/post.html ${proxy} > /dev/null
+http_check "copy cached" \
+    "$(fetch_body ${origin}/post.html ${proxy})" "/post.html #1"
+http_check "POST passed through" \
+    "$(fetch_body ${origin}/post.html ${proxy} --data x)" "/post.html #2"
+http_check "copy dropped" \
+    "$(fetch_body ${origin}/post.html ${proxy})" "/post.html #3"
+http_check "chunked POST refused" \
+    $(fetch_status ${origin}/post.html ${proxy} --data x \
+                   -H "Transfer-Encoding: chunked") 411
+http_check "copy kept" \
+    "$(fetch_body ${origin}/post.html ${proxy})" "/post.html #3"
+
+# Each Accept-Encoding gets its own variant of an object that varies by
+# it, and an object that varies by anything isn't cached
+echo "Vary"
+for enc in gzip br
+do
+    fetch_body ${origin}/vary.html ${proxy} -H "Accept-Encoding: ${enc}" \
+        > /dev/null
+done
+http_check "gzip variant cached" \
+    "$(fetch_body ${origin}/vary.html ${proxy} -H "Accept-Encoding: gzip")" \
+    "/vary.html #1 gzip"
+http_check "br variant cached" \
+    "$(fetch_body ${origin}/vary.html ${proxy} -H "Accept-Encoding: br")" \
+    "/vary.html #2 br"
+fetch_body ${origin}/varystar.html ${proxy} > /dev/null
+http_check "Vary: * not cached" \
+    "$(fetch_body ${origin}/varystar.html ${proxy})" "/varystar.html #2"
+
+# A 404 is cached too, but only for -e seconds
+echo "404 caching (-e ${NEG_TTL})"
+http_check "404 status" $(fetch_status ${origin}/missing.html ${proxy}) 404
+http_check "404 cached" \
+    "$(fetch_body ${origin}/missing.html ${proxy})" "/missing.html #1"
+sleep `expr ${NEG_TTL} + 1`
+http_check "404 expired" \
+    "$(fetch_body ${origin}/missing.html ${proxy})" "/missing.html #2"
+
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+kill $origin_pid 2> /dev/null
+wait $origin_pid 2> /dev/null
+
+echo "HTTP: ${numHttpSucceeded} / ${numHttpRun} checks passed"
+
 # Emit the total score
 totalScore=`expr ${basicScore} + ${cacheScore} + ${concurrencyScore}`
 maxScore=`expr ${MAX_BASIC} + ${MAX_CACHE} + ${MAX_CONCURRENCY}`
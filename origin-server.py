@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+
+# origin-server.py - This is an origin server for the HTTP caching tests.
+#                    It answers each connection in a thread of its own,
+#                    dates every response, and says in every body how
+#                    many times its path was asked for, so a test can
+#                    tell a copy the proxy kept from a new one. Its
+#                    paths are:
+#
+#                    /etag.html     fresh for 1 second, with ETag "v1"
+#                                   (a request with If-None-Match "v1"
+#                                   gets a 304)
+#                    /missing.html  a 404, without Cache-Control
+#                    /short.html    fresh for 1 second
+#                    /swr.html      fresh for 1 second, then may be served
+#                                   stale for 30 while it's refreshed
+#                    /sie.html      fresh for 1 second, then may be served
+#                                   stale for 30 if the origin fails
+#                    /mustrev.html  fresh for 1 second, must-revalidate
+#                    /vary.html     fresh for 100 seconds, varies by
+#                                   Accept-Encoding (its value follows
+#                                   the count)
+#                    /varystar.html fresh for 100 seconds, Vary: *
+#                    /big/<n>.bin   n bytes that are the same every time,
+#                                   fresh for 100 seconds
+#                    /slow/<n>.bin  n bytes, the count line first, sent
+#                                   SLOW_CHUNK bytes every SLOW_PAUSE
+#                                   seconds, fresh for 100 seconds
+#                    /ranges/<n>.bin  n bytes that are the same every
+#                                   time, paced like /slow/, fresh for
+#                                   100 seconds, with ETag "r1"; sent
+#                                   in ranges (a 206 for a Range whose
+#                                   If-Range, if any, is "r1")
+#                    /changing/<n>.bin  the same, but a new version every
+#                                   time: ETag "v<count>" & other bytes
+#                    any other      fresh for 100 seconds
+#
+#                    Any other method than GET & HEAD is answered 200,
+#                    once its body has been read.
+#
+# usage: origin-server.py <port>
+#
+import socket
+import sys
+import threading
+import time
+from email.utils import formatdate
+
+# Cache-Control of the paths that go stale after a second
+SHORT = {
+  '/short.html':   'max-age=1',
+  '/swr.html':     'max-age=1, stale-while-revalidate=30',
+  '/sie.html':     'max-age=1, stale-if-error=30',
+  '/mustrev.html': 'max-age=1, must-revalidate',
+}
+
+# Pace of the /slow/ paths
+SLOW_CHUNK = 16384
+SLOW_PAUSE = 0.02
+
+# Requests seen so far, by path
+hits = {}
+hits_lock = threading.Lock()
+
+def respond(channel, status, headers, body, pace=False):
+  head = "HTTP/1.0 %s\r\nDate: %s\r\n" % (status, formatdate(usegmt=True))
+  for header in headers:
+    head += header + "\r\n"
+  head += "Content-Length: %d\r\n\r\n" % len(body)
+  response = head.encode() + body
+  if not pace:
+    channel.sendall(response)
+    return
+  for i in range(0, len(response), SLOW_CHUNK):
+    channel.sendall(response[i:i + SLOW_CHUNK])
+    time.sleep(SLOW_PAUSE)
+
+def big(n):
+  return bytes(i % 251 for i in range(n))
+
+def size(path):
+  return int(path.rpartition('/')[2].partition('.')[0])
+
+def ranged(channel, headers, etag, body):
+  cache = ['Cache-Control: max-age=100', 'ETag: ' + etag,
+           'Accept-Ranges: bytes']
+  spec = headers.get('range', '')
+  if not spec.startswith('bytes=') or headers.get('if-range', etag) != etag:
+    respond(channel, "200 OK", cache, body, pace=True)
+    return
+  first, dash, last = spec[6:].partition(',')[0].partition('-')
+  first = int(first)
+  last = min(int(last), len(body) - 1) if last else len(body) - 1
+  respond(channel, "206 Partial Content", cache +
+          ['Content-Range: bytes %d-%d/%d' % (first, last, len(body))],
+          body[first:last + 1], pace=True)
+
+def serve(channel, rfile):
+  request = rfile.readline().decode().split()
+  headers = {}
+  while 1:
+    line = rfile.readline().decode()
+    if line in ('\r\n', '\n', ''):
+      break
+    name, colon, value = line.partition(':')
+    headers[name.strip().lower()] = value.strip()
+  if len(request) < 2:
+    return
+  method, path = request[0], request[1]
+  if path.startswith('http://'):
+    path = '/' + path[7:].partition('/')[2]
+  with hits_lock:
+    hits[path] = hits.get(path, 0) + 1
+    count = hits[path]
+  body = ("%s #%d\n" % (path, count)).encode()
+
+  if method not in ('GET', 'HEAD'):
+    rfile.read(int(headers.get('content-length', '0')))
+    respond(channel, "200 OK", [], body)
+  elif path == '/missing.html':
+    respond(channel, "404 Not Found", [], body)
+  elif path in SHORT:
+    respond(channel, "200 OK", ['Cache-Control: ' + SHORT[path]], body)
+  elif path == '/vary.html':
+    body = ("%s #%d %s\n" % (path, count,
+                             headers.get('accept-encoding', '-'))).encode()
+    respond(channel, "200 OK", ['Cache-Control: max-age=100',
+                                'Vary: Accept-Encoding'], body)
+  elif path == '/varystar.html':
+    respond(channel, "200 OK", ['Cache-Control: max-age=100', 'Vary: *'],
+            body)
+  elif path.startswith('/big/'):
+    respond(channel, "200 OK", ['Cache-Control: max-age=100'],
+            big(size(path)))
+  elif path.startswith('/slow/'):
+    respond(channel, "200 OK", ['Cache-Control: max-age=100'],
+            body + big(size(path) - len(body)), pace=True)
+  elif path.startswith('/ranges/'):
+    ranged(channel, headers, '"r1"', big(size(path)))
+  elif path.startswith('/changing/'):
+    ranged(channel, headers, '"v%d"' % count,
+           bytes((i + count) % 251 for i in range(size(path))))
+  elif path == '/etag.html':
+    if headers.get('if-none-match') == '"v1"':
+      respond(channel, "304 Not Modified", ['Cache-Control: max-age=1'], b'')
+    else:
+      respond(channel, "200 OK", ['Cache-Control: max-age=1', 'ETag: "v1"'],
+              body)
+  else:
+    respond(channel, "200 OK", ['Cache-Control: max-age=100'], body)
+
+def connection(channel):
+  rfile = channel.makefile('rb')
+  try:
+    serve(channel, rfile)
+  except OSError:
+    pass # the client hung up
+  rfile.close()
+  channel.close()
+
+#create an INET, STREAMing socket
+serversocket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+serversocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+serversocket.bind(('', int(sys.argv[1])))
+serversocket.listen(5)
+
+while 1:
+  channel, details = serversocket.accept()
+  threading.Thread(target=connection, args=(channel,), daemon=True).start()
@@ -0,0 +1,209 @@
+/*
+ * parena.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the bump arena every connection allocates its request state
+ * from. Nothing is zeroed and nothing is freed individually: the whole
+ * arena is reset when the connection ends. A request thread is kept
+ * for the next connection while one comes (see idle_wait), so each
+ * thread keeps its last reset arena to itself and takes it back without
+ * a lock. Arenas beyond that, and the one a thread kept when it exits
+ * (see arena_release), go on a small shared freelist.
+ */
+
+#include "csapp.h"
+#include "parena.h"
+
+/* Alignment of arena allocations */
+#define ARENA_ALIGN 8
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Reset arena kept by this thread */
+static __thread arena *arena_mine = NULL;
+/* Freelist of reset arenas */
+static arena *arena_free = NULL;
+static int arena_nfree = 0;
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void arena_release_one(arena *ar);
+static struct arena_block *block_new(size_t size, struct arena_block *next);
+
+
+/*****************
+ * ARENA FUNCTIONS
+ *****************/
+
+/*
+ * arena_get - take an empty arena: the one this thread kept, or one
+ *             from the freelist (or make one)
+ */
+arena *arena_get(void)
+{
+  arena *ar;
+
+  if ((ar = arena_mine) != NULL) {
+    arena_mine = NULL;
+    return ar;
+  }
+  pthread_mutex_lock(&arena_lock);
+  if ((ar = arena_free) != NULL) {
+    arena_free = ar->next;
+    arena_nfree--;
+  }
+  pthread_mutex_unlock(&arena_lock);
+
+  if (ar == NULL) {
+    ar = Malloc(sizeof(struct arena));
+    ar->block = block_new(ARENA_BLOCK, NULL);
+  }
+  ar->next = NULL;
+  return ar;
+}
+
+/*
+ * arena_put - reset arena [ar] & keep it for this thread (or put it
+ *             back on the freelist); blocks it grew beyond the first
+ *             one are freed
+ */
+void arena_put(arena *ar)
+{
+  struct arena_block *blk;
+
+  /* Keep only the first block */
+  while ((blk = ar->block)->next != NULL) {
+    ar->block = blk->next;
+    Free(blk);
+  }
+  ar->block->used = 0;
+  if (arena_mine == NULL) {
+    arena_mine = ar;
+    return;
+  }
+  arena_release_one(ar);
+}
+
+/*
+ * arena_release - hand the arena this thread kept to the freelist;
+ *                 call it before the thread exits
+ */
+void arena_release(void)
+{
+  if (arena_mine != NULL)
+    arena_release_one(arena_mine);
+  arena_mine = NULL;
+}
+
+/*
+ * arena_release_one - put reset arena [ar] on the freelist, or free
+ *                     it if the freelist is full
+ */
+static void arena_release_one(arena *ar)
+{
+  pthread_mutex_lock(&arena_lock);
+  if (arena_nfree < ARENA_KEEP) {
+    ar->next = arena_free;
+    arena_free = ar;
+    arena_nfree++;
+    ar = NULL;
+  }
+  pthread_mutex_unlock(&arena_lock);
+
+  /* Freelist is full */
+  if (ar != NULL) {
+    Free(ar->block);
+    Free(ar);
+  }
+}
+
+/*
+ * arena_alloc - bump-allocate [n] uninitialized bytes from arena [ar];
+ *               a new block (at least twice the last) is added if the
+ *               current one is full
+ */
+void *arena_alloc(arena *ar, size_t n)
+{
+  struct arena_block *blk = ar->block;
+  void *p;
+
+  n = ARENA_ROUND(n);
+  if (blk->size - blk->used < n)
+    blk = ar->block = block_new(2 * blk->size > n ? 2 * blk->size : n, blk);
+  p = (char *)(blk + 1) + blk->used;
+  blk->used += n;
+  return p;
+}
+
+/*
+ * block_new - malloc an arena block with [size] bytes of data,
+ *             linked to the older block [next]
+ */
+static struct arena_block *block_new(size_t size, struct arena_block *next)
+{
+  struct arena_block *blk = Malloc(sizeof(struct arena_block) + size);
+
+  blk->next = next;
+  blk->size = size;
+  blk->used = 0;
+  return blk;
+}
+
+
+/************************
+ * ARENA BUFFER FUNCTIONS
+ ************************/
+
+/*
+ * abuf_init - start an empty buffer [buf] in arena [ar] with room
+ *             for [cap] bytes
+ */
+void abuf_init(abuf *buf, arena *ar, size_t cap)
+{
+  buf->ar = ar;
+  buf->len = 0;
+  buf->cap = cap;
+  buf->data = arena_alloc(ar, cap + 1);
+  buf->data[0] = '\0';
+}
+
+/*
+ * abuf_append - append [n] bytes of [src] to buffer [buf], growing it
+ *               in place if it's the newest allocation of its block
+ */
+void abuf_append(abuf *buf, const void *src, size_t n)
+{
+  struct arena_block *blk = buf->ar->block;
+  char *top = (char *)(blk + 1) + blk->used;
+  size_t cap, old, want;
+  char *data;
+
+  if (buf->len + n > buf->cap) {
+    cap = 2 * buf->cap > buf->len + n ? 2 * buf->cap : buf->len + n;
+    old = ARENA_ROUND(buf->cap + 1);
+    want = ARENA_ROUND(cap + 1);
+    /* Newest allocation with room behind it: just extend it */
+    if (buf->data + old == top && blk->used - old + want <= blk->size)
+      blk->used += want - old;
+    /* Otherwise move it */
+    else {
+      data = arena_alloc(buf->ar, cap + 1);
+      memcpy(data, buf->data, buf->len);
+      buf->data = data;
+    }
+    buf->cap = cap;
+  }
+  memcpy(buf->data + buf->len, src, n);
+  buf->len += n;
+  buf->data[buf->len] = '\0';
+}
+
+/*
+ * abuf_puts - append string [str] to buffer [buf]
+ */
+void abuf_puts(abuf *buf, const char *str)
+{
+  abuf_append(buf, str, strlen(str));
+}
@@ -0,0 +1,59 @@
+/*
+ * parena.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for parena.c (per-connection bump arena)
+ */
+#ifndef __PARENA_H__
+#define __PARENA_H__
+
+#include <stddef.h>
+
+/* Arena sizes */
+#define ARENA_BLOCK 4096  // first block of every arena (4 Kb: a request)
+#define ARENA_KEEP  64    // max arenas kept for reuse
+
+/* Structure of an arena block consists of a link to the previous
+ * block, its size and how much of it is used; the data follows it.
+ */
+struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+};
+
+/* Structure of an arena consists of its newest block & a link used
+ * while it sits on the freelist.
+ */
+struct arena {
+  struct arena_block *block;
+  struct arena *next;
+};
+typedef struct arena arena;
+
+/* Structure of an arena buffer: a byte string in an arena that grows
+ * on demand and is always NUL-terminated.
+ */
+struct arena_buf {
+  arena *ar;
+  char *data;
+  size_t len;
+  size_t cap;
+};
+typedef struct arena_buf abuf;
+
+/* Function prototypes for arena operations */
+arena *arena_get(void);
+void arena_put(arena *ar);
+void arena_release(void);
+void *arena_alloc(arena *ar, size_t n);
+/* Function prototypes for arena buffers */
+void abuf_init(abuf *buf, arena *ar, size_t cap);
+void abuf_append(abuf *buf, const void *src, size_t n);
+void abuf_puts(abuf *buf, const char *str);
+
+#endif
@@ -7,11 +7,74 @@
  * Proxy Lab 
  *
  * This is the web object cache used for Part 3 of the Proxy Lab; it's 
- * implemented as a linked list with a semi-LRU eviction policy.
+ * implemented as a hash table with a GreedyDual-Size-Frequency (GDSF)
+ * eviction policy: every line has priority H = L + freq * cost / size,
+ * where cost is the origin fetch latency and L is the priority of the
+ * last line evicted. Lines live in a min-heap so the victim is heap[0].
+ * Lines are allocated from a slab (see pslab.c); there's one heap per
+ * slab class so that eviction frees a chunk the new line can use.
+ * Alternatively, lines are appended to a log (see plog.c) that evicts
+ * its oldest segment at once, moving lines hit since they were stored
+ * to the front instead.
+ * Budget, object size & object count limits are set at startup.
+ * Objects too big for one chunk are stored as a chain of segments that
+ * is published while the object streams in, so other clients can read
+ * a line while it's still filling. Lines are reference counted: an 
+ * evicted line is only freed once its last reader lets go of it.
+ * Complete lines evicted for room can be handed to a spill callback
+ * (the disk tier, see pdisk.c) on their way out.
+ * The whole cache can live in shared memory instead, for worker
+ * processes forked after it's set up; its locks then work across
+ * processes, and the parent cleans up after a worker that dies.
+ * In front of it, every thread keeps a few small hot lines of its own
+ * (the L1), found without the lock or any shared write. Hits are also
+ * counted in a sketch (see psketch.c), so that the hottest keys are
+ * replicated into every thread's L1 whatever their size, and never
+ * pushed out of it by colder ones.
  */
 
 #include "csapp.h"
 #include "pcache.h"
+#include "phttp.h"
+
+static void evict_owner(void *owner, void *arg);
+static void evict_line(cache *cash, line *lion);
+static int evict_some(cache *cash);
+static void log_evict_owner(void *owner, void *arg);
+static void *chunk_alloc(cache *cash, size_t need, line *owner);
+static void chunk_free(cache *cash, void *ptr, size_t size);
+static size_t store_capacity(cache *cash);
+static size_t store_used(cache *cash);
+static void cache_locks(cache *cash);
+static void lock_fill(cache *cash);
+static int line_stale(line *lion, time_t now);
+static void wheel_add(cache *cash, line *lion);
+static void wheel_del(cache *cash, line *lion);
+static void wheel_turn(cache *cash, time_t now);
+static line *find_ready(cache *cash, char *host, char *path, char *req,
+                        size_t rlen, int stale);
+static int line_match(line *lion, char *req, size_t rlen);
+
+/* Structure of an L1 slot consists of a line the thread holds a
+ * reference to, its hash, and the hits not yet added to its freq.
+ */
+struct l1_slot {
+  line *lion;
+  unsigned long hash;
+  unsigned int hits;
+};
+/* The L1 of this thread (there's one cache per process) & its bytes */
+static __thread struct l1_slot l1[L1_SLOTS];
+static __thread size_t l1_bytes;
+/* The dice of line_ahead, per thread (0: not seeded yet) */
+static __thread unsigned int ahead_seed;
+/* Pin table of this process in every shared cache (-1: it's no worker) */
+static int pin_worker = -1;
+
+static void l1_drop(cache *cash, struct l1_slot *slot);
+static void line_unpin(cache *cash, line *lion);
+static void pin_stats(cache *cash, FILE *fp);
+static line *heap_top(cache *cash, int cls);
 
 
 /*****************
@@ -19,16 +82,220 @@
  *****************/
 
 /* Note: malloc for cache outside of init
- * cache_init - initialize shared cache [cash] & read-write locks
+ * cache_init - initialize shared cache [cash] with limits [cfg] & 
+ *              read-write locks
  */
-void cache_init(cache *cash, pthread_rwlock_t *lock)
+void cache_init(cache *cash, pthread_rwlock_t *lock, cconfig *cfg)
 { 
+  int i;
+
   /* Initialize read-write lock */
-  Pthread_rwlock_init(lock, NULL);
+  cash->lock = lock;
+  cash->cfg = *cfg;
+  cache_locks(cash);
 
   /* Init cache to empty state */
   cash->size = 0;
-  cash->start = NULL;
+  cash->nlines = 0;
+  if (cash->cfg.max_lines == 0)
+    cash->cfg.max_lines = cash->cfg.capacity / LINE_AVG_SIZE + 1;
+  cash->objective = GDSF_OBJ_HIT;
+  cash->inflation = 0;
+  memset(cash->heaps, 0, sizeof(cash->heaps));
+  memset(cash->wheel, 0, sizeof(cash->wheel));
+  cash->wheel_at = 0;
+  cash->expired = 0;
+  cash->demoted = 0;
+  cash->refreshed = 0;
+  cash->ahead = 0;
+  /* One bucket per line at most */
+  cash->nbuckets = 1;
+  while (cash->nbuckets < cash->cfg.max_lines)
+    cash->nbuckets *= 2;
+  cash->buckets = cache_map(cash->nbuckets * sizeof(line *), cfg->shared);
+  cash->spill = NULL;
+  cash->spill_arg = NULL;
+  /* Reserve the cache's memory (no chunk is bigger than a segment) */
+  memset(&cash->mem, 0, sizeof(cash->mem)); // no slab classes in a log
+  if (cash->cfg.store == STORE_LOG)
+    log_init(&cash->log, cash->cfg.capacity, SEG_SIZE - SLAB_CHUNK_HDR,
+             cfg->shared, cfg->hugetlb);
+  else
+    slab_init(&cash->mem, cash->cfg.capacity, SEG_SIZE - SLAB_CHUNK_HDR,
+              cfg->shared, cfg->hugetlb);
+  sketch_init(&cash->hot, cash->cfg.max_lines, cfg->shared);
+  cash->pins = cfg->shared ? 
+               cache_map(PIN_WORKERS * sizeof(struct pin_table), 1) : NULL;
+  /* Shared heaps can't be realloc'd: each gets room for every line */
+  if (cfg->shared)
+    for (i = 0; i < cash->mem.nclasses; i++) {
+      cash->heaps[i].lines = cache_map(cash->cfg.max_lines * sizeof(line *), 1);
+      cash->heaps[i].cap = (int)cash->cfg.max_lines;
+    }
+}
+
+/*
+ * cache_locks - initialize the locks of cache [cash]; a shared cache's
+ *               locks work across processes, and its fill lock 
+ *               survives a process that dies holding it
+ */
+static void cache_locks(cache *cash)
+{
+  int pshared = cash->cfg.shared ? PTHREAD_PROCESS_SHARED : 
+                                   PTHREAD_PROCESS_PRIVATE;
+  pthread_rwlockattr_t rwattr;
+  pthread_mutexattr_t mattr;
+  pthread_condattr_t cattr;
+
+  pthread_rwlockattr_init(&rwattr);
+  pthread_rwlockattr_setpshared(&rwattr, pshared);
+  Pthread_rwlock_init(cash->lock, &rwattr);
+  pthread_rwlockattr_destroy(&rwattr);
+
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_setpshared(&mattr, pshared);
+  if (cash->cfg.shared)
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&cash->fill_lock, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setpshared(&cattr, pshared);
+  pthread_cond_init(&cash->fill_cond, &cattr);
+  pthread_condattr_destroy(&cattr);
+}
+
+/*
+ * cache_map - allocate [size] zeroed bytes for a cache, shared with
+ *             processes forked later on if [shared]; returns them
+ *
+ * Note: shared memory is only reserved up front, and never freed
+ */
+void *cache_map(size_t size, int shared)
+{
+  if (!shared)
+    return Calloc(1, size);
+  return Mmap(NULL, size, PROT_READ | PROT_WRITE, 
+              MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+
+/*
+ * cache_attach - take pin table [worker] (< PIN_WORKERS) of shared cache
+ *                [cash] for the calling worker process, so the 
+ *                references it takes can be dropped if it dies
+ */
+void cache_attach(cache *cash, int worker)
+{
+  pin_worker = worker;
+  cash->pins[worker].lost = 0;
+  cash->pins[worker].pid = getpid();
+}
+
+/*
+ * cache_recover - clean up shared cache [cash] after worker process 
+ *                 [pid] died: the lines it was filling are removed, or
+ *                 their readers would wait for them forever, and every
+ *                 reference in its pin table (the fills', the reads' & 
+ *                 its threads' L1s') is dropped;
+ *                 returns 0, or -1 if the cache lock doesn't come free
+ *                 (the worker died holding it; see cache_reset)
+ *
+ * Note: references that didn't fit in its pin table are lost with it,
+ *       so those lines stay allocated until the cache is reset
+ */
+int cache_recover(cache *cash, pid_t pid)
+{
+  struct timespec deadline;
+  struct pin_table *pt = NULL;
+  line *lion, *next;
+  size_t b;
+  int i;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += CACHE_RECOVER_WAIT;
+  /* WRITING */
+  if (pthread_rwlock_timedwrlock(cash->lock, &deadline) != 0)
+    return -1;
+  for (b = 0; b < cash->nbuckets; b++)
+    for (lion = cash->buckets[b]; lion != NULL; lion = next) {
+      next = lion->next;
+      if (lion->state == LINE_FILLING && lion->filler == pid)
+        remove_line(cash, lion);
+    }
+  /* Its references */
+  for (i = 0; cash->pins != NULL && i < PIN_WORKERS; i++)
+    if (cash->pins[i].pid == pid)
+      pt = &cash->pins[i];
+  for (i = 0; pt != NULL && i < PIN_SLOTS; i++)
+    if ((lion = pt->lines[i]) != NULL) {
+      pt->lines[i] = NULL;
+      if (__sync_sub_and_fetch(&lion->refcnt, 1) == 0)
+        free_line(cash, lion);
+    }
+  if (pt != NULL) pt->pid = 0;
+  Pthread_rwlock_unlock(cash->lock);
+  return 0;
+}
+
+/*
+ * cache_reset - empty shared cache [cash] & re-initialize its locks, 
+ *               after a worker died holding them
+ *
+ * Note: no other process may be using the cache
+ */
+void cache_reset(cache *cash)
+{
+  int i;
+
+  cache_locks(cash);
+  cash->size = 0;
+  cash->nlines = 0;
+  cash->inflation = 0;
+  memset(cash->buckets, 0, cash->nbuckets * sizeof(line *));
+  memset(cash->wheel, 0, sizeof(cash->wheel));
+  for (i = 0; i < SLAB_MAX_CLASSES; i++)
+    cash->heaps[i].len = 0;
+  for (i = 0; cash->pins != NULL && i < PIN_WORKERS; i++)
+    if (cash->pins[i].pid != 0)
+      memset(&cash->pins[i], 0, sizeof(struct pin_table));
+  if (cash->cfg.store == STORE_LOG)
+    log_reset(&cash->log);
+  else
+    slab_reset(&cash->mem);
+}
+
+/*
+ * cache_resize - let cache [cash] use [budget] bytes of memory (no 
+ *                more than it reserved at cache_init): over a lower 
+ *                budget, lines are evicted (GDSF, or oldest segments 
+ *                first) and then whole slab pages are emptied until 
+ *                the store fits; returns the budget in effect
+ *
+ * Note: hold the writer lock; memory still read by someone is given
+ *       back when the last reader is done
+ */
+size_t cache_resize(cache *cash, size_t budget)
+{
+  size_t tries;
+
+  if (budget < cash->cfg.max_object)
+    budget = cash->cfg.max_object;
+  wheel_turn(cash, time(NULL));
+  if (cash->cfg.store == STORE_LOG) {
+    log_limit(&cash->log, budget);
+    while (store_used(cash) > store_capacity(cash) && evict_some(cash))
+      ;
+    return store_capacity(cash);
+  }
+  slab_limit(&cash->mem, budget);
+  while (cash->size > store_capacity(cash) && evict_some(cash))
+    ;
+  // Lines left may be spread over more pages than the limit
+  for (tries = cash->mem.npages; 
+       store_used(cash) > store_capacity(cash) && tries > 0; tries--)
+    if (!slab_reassign(&cash->mem, -1, evict_owner, cash))
+      break;
+  return store_capacity(cash);
 }
 
 /*
@@ -38,7 +305,8 @@ void cache_init(cache *cash, pthread_rwlock_t *lock)
 int cache_full(cache *cash)
 {
   // The cache is full if there isn't enough room for another object
-  return ((MAX_CACHE_SIZE - (cash->size)) < MAX_OBJECT_SIZE);
+  return (cash->size + cash->cfg.max_object > store_capacity(cash)
+          || cash->nlines >= cash->cfg.max_lines);
 }
 
 /*
@@ -47,22 +315,31 @@ int cache_full(cache *cash)
  */
 void cache_free(cache *cash) 
 {
-  /* Need a ptr to keep track of next so current->next can be freed */
-  line *lion = cash->start;
-  line *nextlion = lion->next;
+  /* Need a ptr to keep track of next so current can be freed */
+  line *lion, *nextlion;
+  size_t b;
+  int i;
   /* Free all the lines in the cache */
-  while (lion != NULL) {
-    /* Free a line */
-    free_line(cash, lion);
-    Free(lion->next); 
-    lion = nextlion;
-    /* Get the next line to be freed */
-    if (nextlion != NULL)
-      nextlion = nextlion->next;
-    else break; // end of cache
+  for (b = 0; b < cash->nbuckets; b++) {
+    lion = cash->buckets[b];
+    while (lion != NULL) {
+      nextlion = lion->next;
+      free_line(cash, lion);
+      lion = nextlion;
+    }
+    cash->buckets[b] = NULL;
+  }
+  memset(cash->wheel, 0, sizeof(cash->wheel));
+  cash->size = 0;
+  cash->nlines = 0;
+  /* Free the eviction heaps (shared ones are kept for good) */
+  for (i = 0; i < SLAB_MAX_CLASSES; i++) {
+    cash->heaps[i].len = 0;
+    if (cash->cfg.shared) continue;
+    Free(cash->heaps[i].lines);
+    cash->heaps[i].lines = NULL;
+    cash->heaps[i].cap = 0;
   }
-  /* Free start of cache */
-  Free(cash->start);
 }
 
 
@@ -72,32 +349,41 @@ void cache_free(cache *cash)
 
 /*
  * in_cache - determines if a web object in question (host/path)
- *            is already in the cache;
- *            returns pointer to line if it is, NULL if it isn't
+ *            is already in the cache (& still fresh), in the variant
+ *            for the request head [req] ([rlen] bytes) the proxy
+ *            sends for it; returns pointer to line if it is, NULL if
+ *            it isn't
+ *
+ * Note: the line comes with a reference; drop it with line_put. A 
+ *       stale line is left for the wheel (or a fresh copy) to remove
  */
-line *in_cache(cache *cash, char *host, char *path)
+line *in_cache(cache *cash, char *host, char *path, char *req, size_t rlen)
 {
-  size_t hp = strlen(host) + strlen(path) + 2;
-  char loc[hp];
-
-  memset(loc, 0, sizeof(loc));
+  unsigned long hash = loc_hash(host, path);
+  size_t hl = strlen(host);
+  time_t now = time(NULL);
 
   /* CRITICAL SECTION: READING */ 
   /* Nothing is in the cache if it's empty */
-  if (cash->size == 0) return NULL;
-  /* Incr. age of lines */
-  age_lines(cash);
-  /* Create the location given host and path */
-  strcat(loc, host);
-  strcat(loc, path);
-
-  /* Determine if this object is cached */
+  if (cash->nlines == 0) return NULL;
+
+  /* Determine if this object is cached (loc is host followed by path) */
   line *object = NULL;
-  line *lion = cash->start;
+  line *lion = cash->buckets[hash & (cash->nbuckets - 1)];
   while (lion != NULL) 
   {
-    if (!strcmp(loc, lion->loc)) {
+    if (lion->hash == hash && !strncmp(lion->loc, host, hl) &&
+        !strcmp(lion->loc + hl, path) && !line_stale(lion, now) &&
+        line_match(lion, req, rlen)) {
       object = lion;
+      // Only the read lock is held: count the hit atomically and let
+      // choose_evict re-rank the line lazily
+      __sync_fetch_and_add(&object->freq, 1);
+      __sync_fetch_and_add(&object->refcnt, 1);
+      line_pin(cash, object);
+      sketch_add(&cash->hot, hash, 1);
+      if (cash->mem.nnodes > 1) // zeroed in a log
+        slab_hit(&cash->mem, object, 1);
       break; // Object found!
     }
     lion = lion->next;
@@ -108,80 +394,241 @@ line *in_cache(cache *cash, char *host, char *path)
 }
 
 /*
- * make_line - create a line that can be inserted into the cache using 
+ * stale_line - find the complete but stale copy of host/path in the 
+ *              cache (kept to be revalidated, or served stale for a
+ *              while); returns the line, or NULL if there's none
+ *
+ * Note: the line comes with a reference (drop it with line_put), but
+ *       no hit is counted: the origin decides if it's still good
+ */
+line *stale_line(cache *cash, char *host, char *path, char *req, 
+                 size_t rlen)
+{
+  return find_ready(cash, host, path, req, rlen, 1);
+}
+
+/*
+ * peek_line - find the complete copy of host/path in the cache, fresh 
+ *             or stale; returns the line, or NULL if there's none
+ *
+ * Note: like stale_line, the line comes with a reference but no hit
+ *       is counted
+ */
+line *peek_line(cache *cash, char *host, char *path, char *req, 
+                size_t rlen)
+{
+  return find_ready(cash, host, path, req, rlen, 0);
+}
+
+/*
+ * find_ready - find the complete copy of host/path in cache [cash] (if
+ *              [stale], only a stale one) in the variant for request 
+ *              head [req] ([rlen] bytes) & take a reference to it;
+ *              returns the line, or NULL if there's none
+ */
+static line *find_ready(cache *cash, char *host, char *path, char *req,
+                        size_t rlen, int stale)
+{
+  unsigned long hash = loc_hash(host, path);
+  size_t hl = strlen(host);
+  time_t now = time(NULL);
+  line *lion;
+
+  /* CRITICAL SECTION: READING */ 
+  for (lion = cash->buckets[hash & (cash->nbuckets - 1)]; lion != NULL;
+       lion = lion->next)
+    if (lion->hash == hash && !strncmp(lion->loc, host, hl) &&
+        !strcmp(lion->loc + hl, path) && 
+        (!stale || line_stale(lion, now)) &&
+        __atomic_load_n(&lion->state, __ATOMIC_ACQUIRE) == LINE_READY &&
+        line_match(lion, req, rlen)) {
+      __sync_fetch_and_add(&lion->refcnt, 1);
+      line_pin(cash, lion);
+      return lion;
+    }
+  /* END CRITICAL SECTION */
+  return NULL;
+}
+
+/*
+ * line_match - whether line [lion] holds the variant of its object for
+ *              request head [req] ([rlen] bytes), as any line that 
+ *              doesn't vary does
+ */
+static int line_match(line *lion, char *req, size_t rlen)
+{
+  return lion->vary == 0 || 
+         lion->vary == http_vary(lion->obj + lion->desc.vary.off,
+                                 lion->desc.vary.len, req, rlen);
+}
+
+/*
+ * line_refresh - make line [lion] of cache [cash] fresh (again) until
+ *                [expires] (the origin said it's not modified: it's as
+ *                good as new, Age included) & rank it like it was never
+ *                demoted
+ *
+ * Note: hold the write lock
+ */
+void line_refresh(cache *cash, line *lion, time_t expires)
+{
+  if (lion->state != LINE_READY) return;
+  wheel_del(cash, lion);
+  lion->expires = expires;
+  lion->desc.date = time(NULL);
+  lion->desc.age = 0;
+  wheel_add(cash, lion);
+  lion->pfreq = lion->freq;
+  lion->pri = line_priority(cash, lion);
+  if (lion->hidx >= 0)
+    heap_sift(cash, lion);
+  cash->refreshed++;
+}
+
+/*
+ * loc_hash - hash the location of an object (host followed by path)
+ *            with 64-bit FNV-1a
+ */
+unsigned long loc_hash(char *host, char *path)
+{
+  unsigned long hash = 14695981039346656037UL;
+  char *p;
+
+  for (p = host; *p; p++) 
+    hash = (hash ^ (unsigned char)*p) * 1099511628211UL;
+  for (p = path; *p; p++) 
+    hash = (hash ^ (unsigned char)*p) * 1099511628211UL;
+  return hash;
+}
+
+/*
+ * make_line - create a line that can be inserted into cache [cash] using 
  *             a given hostname [host], path to an object [path], size of
- *             the object [size],and the object as it would be returned 
- *             to the client [object];
- *             returns a pointer to this line
+ *             the object [size], the object as it would be returned 
+ *             to the client [object], the time it took to fetch it
+ *             from the origin in usec [cost], when it goes stale
+ *             [expires] & the variant it is [vary] (see http_variant);
+ *             returns a pointer to this line, or NULL if it can't fit
+ *
+ * Note: allocating the line may evict others, so hold the write lock
  */
-line *make_line(char *host, char *path, char *object, size_t obj_size)
+line *make_line(cache *cash, char *host, char *path, char *object, 
+               size_t obj_size, unsigned long cost, time_t expires,
+               unsigned long vary)
 {
   /* Variables to build the elements of the line */
   line *lion;
 
-  size_t loc_size = strlen(host) + strlen(path) + 2;
-  char location[loc_size];
-
-  memset(location, 0, sizeof(location));
+  size_t loc_size = strlen(host) + strlen(path) + 1;
+  size_t need = sizeof(struct cache_line) + loc_size + obj_size + 1;
 
-  /* Allocate space for this line */ 
-  lion = Malloc(sizeof(struct cache_line)); 
+  /* Allocate space for this line from the store */ 
+  if (obj_size > cash->cfg.max_object)
+    return NULL;
+  while (cash->nlines >= cash->cfg.max_lines) // too many lines
+    if (!evict_some(cash)) return NULL;
+  if ((lion = chunk_alloc(cash, need, NULL)) == NULL)
+    return NULL; // too big, or nothing left to evict
+  lion->cls = cash->cfg.store == STORE_LOG ? -1 : 
+              slab_class(&cash->mem, need);
 
-  /* Set size and age of line */
-    lion->size = (unsigned int)obj_size;
-    lion->age = 0;
+  /* Set size, state and GDSF bookkeeping of line */
+    lion->size = obj_size;
+    lion->olen = obj_size;
+    lion->state = LINE_READY;
+    lion->refcnt = 1; // the cache's own reference
+    lion->freq = 1;
+    lion->pfreq = 0;
+    lion->cost = cost ? cost : 1;
+    lion->pri = 0;
+    lion->hidx = -1;
+    lion->filler = 0;
+    lion->expires = expires;
+    lion->wnext = lion->wprev = NULL;
+    lion->vary = vary;
+    http_describe(object, obj_size, time(NULL), &lion->desc);
 
   /* Set the location of the line (identifier) */
+  // loc follows the line in its chunk
+    lion->loc = (char *)(lion + 1);
   // Combine host & path
-    strcat(location, host);
-    strcat(location, path);
-
-  // Allocate space for loc
-    loc_size = strlen(location) + 1;
-    lion->loc = Malloc(loc_size);
-  // Finish
-    memcpy(lion->loc, location, loc_size);
+    strcpy(lion->loc, host);
+    strcat(lion->loc, path);
+    lion->hash = loc_hash(host, path);
 
   /* Set the object of the line (core purpose of line) */
-  // Allocate space for obj
-    lion->obj = Malloc(obj_size+1);
+  // obj follows loc in the chunk
+    lion->obj = lion->loc + loc_size;
   // Finish
     memcpy(lion->obj, object, obj_size);
+    lion->obj[obj_size] = '\0';
 
   /* A brand new line is alone in the world until added to cache */
+  lion->segs = lion->tail = NULL;
   lion->next = NULL; 
 
   return lion;
 }
 
 /* 
- * add_line - add a line [lion] to the cache and evict if necessary
+ * add_line - add a line [lion] to the cache (make_line already evicted
+ *            whatever was necessary to make room for it); it replaces
+ *            older copies of its variant, and the oldest variant of 
+ *            its object if there are VARY_MAX already
  *
  * Note: must call make_line before adding a line
  */
 void add_line(cache *cash, line *lion) 
 {
+  line *old, *next, *oldest = NULL;
+  int variants = 0;
+
   /* CRITICAL SECTION: WRITE */
-  /* If the cache is full, choose a line to evict & remove it */
-  if (cache_full(cash))
-    remove_line(cash, choose_evict(cash));
-  /* Insert the line at the beginning of the list */
-  lion->next = cash->start;
-  cash->start = lion;
+  /* Nothing to add if make_line couldn't find room */
+  if (lion == NULL) return;
+  /* Insert the line at the beginning of its bucket */
+  line **bucket = &cash->buckets[lion->hash & (cash->nbuckets - 1)];
+  lion->next = *bucket;
+  *bucket = lion;
+  /* It replaces older complete copies (stale ones, most likely) */
+  for (old = lion->next; old != NULL; old = next) {
+    next = old->next;
+    if (old->hash != lion->hash || old->state != LINE_READY ||
+        strcmp(old->loc, lion->loc))
+      continue;
+    if (old->vary == lion->vary)
+      remove_line(cash, old);
+    else {
+      variants++;
+      oldest = old; // the bucket goes from newest to oldest
+    }
+  }
+  if (variants >= VARY_MAX)
+    remove_line(cash, oldest);
+  wheel_add(cash, lion);
   /* Update the cache size accordingly */
   cash->size += lion->size;
+  cash->nlines++;
+  /* Rank the line against the current inflation value */
+  lion->pfreq = lion->freq;
+  lion->pri = line_priority(cash, lion);
+  if (lion->cls >= 0)
+    heap_push(cash, lion);
   /* END CRITICAL SECTION */
 }
 
 /*
- * age_lines - age the cache (for LRU policy)
+ * line_priority - compute the GDSF priority of line [lion];
+ *                 the byte hit objective drops the size term so that
+ *                 large objects aren't penalized
  */
-void age_lines(cache *cash)   
+double line_priority(cache *cash, line *lion)
 {
-  line *lion = cash->start;
-  /* Increment age of all lines */
-  while (lion != NULL) 
-  { (lion->age)++; lion = lion->next; }
+  double value = (double)lion->freq * (double)lion->cost;
+
+  if (cash->objective == GDSF_OBJ_HIT)
+    value /= (lion->size ? lion->size : 1);
+  return cash->inflation + value;
 }
 
 /*
@@ -189,66 +636,773 @@ void age_lines(cache *cash)
  */
 void remove_line(cache *cash, line *lion) 
 {
-  line *tmp = cash->start;
-  /* Case: first line of cache */
+  line **bucket, *tmp;
+  /* Case: nothing to remove (or already removed) */
+  if (lion == NULL || lion->state == LINE_DEAD) return;
+  /* Take line out of the eviction heap & the expiry wheel */
+  if (lion->hidx >= 0)
+    heap_remove(cash, lion);
+  wheel_del(cash, lion);
+  bucket = &cash->buckets[lion->hash & (cash->nbuckets - 1)];
+  tmp = *bucket;
+  /* Case: first line of bucket */
   if (tmp == lion) {
-  // Adjust start of cache
-    cash->start = lion->next;
-  // Fully free line
-    free_line(cash, lion);
-    free(lion);
-    return;
+  // Adjust start of bucket
+    *bucket = lion->next;
   }
-  while (tmp != NULL)
-  {
-    /* Case: middle line of cache */
-    if (tmp->next == lion) {
-    // Adjust previous line's next ptr
-      tmp->next = lion->next;
-    // Fully free line
-      free_line(cash, lion);
-      free(lion);
+  else {
+    /* Case: middle line of bucket */
+    while (tmp != NULL && tmp->next != lion)
+      tmp = tmp->next;
+    /* Case: line not found.. can't remove */
+    if (tmp == NULL) {
+      cache_error("remove_line error: line not found");
       return;
     }
-    /* Continue */
-    else tmp = tmp->next;
+  // Adjust previous line's next ptr
+    tmp->next = lion->next;
   }
-  /* Case: line not found.. can't remove */
-  cache_error("remove_line error: line not found");
+  /* Update the cache size accordingly */
+  cash->size -= lion->size;
+  cash->nlines--;
+  /* Wake up anyone waiting on the line's segments */
+  lock_fill(cash);
+  lion->state = LINE_DEAD;
+  pthread_cond_broadcast(&cash->fill_cond);
+  pthread_mutex_unlock(&cash->fill_lock);
+  /* Drop the cache's reference; readers free it otherwise */
+  if (__sync_sub_and_fetch(&lion->refcnt, 1) == 0)
+    free_line(cash, lion);
 }
 
 /*
- * choose_evict - choose a line to evict using an LRU policy;
- *                return a pointer to the chosen line
+ * remove_loc - remove every line of host/path from the cache, each 
+ *              variant & any still filling (the object changed at its
+ *              origin); returns how many were removed
  */
-line *choose_evict(cache *cash)          
+int remove_loc(cache *cash, char *host, char *path)
 {
-  line *evict, *lion;
-  int eldest = -1;
+  unsigned long hash = loc_hash(host, path);
+  size_t hl = strlen(host);
+  line *lion, *next;
+  int n = 0;
 
-  lion = cash->start;
-  evict = lion;
-  /* Search the cache for the oldest line */
-  while (lion != NULL) {
-    if (lion->age > eldest) {
-      eldest = lion->age;
-      evict = lion;
+  for (lion = cash->buckets[hash & (cash->nbuckets - 1)]; lion != NULL;
+       lion = next) {
+    next = lion->next;
+    if (lion->hash == hash && !strncmp(lion->loc, host, hl) &&
+        !strcmp(lion->loc + hl, path)) {
+      remove_line(cash, lion);
+      n++;
     }
-    lion = lion->next;
   }
-  return evict;
+  return n;
+}
+
+/*
+ * choose_evict - choose a line of slab class [cls] (any class if -1)
+ *                to evict using the GDSF policy and inflate L to its 
+ *                priority;
+ *                return a pointer to the chosen line (NULL if empty)
+ */
+line *choose_evict(cache *cash, int cls)          
+{
+  line *lion = NULL, *top;
+  int i;
+
+  if (cls >= 0)
+    lion = heap_top(cash, cls);
+  /* Lowest priority among the tops of all heaps */
+  else for (i = 0; i < cash->mem.nclasses; i++) {
+    top = heap_top(cash, i);
+    if (top != NULL && (lion == NULL || top->pri < lion->pri))
+      lion = top;
+  }
+  /* Inflate L so that lines still in the cache age relative to new ones */
+  if (lion != NULL)
+    cash->inflation = lion->pri;
+  return lion;
+}
+
+/*
+ * heap_top - return the lowest priority line of class [cls] (NULL if
+ *            there are none)
+ *
+ * Note: hits only bump freq, so a line whose freq changed since it was
+ *       ranked is re-ranked (at the current L) before it can be evicted
+ */
+static line *heap_top(cache *cash, int cls)
+{
+  struct evict_heap *heap = &cash->heaps[cls];
+  line *lion;
+
+  if (heap->len == 0) return NULL;
+  /* Re-rank stale lines at the top of the heap */
+  lion = heap->lines[0];
+  while (lion->pfreq != lion->freq) {
+    lion->pfreq = lion->freq;
+    lion->pri = line_priority(cash, lion);
+    heap_sift(cash, lion);
+    lion = heap->lines[0];
+  }
+  return lion;
 }
 
 /* 
- * free_line - free a specified line [lion] from cache [cash]
+ * free_line - free a specified line [lion] & its segments from cache 
+ *             [cash] (remove_line already updated the cache size)
  */
 void free_line(cache *cash, line *lion)
 {
-  /* Before freeing, update cache size */
-  cash->size -= lion->size;
-  /* Free elements of line (except next--needed for freeing cache) */
-  Free(lion->loc);
-  Free(lion->obj);
+  size_t need = sizeof(struct cache_line) + strlen(lion->loc) + 1 + 
+                lion->olen + 1;
+  struct segment *seg, *next;
+
+  /* Segments go back to the store */
+  for (seg = lion->segs; seg != NULL; seg = next) {
+    next = seg->next;
+    chunk_free(cash, seg, sizeof(struct segment) + seg->len);
+  }
+  /* Line, loc & first part of obj go back to the store together */
+  chunk_free(cash, lion, need);
+}
+
+/*
+ * evict_owner - slab_reassign callback: evict the line owning a chunk
+ *               (a line owns its segments' chunks too)
+ */
+static void evict_owner(void *owner, void *arg)
+{
+  evict_line((cache *)arg, (line *)owner);
+}
+
+/*
+ * evict_line - remove line [lion] from cache [cash] to make room, 
+ *              handing it to the spill callback first if it's complete
+ */
+static void evict_line(cache *cash, line *lion)
+{
+  if (lion == NULL) return;
+  if (cash->spill != NULL && lion->state == LINE_READY)
+    cash->spill(cash, lion, cash->spill_arg);
+  remove_line(cash, lion);
+}
+
+/*
+ * evict_some - evict the next victim of cache [cash] (a line from the
+ *              slab, a whole segment from the log);
+ *              returns 1 if something was evicted, 0 if it's empty
+ */
+static int evict_some(cache *cash)
+{
+  line *lion;
+
+  if (cash->cfg.store == STORE_LOG)
+    return log_evict(&cash->log, log_evict_owner, cash);
+  if ((lion = choose_evict(cash, -1)) == NULL)
+    return 0;
+  evict_line(cash, lion);
+  return 1;
+}
+
+/*
+ * log_evict_owner - log_evict callback: a complete one-chunk line that
+ *                   was hit since it was stored (& isn't being read) 
+ *                   moves to the open segment, any other line owning a
+ *                   record is evicted
+ */
+static void log_evict_owner(void *owner, void *arg)
+{
+  cache *cash = (cache *)arg;
+  line *lion = (line *)owner, *moved, **prev;
+  size_t need = sizeof(struct cache_line) + strlen(lion->loc) + 1 + 
+                lion->olen + 1;
+
+  if (lion->freq > 1 && lion->state == LINE_READY && lion->refcnt == 1 &&
+      lion->segs == NULL &&
+      (moved = log_alloc(&cash->log, need, NULL)) != NULL) {
+    wheel_del(cash, lion);
+    memcpy(moved, lion, need);
+    wheel_add(cash, moved);
+    moved->loc = (char *)(moved + 1);
+    moved->obj = moved->loc + (lion->obj - lion->loc);
+    moved->freq = 1; // has to be hit again to be moved again
+    // Point the index at the copy
+    prev = &cash->buckets[lion->hash & (cash->nbuckets - 1)];
+    while (*prev != lion)
+      prev = &(*prev)->next;
+    *prev = moved;
+    log_free(&cash->log, lion, need);
+    cash->log.reinserted++;
+    return;
+  }
+  evict_line(cash, lion);
+}
+
+
+/******************
+ * EXPIRY FUNCTIONS
+ ******************/
+
+/*
+ * line_stale - whether line [lion] is past its expiry time at [now]
+ */
+static int line_stale(line *lion, time_t now)
+{
+  return lion->expires != 0 && lion->expires <= now;
+}
+
+/*
+ * line_ahead - whether hot line [lion] of cache [cash] should be fetched
+ *              again before it expires (XFetch): true once now, pushed
+ *              ahead by its fetch cost times XFETCH_BETA times a random
+ *              -ln(u), reaches its expiry time. A line hit more often
+ *              rolls more often, and a slow one starts rolling earlier
+ *
+ * Note: no lock is needed
+ */
+int line_ahead(cache *cash, line *lion)
+{
+  struct timeval tv;
+  double now, gap, u;
+
+  if (lion->expires == 0 ||
+      sketch_estimate(&cash->hot, lion->hash) < HOT_MIN)
+    return 0;
+  gettimeofday(&tv, NULL);
+  now = tv.tv_sec + tv.tv_usec / 1e6;
+  if (now >= (double)lion->expires) // stale already
+    return 0;
+  if (ahead_seed == 0)
+    ahead_seed = (unsigned int)(pthread_self() ^ tv.tv_usec) | 1;
+  u = (rand_r(&ahead_seed) + 1.0) / ((double)RAND_MAX + 2.0);
+  gap = lion->cost / 1e6 * XFETCH_BETA * -log(u);
+  if (now + gap < (double)lion->expires)
+    return 0;
+  __sync_fetch_and_add(&cash->ahead, 1);
+  return 1;
+}
+
+/*
+ * wheel_add - put line [lion] of cache [cash] in the wheel slot of its
+ *             expiry time (lines that never expire stay out)
+ */
+static void wheel_add(cache *cash, line *lion)
+{
+  line **slot;
+
+  if (lion->expires == 0) return;
+  slot = &cash->wheel[(lion->expires / WHEEL_TICK) % WHEEL_SLOTS];
+  lion->wprev = NULL;
+  lion->wnext = *slot;
+  if (*slot) (*slot)->wprev = lion;
+  *slot = lion;
+}
+
+/*
+ * wheel_del - take line [lion] of cache [cash] out of the wheel
+ */
+static void wheel_del(cache *cash, line *lion)
+{
+  if (lion->expires == 0) return;
+  if (lion->wprev) lion->wprev->wnext = lion->wnext;
+  else cash->wheel[(lion->expires / WHEEL_TICK) % WHEEL_SLOTS] = lion->wnext;
+  if (lion->wnext) lion->wnext->wprev = lion->wprev;
+  lion->wnext = lion->wprev = NULL;
+}
+
+/*
+ * wheel_turn - remove the stale lines of every wheel slot of cache 
+ *              [cash] whose tick is over by [now]; lines of the same
+ *              slot that expire on a later turn stay, and so do those
+ *              that can be revalidated or may still be served stale
+ *              (see http_stale), but they're ranked to be evicted 
+ *              before anything fresh
+ *
+ * Note: each slot is swept once per tick, so this is cheap enough to
+ *       call before every allocation
+ */
+static void wheel_turn(cache *cash, time_t now)
+{
+  time_t tick = now / WHEEL_TICK;
+  line *lion, *next;
+
+  if (cash->wheel_at == 0 || tick - cash->wheel_at > WHEEL_SLOTS)
+    cash->wheel_at = tick - (cash->wheel_at == 0 ? 0 : WHEEL_SLOTS);
+  for (; cash->wheel_at < tick; cash->wheel_at++)
+    for (lion = cash->wheel[cash->wheel_at % WHEEL_SLOTS]; lion; lion = next) {
+      next = lion->wnext;
+      // A filling line goes when its fill is done
+      if (!line_stale(lion, now) || lion->state != LINE_READY)
+        continue;
+      if (lion->desc.etag.len == 0 && lion->desc.lastmod.len == 0 &&
+          http_stale(lion->obj, lion->olen, lion->expires, NULL,
+                     cash->cfg.swr, cash->cfg.sie) <= now) {
+        remove_line(cash, lion);
+        cash->expired++;
+      }
+      // A log keeps it until its segment goes, like any other line
+      else if (lion->pri != 0) { // (or it was demoted on an earlier turn)
+        lion->pfreq = lion->freq;
+        lion->pri = 0;
+        if (lion->hidx >= 0)
+          heap_sift(cash, lion);
+        cash->demoted++;
+      }
+    }
+}
+
+
+/*****************
+ * STORE FUNCTIONS
+ *****************/
+
+/*
+ * chunk_alloc - allocate [need] bytes owned by line [owner] (NULL: the
+ *               chunk is a new line) from the store of cache [cash], 
+ *               evicting (but never [owner]) until they fit;
+ *               returns the chunk, or NULL if it can't fit
+ *
+ * Note: [owner] may still be evicted with a log segment or a stolen
+ *       slab page, so check its state afterwards
+ */
+static void *chunk_alloc(cache *cash, size_t need, line *owner)
+{
+  line *victim;
+  void *ptr;
+  int cls;
+
+  /* Stale lines are the first to go */
+  wheel_turn(cash, time(NULL));
+  /* Log: evict the oldest segments until a free one comes up */
+  if (cash->cfg.store == STORE_LOG) {
+    while ((ptr = log_alloc(&cash->log, need, owner)) == NULL)
+      if (!log_evict(&cash->log, log_evict_owner, cash))
+        return NULL;
+    return ptr;
+  }
+  /* Slab: evict from the same class, or steal a page from another */
+  if ((cls = slab_class(&cash->mem, need)) < 0)
+    return NULL; // too big for any class
+  while ((ptr = slab_alloc(&cash->mem, cls, need, owner)) == NULL) {
+    if ((victim = choose_evict(cash, cls)) != NULL) {
+      if (victim == owner) return NULL;
+      evict_line(cash, victim);
+    }
+    else if (!slab_reassign(&cash->mem, cls, evict_owner, cash))
+      return NULL;
+  }
+  return ptr;
+}
+
+/*
+ * chunk_free - give chunk [ptr] (holding [size] bytes) back to the 
+ *              store of cache [cash]
+ */
+static void chunk_free(cache *cash, void *ptr, size_t size)
+{
+  if (cash->cfg.store == STORE_LOG)
+    log_free(&cash->log, ptr, size);
+  else
+    slab_free(&cash->mem, ptr, size);
+}
+
+/*
+ * store_capacity - bytes of memory the store of cache [cash] may hold
+ */
+static size_t store_capacity(cache *cash)
+{
+  return cash->cfg.store == STORE_LOG ? log_capacity(&cash->log) :
+                                        slab_capacity(&cash->mem);
+}
+
+/*
+ * store_used - bytes of memory the store of cache [cash] holds now
+ */
+static size_t store_used(cache *cash)
+{
+  return cash->cfg.store == STORE_LOG ? log_used(&cash->log) :
+                                        slab_used(&cash->mem);
+}
+
+
+/**************************
+ * SEGMENTED LINE FUNCTIONS
+ **************************/
+
+/*
+ * line_room - how many object bytes fit in the chunk of a line for 
+ *             [host]/[path] without going over one segment
+ */
+size_t line_room(char *host, char *path)
+{
+  return SEG_SIZE - SLAB_CHUNK_HDR - sizeof(struct cache_line) - 
+         (strlen(host) + strlen(path) + 1) - 1;
+}
+
+/*
+ * line_append - copy [len] bytes of [data] into a new segment at the 
+ *               end of filling line [lion] & wake up its readers;
+ *               returns 0 on success, -1 if the line can't grow (it 
+ *               was evicted or there's no room without evicting it)
+ *
+ * Note: allocating the segment may evict others, so hold the write lock
+ */
+int line_append(cache *cash, line *lion, char *data, size_t len)
+{
+  size_t need = sizeof(struct segment) + len;
+  struct segment *seg;
+
+  if (lion->state != LINE_FILLING || 
+      lion->size + len > cash->cfg.max_object)
+    return -1;
+  /* Allocate the segment (the line owns its chunk) */
+  if ((seg = chunk_alloc(cash, need, lion)) == NULL)
+    return -1;
+  /* Making room may have evicted this line */
+  if (lion->state != LINE_FILLING) {
+    chunk_free(cash, seg, need);
+    return -1;
+  }
+  seg->next = NULL;
+  seg->len = len;
+  memcpy(seg->data, data, len);
+  lion->size += len;
+  cash->size += len;
+
+  /* Publish the segment */
+  lock_fill(cash);
+  if (lion->tail) lion->tail->next = seg;
+  else            lion->segs = seg;
+  lion->tail = seg;
+  pthread_cond_broadcast(&cash->fill_cond);
+  pthread_mutex_unlock(&cash->fill_lock);
+  return 0;
+}
+
+/*
+ * line_finish - mark filling line [lion] complete, record its total 
+ *               fetch cost [cost] & re-rank it at its final size
+ *
+ * Note: hold the write lock
+ */
+void line_finish(cache *cash, line *lion, unsigned long cost)
+{
+  if (lion->state != LINE_FILLING) return;
+  lion->cost = cost ? cost : 1;
+  lion->pfreq = lion->freq;
+  lion->pri = line_priority(cash, lion);
+  if (lion->hidx >= 0)
+    heap_sift(cash, lion);
+
+  lock_fill(cash);
+  __atomic_store_n(&lion->state, LINE_READY, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&cash->fill_cond);
+  pthread_mutex_unlock(&cash->fill_lock);
+}
+
+/*
+ * line_next - return the segment of line [lion] after [prev] (the 
+ *             first one if [prev] is NULL), waiting for it while the
+ *             line is filling; returns NULL at the end of the object,
+ *             or if the line died before it was complete
+ *
+ * Note: hold a reference, not the cache lock
+ */
+struct segment *line_next(cache *cash, line *lion, struct segment *prev)
+{
+  struct segment *seg;
+
+  /* Complete lines don't change anymore */
+  if (__atomic_load_n(&lion->state, __ATOMIC_ACQUIRE) == LINE_READY)
+    return prev ? prev->next : lion->segs;
+
+  lock_fill(cash);
+  while ((seg = prev ? prev->next : lion->segs) == NULL &&
+         lion->state == LINE_FILLING)
+    if (pthread_cond_wait(&cash->fill_cond, &cash->fill_lock) == EOWNERDEAD)
+      pthread_mutex_consistent(&cash->fill_lock);
+  pthread_mutex_unlock(&cash->fill_lock);
+  return seg;
+}
+
+/*
+ * lock_fill - take the fill lock of cache [cash] (from a worker that
+ *             died holding it, if need be: the lock only guards the
+ *             pointers of a segment chain, set in one go)
+ */
+static void lock_fill(cache *cash)
+{
+  if (pthread_mutex_lock(&cash->fill_lock) == EOWNERDEAD)
+    pthread_mutex_consistent(&cash->fill_lock);
+}
+
+/*
+ * line_put - drop a reference to line [lion]; the last reference to an 
+ *            evicted line frees it
+ *
+ * Note: takes the write lock itself if it frees the line
+ */
+void line_put(cache *cash, line *lion)
+{
+  line_unpin(cash, lion);
+  if (__sync_sub_and_fetch(&lion->refcnt, 1) == 0) {
+    /* WRITING */
+    Pthread_rwlock_wrlock(cash->lock);
+    free_line(cash, lion);
+    Pthread_rwlock_unlock(cash->lock);
+  }
+}
+
+/*
+ * line_pin - note a reference the calling worker process just took to
+ *            line [lion] of shared cache [cash] in its pin table (see
+ *            cache_recover); line_put takes it out again
+ *
+ * Note: a reference that doesn't fit is only counted; no lock is needed
+ */
+void line_pin(cache *cash, line *lion)
+{
+  struct pin_table *pt;
+  unsigned long i, n;
+
+  if (pin_worker < 0 || cash->pins == NULL) return;
+  pt = &cash->pins[pin_worker];
+  for (i = (unsigned long)lion / SLAB_MIN_CHUNK, n = 0; n < PIN_SLOTS;
+       i++, n++)
+    if (pt->lines[i & (PIN_SLOTS - 1)] == NULL &&
+        __sync_bool_compare_and_swap(&pt->lines[i & (PIN_SLOTS - 1)],
+                                     NULL, lion))
+      return;
+  __sync_fetch_and_add(&pt->lost, 1);
+}
+
+/*
+ * line_unpin - take a reference to line [lion] of shared cache [cash] 
+ *              out of the calling worker's pin table (before it's 
+ *              dropped, so one never counts twice)
+ */
+static void line_unpin(cache *cash, line *lion)
+{
+  struct pin_table *pt;
+  unsigned long i, n;
+
+  if (pin_worker < 0 || cash->pins == NULL) return;
+  pt = &cash->pins[pin_worker];
+  for (i = (unsigned long)lion / SLAB_MIN_CHUNK, n = 0; n < PIN_SLOTS;
+       i++, n++)
+    if (pt->lines[i & (PIN_SLOTS - 1)] == lion &&
+        __sync_bool_compare_and_swap(&pt->lines[i & (PIN_SLOTS - 1)],
+                                     lion, NULL))
+      return;
+}
+
+
+/**************
+ * L1 FUNCTIONS
+ **************/
+
+/*
+ * l1_find - look up [host]/[path] (in the variant for request head 
+ *           [req], [rlen] bytes) in the L1 of the calling thread;
+ *           returns its line, or NULL if it isn't there (or died)
+ *
+ * Note: the line is borrowed from the L1 (don't line_put it), and only
+ *       good until the thread's next l1_keep; no lock is needed
+ */
+line *l1_find(cache *cash, char *host, char *path, char *req, size_t rlen)
+{
+  unsigned long hash = loc_hash(host, path);
+  struct l1_slot *slot = &l1[hash & (L1_SLOTS - 1)];
+  line *lion = slot->lion;
+  size_t hl = strlen(host);
+
+  if (lion == NULL || slot->hash != hash || strncmp(lion->loc, host, hl) ||
+      strcmp(lion->loc + hl, path))
+    return NULL;
+  /* Evicted (or gone stale) since it was kept */
+  if (__atomic_load_n(&lion->state, __ATOMIC_ACQUIRE) != LINE_READY ||
+      line_stale(lion, time(NULL))) {
+    l1_drop(cash, slot);
+    return NULL;
+  }
+  /* Another variant of the object */
+  if (!line_match(lion, req, rlen))
+    return NULL;
+  /* Hits are published in batches, so GDSF & the sketch see them */
+  if (++slot->hits == L1_FLUSH) {
+    __sync_fetch_and_add(&lion->freq, slot->hits);
+    sketch_add(&cash->hot, hash, slot->hits);
+    if (cash->mem.nnodes > 1)
+      slab_hit(&cash->mem, lion, slot->hits);
+    slot->hits = 0;
+  }
+  return lion;
+}
+
+/*
+ * l1_keep - hand line [lion] & a reference to it to the L1 of the 
+ *           calling thread, in place of the line in its slot, if it's
+ *           complete & small or hot (see HOT_MIN), isn't colder than
+ *           the line in its slot, and fits in L1_MAX_BYTES; otherwise
+ *           (or if it's in a log, whose segment it would hold back) 
+ *           its reference is just dropped
+ */
+void l1_keep(cache *cash, line *lion)
+{
+  struct l1_slot *slot = &l1[lion->hash & (L1_SLOTS - 1)];
+  unsigned long heat;
+  size_t old = 0;
+
+  if (cash->cfg.store == STORE_LOG || slot->lion == lion ||
+      __atomic_load_n(&lion->state, __ATOMIC_ACQUIRE) != LINE_READY ||
+      lion->segs != NULL) {
+    line_put(cash, lion);
+    return;
+  }
+  heat = sketch_estimate(&cash->hot, lion->hash);
+  /* A live line only makes way for one at least as hot */
+  if (slot->lion != NULL &&
+      __atomic_load_n(&slot->lion->state, __ATOMIC_ACQUIRE) == LINE_READY) {
+    old = slot->lion->size;
+    if (sketch_estimate(&cash->hot, slot->hash) > heat) {
+      line_put(cash, lion);
+      return;
+    }
+  }
+  if ((lion->size > L1_MAX_OBJECT && heat < HOT_MIN) ||
+      l1_bytes - old + lion->size > L1_MAX_BYTES) {
+    line_put(cash, lion);
+    return;
+  }
+  l1_drop(cash, slot);
+  slot->lion = lion;
+  slot->hash = lion->hash;
+  slot->hits = 0;
+  l1_bytes += lion->size;
+}
+
+/*
+ * l1_sweep - let go of the lines in the calling thread's L1 that were
+ *            evicted (a kept line is only freed once the L1 drops it)
+ */
+void l1_sweep(cache *cash)
+{
+  int i;
+
+  for (i = 0; i < L1_SLOTS; i++)
+    if (l1[i].lion != NULL &&
+        __atomic_load_n(&l1[i].lion->state, __ATOMIC_ACQUIRE) != LINE_READY)
+      l1_drop(cash, &l1[i]);
+}
+
+/*
+ * l1_clear - empty the calling thread's L1 (before the thread exits)
+ */
+void l1_clear(cache *cash)
+{
+  int i;
+
+  for (i = 0; i < L1_SLOTS; i++)
+    l1_drop(cash, &l1[i]);
+}
+
+/*
+ * l1_drop - empty L1 slot [slot], publishing its hits first
+ */
+static void l1_drop(cache *cash, struct l1_slot *slot)
+{
+  line *lion = slot->lion;
+
+  if (lion == NULL) return;
+  if (slot->hits > 0) {
+    __sync_fetch_and_add(&lion->freq, slot->hits);
+    sketch_add(&cash->hot, slot->hash, slot->hits);
+  }
+  l1_bytes -= lion->size;
+  slot->lion = NULL;
+  slot->hits = 0;
+  line_put(cash, lion);
+}
+
+
+/*********************
+ * EVICTION HEAP
+ *********************/
+
+/*
+ * heap_swap - swap slots [i] and [j] of eviction heap [heap]
+ */
+static void heap_swap(struct evict_heap *heap, int i, int j)
+{
+  line *tmp = heap->lines[i];
+
+  heap->lines[i] = heap->lines[j];
+  heap->lines[j] = tmp;
+  heap->lines[i]->hidx = i;
+  heap->lines[j]->hidx = j;
+}
+
+/*
+ * heap_sift - restore heap order around line [lion] after its priority
+ *             changed (moves the line up or down as needed)
+ */
+void heap_sift(cache *cash, line *lion)
+{
+  struct evict_heap *heap = &cash->heaps[lion->cls];
+  line **lines = heap->lines;
+  int i = lion->hidx, child;
+
+  /* Move up while smaller than parent */
+  while (i > 0 && lines[i]->pri < lines[(i - 1) / 2]->pri) {
+    heap_swap(heap, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  /* Move down while larger than the smallest child */
+  while ((child = 2 * i + 1) < heap->len) {
+    if (child + 1 < heap->len && lines[child + 1]->pri < lines[child]->pri)
+      child++;
+    if (lines[i]->pri <= lines[child]->pri)
+      break;
+    heap_swap(heap, i, child);
+    i = child;
+  }
+}
+
+/*
+ * heap_push - insert line [lion] (priority already set) into the heap
+ *             of its slab class
+ */
+void heap_push(cache *cash, line *lion)
+{
+  struct evict_heap *heap = &cash->heaps[lion->cls];
+
+  /* Grow the heap if it's full */
+  if (heap->len == heap->cap) {
+    heap->cap = heap->cap ? 2 * heap->cap : 64;
+    heap->lines = Realloc(heap->lines, heap->cap * sizeof(line *));
+  }
+  lion->hidx = heap->len++;
+  heap->lines[lion->hidx] = lion;
+  heap_sift(cash, lion);
+}
+
+/*
+ * heap_remove - take line [lion] out of its heap
+ */
+void heap_remove(cache *cash, line *lion)
+{
+  struct evict_heap *heap = &cash->heaps[lion->cls];
+  int i = lion->hidx;
+
+  heap->len--;
+  /* Fill the hole with the last line & re-sift it */
+  if (i != heap->len) {
+    heap->lines[i] = heap->lines[heap->len];
+    heap->lines[i]->hidx = i;
+    heap_sift(cash, heap->lines[i]);
+  }
+  lion->hidx = -1;
 }
 
 
@@ -265,6 +1419,51 @@ void cache_error(char *msg)
   fprintf(stderr, "cache_error signaled: %s\n", msg);
 }
 
+/*
+ * pin_stats - print the references the workers of shared cache [cash]
+ *             hold in their pin tables (& lost) to [fp]
+ */
+static void pin_stats(cache *cash, FILE *fp)
+{
+  unsigned long held = 0, lost = 0;
+  int i, j, workers = 0;
+
+  for (i = 0; i < PIN_WORKERS; i++) {
+    if (cash->pins[i].pid == 0) continue;
+    workers++;
+    lost += cash->pins[i].lost;
+    for (j = 0; j < PIN_SLOTS; j++)
+      if (cash->pins[i].lines[j] != NULL) held++;
+  }
+  fprintf(fp, "pins: %lu references held by %d workers | %lu lost\n",
+          held, workers, lost);
+}
+
+/*
+ * cache_stats - print a summary of cache [cash] & its store to [fp]
+ *
+ * Note: hold at least the read lock
+ */
+void cache_stats(cache *cash, FILE *fp)
+{
+  fprintf(fp, "######## WEB CACHE STATS ########\n");
+  fprintf(fp, "lines: %zu / %zu | object bytes: %zu / %zu | "
+              "max object: %zu | L=%.3f\n",
+          cash->nlines, cash->cfg.max_lines, cash->size, 
+          store_capacity(cash), cash->cfg.max_object, 
+          cash->inflation);
+  fprintf(fp, "expired: %lu lines removed stale | %lu kept stale,"
+              " %lu revalidated | %lu refreshes asked ahead\n", 
+          cash->expired, cash->demoted, cash->refreshed, cash->ahead);
+  if (cash->pins != NULL)
+    pin_stats(cash, fp);
+  if (cash->cfg.store == STORE_LOG)
+    log_stats(&cash->log, fp);
+  else
+    slab_stats(&cash->mem, fp);
+  sketch_stats(&cash->hot, fp);
+}
+
 /* Please ignore these :) */
 /*
  * print_cache - print out the cache
@@ -272,20 +1471,22 @@ void cache_error(char *msg)
 void print_cache(cache *cash)
 {
   line *lion;
+  size_t b;
 
   printf("######## WEB CACHE START ########\n");
   printf("- CACHE STATE -\n");
-  printf("Size: %u\n", cash->size);
-  if (cash->start) printf("Start: %s\n", (cash->start)->loc);
-  else             printf("Start: NULL\n");
+  printf("Size: %zu\n", cash->size);
+  printf("Lines: %zu\n", cash->nlines);
   printf("---------------\n\n");
 
   printf("- CACHE LINES -\n");
-  lion = cash->start;
-  while (lion != NULL) 
-  {
-    print_line(lion);
-    lion = lion->next;
+  for (b = 0; b < cash->nbuckets; b++) {
+    lion = cash->buckets[b];
+    while (lion != NULL) 
+    {
+      print_line(lion);
+      lion = lion->next;
+    }
   }
   printf("---------------\n");
   printf("######### WEB CACHE END #########\n\n");
@@ -296,7 +1497,8 @@ void print_cache(cache *cash)
  */
 void print_line(line *lion)
 {
-  uint size, age;
+  size_t size;
+  uint freq;
   char *location, *object;
   line *next;
 
@@ -304,21 +1506,21 @@ void print_line(line *lion)
   if (lion) {
     /* Parts of a line */
     size     = lion->size;
-    age      = lion->age;
+    freq     = lion->freq;
     location = lion->loc;
     object   = lion->obj;
     next     = lion->next;
     /* Print this line */
     // Start & size
-    printf("[ %u bytes ", size);
+    printf("[ %zu bytes ", size);
     // Location
     if (strlen(location)) printf("| %s ", location);
     else printf("| EMPTY LOC ");
     // Object
     if (strlen(object))   printf("| . . . ", object);
     else printf("| EMPTY OBJ ");
-    // Age
-    printf("| age=%u ] ", age);
+    // Frequency
+    printf("| freq=%u ] ", freq);
     // Next & end
     if (next) // If it's another line, value=location
       printf("--> [ %s ]\n", next->loc);
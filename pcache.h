@@ -11,50 +11,233 @@
 #ifndef __PCACHE_H__
 #define __PCACHE_H__
 
-/* Recommended max cache and object sizes */
+#include "pslab.h"
+#include "plog.h"
+#include "psketch.h"
+#include "phttp.h"
+
+/* Default max cache and object sizes (see cache_config) */
 #define MAX_CACHE_SIZE 1049000 // 1 Mb
 #define MAX_OBJECT_SIZE 102400 // 100 Kb
+#define LINE_AVG_SIZE     2048 // default count limit: 1 line per 2 Kb
+/* Seconds to wait for the cache lock after a worker process dies */
+#define CACHE_RECOVER_WAIT 5
+/* References worker processes hold on shared lines (see line_pin) */
+#define PIN_WORKERS   64     // workers whose references are kept (-w max)
+#define PIN_SLOTS     4096   // references one worker keeps (power of 2)
+/* Variants (see http_variant) of one object cached at once */
+#define VARY_MAX 4
+
+/* Per-thread L1 of hot lines (see l1_find) */
+#define L1_SLOTS      32     // direct-mapped (power of 2)
+#define L1_MAX_OBJECT 8192   // bigger lines are only kept if they're hot
+#define L1_MAX_BYTES  262144 // object bytes a thread keeps (256 Kb)
+#define L1_FLUSH      16     // hits counted in the L1 before they're published
+#define HOT_MIN       32     // recent hits (see psketch.c) that make a line hot
+
+/* Timer wheel of line expiry times (see wheel_turn) */
+#define WHEEL_SLOTS   256    // one per tick, wrapping around
+#define WHEEL_TICK    16     // seconds per slot (the wheel turns in ~68 min)
+/* Early refresh of hot lines (see line_ahead) */
+#define XFETCH_BETA   1.0    // > 1: earlier, < 1: later
+
+/* Ways to store the lines of a cache (see cache_config) */
+#define STORE_SLAB 0 // slab classes, GDSF eviction (pslab.c)
+#define STORE_LOG  1 // log segments, FIFO eviction (plog.c)
+
+/* Structure of a cache configuration consists of the byte budget of 
+ * the cache, the largest object it admits, the most objects it may
+ * hold at once (0 derives a limit from the budget), the store its 
+ * lines live in, whether it's shared by forked worker processes,
+ * whether that store is mapped from hugetlb pages (see huge_map), and
+ * how long a stale line may be served while it's refreshed or while
+ * its origin fails, if its response doesn't say (see http_stale).
+ */
+struct cache_config {
+  size_t capacity;
+  size_t max_object;
+  size_t max_lines;
+  int store;
+  int shared;
+  int hugetlb;
+  long swr, sie;          // seconds (default 0: never)
+};
+typedef struct cache_config cconfig;
+
+/* Objects bigger than one chunk of SEG_SIZE bytes are stored as a 
+ * chain of segments; the line's own chunk holds the first part.
+ */
+#define SEG_SIZE 32768 // 32 Kb, the largest slab class (see slab_init)
+#define SEG_DATA (SEG_SIZE - SLAB_CHUNK_HDR - sizeof(struct segment))
+
+/* States of a cache line */
+#define LINE_FILLING 0 // segments still arriving from the origin
+#define LINE_READY   1 // object complete
+#define LINE_DEAD    2 // out of the cache; freed with its last reference
 
-/* Structure of a cache line consists of an identifier (loc),
- * an age (for LRU), the cached web object, it's size, and 
- * a pointer to the next cache line in the linked list. 
+/* Eviction objectives for the GDSF policy */
+#define GDSF_OBJ_HIT  0 // maximize object hit ratio (favor small objects)
+#define GDSF_BYTE_HIT 1 // maximize byte hit ratio (ignore object size)
+
+/* Structure of a segment consists of the next segment of the object,
+ * how many bytes it holds and the bytes themselves (one slab chunk).
+ */
+struct segment {
+  struct segment *next;
+  size_t len;
+  char data[];
+};
+
+/* Structure of a cache line consists of an identifier (loc) & its hash,
+ * which variant of its object it holds (if it varies), the GDSF 
+ * bookkeeping (hit count, fetch cost, priority & heap slot), the 
+ * cached web object, it's size & its descriptor (so it's served 
+ * without being parsed again), its state & references, when it
+ * stops being fresh (& its links in the expiry wheel), and a 
+ * pointer to the next cache line in its hash bucket. 
+ * A line, its loc and the first [olen] bytes of its obj share a single
+ * slab chunk; the rest of a big object follows in [segs].
  */
 struct cache_line {
-  unsigned int size;               
-  unsigned int age;                
+  size_t size;            // object bytes (so far, while filling)
+  size_t olen;            // object bytes in the line's own chunk
+  unsigned long hash;     // hash of loc
+  unsigned long vary;     // variant of the object (0: it doesn't vary)
+  int state;              // LINE_FILLING, LINE_READY or LINE_DEAD
+  int refcnt;             // index + readers + filler
+  unsigned int freq;      // hits since the line was made (starts at 1)
+  unsigned int pfreq;     // freq when pri was last computed
+  unsigned long cost;     // origin fetch latency (usec)
+  double pri;             // GDSF priority: L + freq * cost / size
+  int hidx;               // slot in its class' eviction heap
+  int cls;                // slab class of the line's chunk (-1: log)
+  pid_t filler;           // process filling the line (LINE_FILLING)
+  time_t expires;         // stale from then on (0: never)
+  struct http_desc desc;  // status, head & headers of the object
+  struct cache_line *wnext, *wprev; // same slot of the expiry wheel
   char *loc;              
   char *obj;           
+  struct segment *segs;   // rest of the object
+  struct segment *tail;
   struct cache_line *next; 
 }; 
 typedef struct cache_line line;
 
-/* Structure of a web cache consists of a pointer to the first
- * line of the cache, the last line of the cache, and the total 
- * size of the cache.  
- * Its main purpose is to maintain the linked list & make 
- * searching the list faster.
+/* Structure of a pin table consists of the worker process it belongs
+ * to (0: none), each line it holds a reference to (once per reference;
+ * NULL: a free slot), and how many of its references didn't fit (those
+ * are lost with it if it dies).
+ */
+struct pin_table {
+  pid_t pid;
+  unsigned long lost;
+  line *lines[PIN_SLOTS];
+};
+
+/* Structure of an eviction heap: a min-heap of lines ordered by
+ * GDSF priority (lines[0] is evicted first).
+ */
+struct evict_heap {
+  line **lines;
+  int len, cap;
+};
+
+/* Structure of a web cache consists of its configuration, the total
+ * size & line count of the cache, the slab or log memory the lines 
+ * live in, one eviction heap per slab class (a line can only make 
+ * room for lines of its own class; unused by the log, which evicts
+ * whole segments), a hash index of the lines, an optional 
+ * callback that gets each complete line evicted for room (e.g. to
+ * write it to a slower tier), a sketch of recent hits per key (hot
+ * lines are copied into every thread's L1), a timer wheel of the 
+ * lines by expiry time (stale lines go before any GDSF victim, and
+ * those that can be revalidated or served stale are kept until then),
+ * and the locks:
+ * [lock] guards everything but segment chains, which readers follow 
+ * under [fill_lock] while a line fills.
+ * A shared cache (see cache_map) keeps all of this in memory shared
+ * with forked workers, and its locks work across processes.
  */
 struct web_cache {
-  unsigned int size;
-  line *start;
+  pthread_rwlock_t *lock;
+  pthread_mutex_t fill_lock;
+  pthread_cond_t fill_cond;  // signaled when a filling line changes
+  size_t size;            // bytes of objects cached
+  size_t nlines;          // lines cached
+  cconfig cfg;
+  int objective;          // GDSF_OBJ_HIT or GDSF_BYTE_HIT
+  double inflation;       // L: priority of the last evicted line
+  slab mem;               // STORE_SLAB
+  logstore log;           // STORE_LOG
+  struct evict_heap heaps[SLAB_MAX_CLASSES];
+  line **buckets;         // hash index, chained through line->next
+  size_t nbuckets;        // power of 2
+  void (*spill)(struct web_cache *cash, line *lion, void *arg); // NULL: gone
+  void *spill_arg;
+  sketch hot;
+  struct pin_table *pins; // PIN_WORKERS of them (NULL unless shared)
+  line *wheel[WHEEL_SLOTS];
+  time_t wheel_at;        // next tick to sweep (0: not turned yet)
+  unsigned long expired;  // lines removed stale
+  unsigned long demoted;  // stale lines kept (to revalidate or serve)
+  unsigned long refreshed; // lines revalidated by the origin
+  unsigned long ahead;    // hot lines due for a refresh before expiry
 };
 typedef struct web_cache cache;
 
 /* Function prototypes for cache operations */ 
-void cache_init(cache *cash, pthread_rwlock_t *lock);
+void cache_init(cache *cash, pthread_rwlock_t *lock, cconfig *cfg);
 int cache_full(cache *cash);
 void cache_free(cache *cash);
+void *cache_map(size_t size, int shared);
+void cache_attach(cache *cash, int worker);
+int cache_recover(cache *cash, pid_t pid);
+void cache_reset(cache *cash);
+size_t cache_resize(cache *cash, size_t budget);
 /* Function prototypes for cache_line operations */
-line *in_cache(cache *cash, char *host, char *path);
-line *make_line(char *host, char *path, char *object, size_t obj_size);
+line *in_cache(cache *cash, char *host, char *path, char *req, size_t rlen);
+line *stale_line(cache *cash, char *host, char *path, char *req, 
+                 size_t rlen);
+line *peek_line(cache *cash, char *host, char *path, char *req, 
+                size_t rlen);
+void line_refresh(cache *cash, line *lion, time_t expires);
+int line_ahead(cache *cash, line *lion);
+unsigned long loc_hash(char *host, char *path);
+line *make_line(cache *cash, char *host, char *path, char *object, 
+               size_t obj_size, unsigned long cost, time_t expires,
+               unsigned long vary);
 void add_line(cache *cash, line *lion);
 void remove_line(cache *cash, line *lion);
-line *choose_evict(cache *cash);
-void free_line(cache *cash, line *lion);;
-void age_lines(cache *cash);
+int remove_loc(cache *cash, char *host, char *path);
+line *choose_evict(cache *cash, int cls);
+void free_line(cache *cash, line *lion);
+double line_priority(cache *cash, line *lion);
+/* Function prototypes for segmented lines */
+size_t line_room(char *host, char *path);
+int line_append(cache *cash, line *lion, char *data, size_t len);
+void line_finish(cache *cash, line *lion, unsigned long cost);
+struct segment *line_next(cache *cash, line *lion, struct segment *prev);
+void line_put(cache *cash, line *lion);
+void line_pin(cache *cash, line *lion);
+/* Function prototypes for the per-thread L1 */
+line *l1_find(cache *cash, char *host, char *path, char *req, size_t rlen);
+void l1_keep(cache *cash, line *lion);
+void l1_sweep(cache *cash);
+void l1_clear(cache *cash);
+/* Function prototypes for the eviction heap */
+void heap_push(cache *cash, line *lion);
+void heap_remove(cache *cash, line *lion);
+void heap_sift(cache *cash, line *lion);
+/* Function prototypes for read-write lock wrappers (see proxy.c) */
+int Pthread_rwlock_init(pthread_rwlock_t *rwlock, 
+                       const pthread_rwlockattr_t *attr);
+int Pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int Pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int Pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
 /* Function prototypes for debugging */
 void cache_error(char *msg);
 void print_cache(cache *cash);
 void print_line(line *lion);
+void cache_stats(cache *cash, FILE *fp);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,513 @@
+/*
+ * pdisk.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the disk tier behind the web object cache. Lines evicted
+ * from memory are pinned in a write-behind queue and a helper thread
+ * copies & appends them to a preallocated cache file, which is used as
+ * a circular log: a new record overwrites the oldest ones. The index of
+ * the records on disk lives in memory, and a Bloom filter in front of
+ * it turns away most misses without taking the lock. Readers pread
+ * straight from the file and check afterwards that the record wasn't
+ * overwritten while they read it.
+ */
+
+#include "csapp.h"
+#include "pdisk.h"
+
+/* Record sizes are rounded up to whole blocks */
+#define DISK_ROUND(n) (((n) + DISK_BLOCK - 1) & ~(size_t)(DISK_BLOCK - 1))
+
+static void *disk_writer(void *vargp);
+static char *record_image(dentry *ent);
+static dentry *entry_find(disk *dk, unsigned long hash);
+static void entry_unlink(disk *dk, dentry *ent);
+static void log_claim(disk *dk, off_t start, off_t end);
+static int hit_valid(disk *dk, dhit *hit);
+static ssize_t pread_full(int fd, char *buf, size_t n, off_t off);
+static void bloom_add(disk *dk, unsigned long hash);
+static int bloom_has(disk *dk, unsigned long hash);
+static void bloom_rebuild(disk *dk);
+
+
+/****************
+ * DISK FUNCTIONS
+ ****************/
+
+/*
+ * disk_init - open (or create) the cache file at [path], preallocate
+ *             [size] bytes of it for disk tier [dk] & start the
+ *             write-behind thread; exits if the file can't be set up
+ *
+ * Note: records from an earlier run are not trusted; the index starts
+ *       out empty
+ */
+void disk_init(disk *dk, char *path, size_t size)
+{
+  size_t nrecs;
+  pthread_t tid;
+
+  /* Set up the file */
+  dk->size = size & ~(size_t)(DISK_BLOCK - 1);
+  if (dk->size < DISK_BLOCK) dk->size = DISK_BLOCK;
+  dk->fd = Open(path, O_RDWR | O_CREAT, 0600);
+  // Reserve the blocks up front (sparse if the filesystem can't)
+  if (posix_fallocate(dk->fd, 0, dk->size) != 0 &&
+      ftruncate(dk->fd, dk->size) < 0)
+    unix_error("disk_init error: can't size cache file");
+  dk->head = 0;
+  dk->seq = 0;
+  pthread_mutex_init(&dk->lock, NULL);
+  pthread_cond_init(&dk->queued, NULL);
+
+  /* Size the index & filter for the most records the file can hold */
+  nrecs = dk->size / DISK_BLOCK;
+  dk->nbuckets = 1;
+  while (dk->nbuckets < nrecs / 2)
+    dk->nbuckets *= 2;
+  dk->buckets = Calloc(dk->nbuckets, sizeof(dentry *));
+  dk->nbits = 64;
+  while (dk->nbits < nrecs * DISK_BLOOM_BITS)
+    dk->nbits *= 2;
+  dk->bloom = Calloc(dk->nbits / 8, 1);
+  dk->oldest = dk->newest = NULL;
+  dk->nentries = dk->stale = 0;
+
+  /* Write-behind queue (never more than a quarter of the file) */
+  dk->qhead = dk->qtail = NULL;
+  dk->qbytes = 0;
+  dk->qmax = dk->size / 4 < DISK_QUEUE_MAX ? dk->size / 4 : DISK_QUEUE_MAX;
+  dk->hits = dk->misses = dk->filtered = 0;
+  dk->writes = dk->skipped = dk->errors = 0;
+  Pthread_create(&tid, NULL, disk_writer, dk);
+}
+
+/*
+ * disk_spill - cache spill callback: queue line [lion], evicted from
+ *              cache [cash], to be written to disk tier [arg]; a line
+ *              whose version is on disk already, and lines that don't
+ *              fit in the queue, are skipped. Older records of the same
+ *              variant are superseded (no longer found)
+ *
+ * Note: called under the cache's write lock, so spills never race; the
+ *       line is only pinned here, and copied by the write-behind thread
+ */
+void disk_spill(cache *cash, line *lion, void *arg)
+{
+  disk *dk = arg;
+  size_t keylen = strlen(lion->loc);
+  size_t rlen = DISK_ROUND(sizeof(struct disk_rec) + keylen + lion->size);
+  dentry *ent = Malloc(sizeof(dentry)), *old;
+  int same;
+
+  ent->hash = lion->hash;
+  ent->rlen = rlen;
+  ent->len = lion->size;
+  ent->keylen = keylen;
+  ent->cost = lion->cost;
+  ent->expires = lion->expires;
+  ent->vary = lion->vary;
+  ent->ready = ent->dead = ent->gone = 0;
+
+  /* CRITICAL SECTION */
+  pthread_mutex_lock(&dk->lock);
+  // Newest record of this variant still served: the same version (the
+  // line came back from disk unchanged) needn't be written again, but
+  // one dropped by disk_forget must (overwritten ones aren't indexed)
+  for (old = entry_find(dk, ent->hash); old != NULL; old = old->next)
+    if (old->hash == ent->hash && old->vary == ent->vary && !old->gone)
+      break;
+  same = old != NULL && old->expires == ent->expires &&
+         old->len == ent->len;
+  if (same || dk->qbytes + rlen > dk->qmax) {
+    if (!same) dk->skipped++;
+    pthread_mutex_unlock(&dk->lock);
+    Free(ent);
+    return;
+  }
+  // Older versions are superseded
+  for (; old != NULL; old = old->next)
+    if (old->hash == ent->hash && old->vary == ent->vary)
+      old->gone = 1;
+  dk->qbytes += rlen;
+  // Take the next stretch of the log (records don't wrap around)
+  if (dk->head + rlen > dk->size) {
+    log_claim(dk, dk->head, dk->size);
+    dk->head = 0;
+  }
+  log_claim(dk, dk->head, dk->head + rlen);
+  ent->off = dk->head;
+  dk->head += rlen;
+  ent->seq = ++dk->seq;
+  // Index it
+  ent->next = dk->buckets[ent->hash & (dk->nbuckets - 1)];
+  dk->buckets[ent->hash & (dk->nbuckets - 1)] = ent;
+  ent->newer = NULL;
+  if (dk->newest) dk->newest->newer = ent;
+  else            dk->oldest = ent;
+  dk->newest = ent;
+  dk->nentries++;
+  if (dk->stale > dk->nentries)
+    bloom_rebuild(dk);
+  bloom_add(dk, ent->hash);
+  // Queue it, with the line pinned until it's copied
+  __sync_fetch_and_add(&lion->refcnt, 1);
+  ent->src = lion;
+  ent->cash = cash;
+  ent->qnext = NULL;
+  if (dk->qtail) dk->qtail->qnext = ent;
+  else           dk->qhead = ent;
+  dk->qtail = ent;
+  pthread_cond_signal(&dk->queued);
+  pthread_mutex_unlock(&dk->lock);
+  /* END CRITICAL SECTION */
+}
+
+/*
+ * disk_find - look up the object at [host]/[path] in disk tier [dk]
+ *             & check its record; fills in [hit] if it's there (with
+ *             the expiry & variant of the line it was spilled from);
+ *             returns 1 on a hit, 0 on a miss
+ */
+int disk_find(disk *dk, char *host, char *path, dhit *hit)
+{
+  unsigned long hash = loc_hash(host, path);
+  size_t hl = strlen(host), keylen = 0;
+  struct disk_rec *rec;
+  dentry *ent;
+  off_t off = 0;
+  char *buf;
+  int ok = 0;
+
+  /* The filter rules out most misses without the lock */
+  if (!bloom_has(dk, hash)) {
+    __sync_fetch_and_add(&dk->filtered, 1);
+    return 0;
+  }
+  pthread_mutex_lock(&dk->lock);
+  if ((ent = entry_find(dk, hash)) != NULL && ent->ready && !ent->gone) {
+    hit->hash = hash;
+    hit->seq = ent->seq;
+    hit->len = ent->len;
+    hit->cost = ent->cost;
+    hit->expires = ent->expires;
+    hit->vary = ent->vary;
+    hit->data = ent->off + sizeof(struct disk_rec) + ent->keylen;
+    keylen = ent->keylen;
+    off = ent->off;
+    ok = 1;
+  }
+  pthread_mutex_unlock(&dk->lock);
+
+  /* Make sure the record is this object (hashes can collide) */
+  if (ok && keylen == hl + strlen(path)) {
+    buf = Malloc(sizeof(struct disk_rec) + keylen);
+    rec = (struct disk_rec *)buf;
+    ok = pread_full(dk->fd, buf, sizeof(struct disk_rec) + keylen, off) ==
+           (ssize_t)(sizeof(struct disk_rec) + keylen) &&
+         rec->magic == DISK_MAGIC && rec->seq == hit->seq &&
+         rec->len == hit->len &&
+         !memcmp(buf + sizeof(struct disk_rec), host, hl) &&
+         !memcmp(buf + sizeof(struct disk_rec) + hl, path, keylen - hl) &&
+         hit_valid(dk, hit);
+    Free(buf);
+  }
+  else ok = 0;
+  __sync_fetch_and_add(ok ? &dk->hits : &dk->misses, 1);
+  return ok;
+}
+
+/*
+ * disk_forget - drop the object at [host]/[path] from disk tier [dk]
+ *               (it changed at its origin): its records are no longer
+ *               found, nor read by hits already taken, and age out of
+ *               the log like the rest
+ *
+ * Note: records of other objects with the same hash go too
+ */
+void disk_forget(disk *dk, char *host, char *path)
+{
+  unsigned long hash = loc_hash(host, path);
+  dentry *ent;
+
+  if (!bloom_has(dk, hash)) return;
+  pthread_mutex_lock(&dk->lock);
+  for (ent = entry_find(dk, hash); ent != NULL; ent = ent->next)
+    if (ent->hash == hash) ent->gone = 1;
+  pthread_mutex_unlock(&dk->lock);
+}
+
+/*
+ * disk_read - read up to [n] bytes of the object of disk hit [hit],
+ *             starting [pos] bytes in, into [buf];
+ *             returns the bytes read (0 at the end of the object), or
+ *             -1 if the read failed or the record was overwritten
+ */
+ssize_t disk_read(disk *dk, dhit *hit, size_t pos, char *buf, size_t n)
+{
+  if (pos >= hit->len) return 0;
+  if (n > hit->len - pos) n = hit->len - pos;
+  if (pread_full(dk->fd, buf, n, hit->data + pos) != (ssize_t)n)
+    return -1;
+  /* The bytes are only good if nobody overwrote them meanwhile */
+  return hit_valid(dk, hit) ? (ssize_t)n : -1;
+}
+
+/*
+ * disk_writer - write-behind thread: write queued records to the
+ *               cache file in log order
+ *
+ * Note: one writer keeps writes to the same stretch of the file in the
+ *       order the stretch was claimed
+ */
+static void *disk_writer(void *vargp)
+{
+  disk *dk = vargp;
+  dentry *ent;
+  char *buf;
+  int dead, ok;
+
+  Pthread_detach(pthread_self());
+  while (1) {
+    /* Take the oldest queued record */
+    pthread_mutex_lock(&dk->lock);
+    while (dk->qhead == NULL)
+      pthread_cond_wait(&dk->queued, &dk->lock);
+    ent = dk->qhead;
+    if ((dk->qhead = ent->qnext) == NULL)
+      dk->qtail = NULL;
+    dead = ent->dead;
+    pthread_mutex_unlock(&dk->lock);
+
+    /* Copy its line & let go of it, then write it (unless it was
+       overwritten while queued) */
+    buf = dead ? NULL : record_image(ent);
+    line_put(ent->cash, ent->src);
+    ok = !dead && pwrite(dk->fd, buf, ent->rlen, ent->off) ==
+                  (ssize_t)ent->rlen;
+    Free(buf);
+
+    /* CRITICAL SECTION */
+    pthread_mutex_lock(&dk->lock);
+    dk->qbytes -= ent->rlen;
+    ent->src = NULL;
+    if (ent->dead)
+      Free(ent);
+    else if (ok) {
+      ent->ready = 1;
+      dk->writes++;
+    }
+    else
+      dk->errors++; // never served; ages out of the log
+    pthread_mutex_unlock(&dk->lock);
+    /* END CRITICAL SECTION */
+  }
+  return NULL;
+}
+
+/*
+ * record_image - copy the line of queued entry [ent] into a new record
+ *                (header, key & object, zero padded to whole blocks);
+ *                returns the record
+ *
+ * Note: the line is pinned & complete, so no lock is needed to read it
+ */
+static char *record_image(dentry *ent)
+{
+  char *buf = Malloc(ent->rlen), *p;
+  struct disk_rec *rec = (struct disk_rec *)buf;
+  struct segment *seg;
+  line *lion = ent->src;
+
+  rec->magic = DISK_MAGIC;
+  rec->keylen = ent->keylen;
+  rec->hash = ent->hash;
+  rec->seq = ent->seq;
+  rec->len = ent->len;
+  rec->cost = ent->cost;
+  rec->expires = ent->expires;
+  rec->vary = ent->vary;
+  p = buf + sizeof(struct disk_rec);
+  memcpy(p, lion->loc, ent->keylen);
+  p += ent->keylen;
+  memcpy(p, lion->obj, lion->olen);
+  p += lion->olen;
+  for (seg = lion->segs; seg != NULL; seg = seg->next) {
+    memcpy(p, seg->data, seg->len);
+    p += seg->len;
+  }
+  memset(p, 0, buf + ent->rlen - p);
+  return buf;
+}
+
+
+/********************
+ * DISK INDEX HELPERS
+ ********************/
+
+/*
+ * entry_find - find the entry for [hash] in the index of [dk]
+ *
+ * Note: hold the disk lock
+ */
+static dentry *entry_find(disk *dk, unsigned long hash)
+{
+  dentry *ent = dk->buckets[hash & (dk->nbuckets - 1)];
+
+  while (ent != NULL && ent->hash != hash)
+    ent = ent->next;
+  return ent;
+}
+
+/*
+ * entry_unlink - take entry [ent] out of its bucket in [dk]
+ */
+static void entry_unlink(disk *dk, dentry *ent)
+{
+  dentry **pp = &dk->buckets[ent->hash & (dk->nbuckets - 1)];
+
+  while (*pp != ent)
+    pp = &(*pp)->next;
+  *pp = ent->next;
+}
+
+/*
+ * log_claim - drop the records of [dk] overlapping bytes [start, end)
+ *             of the file; they're always the oldest ones
+ *
+ * Note: hold the disk lock
+ */
+static void log_claim(disk *dk, off_t start, off_t end)
+{
+  dentry *ent;
+
+  while ((ent = dk->oldest) != NULL && ent->off < end &&
+         ent->off + (off_t)ent->rlen > start) {
+    entry_unlink(dk, ent);
+    if ((dk->oldest = ent->newer) == NULL)
+      dk->newest = NULL;
+    dk->nentries--;
+    dk->stale++;
+    // A record still in the queue is freed by the writer
+    if (ent->src != NULL) ent->dead = 1;
+    else                  Free(ent);
+  }
+}
+
+/*
+ * hit_valid - check that the record of [hit] is still in [dk];
+ *             returns 1 if it is, 0 if it was overwritten
+ */
+static int hit_valid(disk *dk, dhit *hit)
+{
+  dentry *ent;
+  int ok;
+
+  pthread_mutex_lock(&dk->lock);
+  ok = (ent = entry_find(dk, hit->hash)) != NULL && ent->seq == hit->seq &&
+       !ent->gone;
+  pthread_mutex_unlock(&dk->lock);
+  return ok;
+}
+
+/*
+ * pread_full - pread [n] bytes at [off] of [fd] into [buf], retrying
+ *              short reads; returns the bytes read or -1 on error
+ */
+static ssize_t pread_full(int fd, char *buf, size_t n, off_t off)
+{
+  size_t done = 0;
+  ssize_t r;
+
+  while (done < n) {
+    if ((r = pread(fd, buf + done, n - done, off + done)) < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (r == 0) break;
+    done += r;
+  }
+  return done;
+}
+
+
+/**************
+ * BLOOM FILTER
+ **************/
+
+/*
+ * bloom_add - set the DISK_BLOOM_K bits of [hash] in the filter of [dk]
+ *             (double hashing on the two halves of the hash)
+ */
+static void bloom_add(disk *dk, unsigned long hash)
+{
+  unsigned long h2 = (hash >> 32) | 1, bit;
+  int i;
+
+  for (i = 0; i < DISK_BLOOM_K; i++, hash += h2) {
+    bit = hash & (dk->nbits - 1);
+    __atomic_fetch_or(&dk->bloom[bit / 8], 1 << (bit % 8), __ATOMIC_RELAXED);
+  }
+}
+
+/*
+ * bloom_has - check whether [hash] may be in [dk];
+ *             returns 0 if it surely isn't, 1 if it may be
+ */
+static int bloom_has(disk *dk, unsigned long hash)
+{
+  unsigned long h2 = (hash >> 32) | 1, bit;
+  int i;
+
+  for (i = 0; i < DISK_BLOOM_K; i++, hash += h2) {
+    bit = hash & (dk->nbits - 1);
+    if (!(__atomic_load_n(&dk->bloom[bit / 8], __ATOMIC_RELAXED) &
+          (1 << (bit % 8))))
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * bloom_rebuild - clear the filter of [dk] & add back the records
+ *                 still on disk (overwritten ones can't be removed
+ *                 one by one)
+ *
+ * Note: hold the disk lock; lookups meanwhile may miss, never lie
+ */
+static void bloom_rebuild(disk *dk)
+{
+  dentry *ent;
+
+  memset(dk->bloom, 0, dk->nbits / 8);
+  for (ent = dk->oldest; ent != NULL; ent = ent->newer)
+    bloom_add(dk, ent->hash);
+  dk->stale = 0;
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * disk_stats - print occupancy & hit counts of disk tier [dk] to [fp]
+ */
+void disk_stats(disk *dk, FILE *fp)
+{
+  pthread_mutex_lock(&dk->lock);
+  fprintf(fp, "- DISK TIER -\n");
+  fprintf(fp, "records: %lu | file: %lu bytes | queued: %lu / %lu bytes\n",
+          (unsigned long)dk->nentries, (unsigned long)dk->size,
+          (unsigned long)dk->qbytes, (unsigned long)dk->qmax);
+  fprintf(fp, "hits: %lu | misses: %lu | filtered: %lu\n",
+          dk->hits, dk->misses, dk->filtered);
+  fprintf(fp, "writes: %lu | skipped: %lu | errors: %lu\n",
+          dk->writes, dk->skipped, dk->errors);
+  fprintf(fp, "-------------\n");
+  pthread_mutex_unlock(&dk->lock);
+}
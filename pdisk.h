@@ -0,0 +1,114 @@
+/*
+ * pdisk.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pdisk.c (disk tier behind the web cache)
+ */
+#ifndef __PDISK_H__
+#define __PDISK_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "pcache.h"
+
+/* Disk tier geometry */
+#define DISK_BLOCK       4096     // records start on block boundaries
+#define DISK_SIZE        268435456 // default cache file size (256 Mb)
+#define DISK_QUEUE_MAX   16777216 // bytes waiting to be written (16 Mb)
+#define DISK_BLOOM_BITS  10       // Bloom filter bits per possible record
+#define DISK_BLOOM_K     7        // Bloom filter probes per key
+#define DISK_MAGIC       0x31445850 // "PXD1"
+
+/* Structure of a record header on disk; the key (host followed by
+ * path) and then the object follow it.
+ */
+struct disk_rec {
+  unsigned int magic;
+  unsigned int keylen;
+  unsigned long hash;     // loc_hash of the key
+  unsigned long seq;      // record number (tells rewrites apart)
+  unsigned long len;      // object bytes
+  unsigned long cost;     // origin fetch latency (usec)
+  long expires;           // stale from then on
+  unsigned long vary;     // variant of the object (0: it doesn't vary)
+};
+
+/* Structure of a disk index entry consists of where its record is,
+ * what it holds, links for its hash bucket & the log (oldest first),
+ * and, until the write-behind thread gets to it, the evicted line its
+ * record is copied from (kept pinned in its cache until then).
+ */
+struct disk_entry {
+  unsigned long hash;
+  unsigned long seq;
+  off_t off;              // record offset in the file
+  size_t rlen;            // record bytes (whole blocks)
+  size_t len;             // object bytes
+  size_t keylen;
+  unsigned long cost;
+  time_t expires;
+  unsigned long vary;
+  int ready;              // written & readable
+  int dead;               // overwritten before it was written
+  int gone;               // dropped by disk_forget or superseded
+  line *src;              // line waiting to be written (NULL once written)
+  cache *cash;            // cache [src] is pinned in
+  struct disk_entry *next;   // hash bucket
+  struct disk_entry *newer;  // log order
+  struct disk_entry *qnext;  // write queue
+};
+typedef struct disk_entry dentry;
+
+/* Structure of a disk hit: a copy of the entry found, good for reads
+ * for as long as the record isn't overwritten.
+ */
+struct disk_hit {
+  unsigned long hash;
+  unsigned long seq;
+  off_t data;             // offset of the object in the file
+  size_t len;
+  unsigned long cost;
+  time_t expires;         // stale from then on
+  unsigned long vary;     // variant of the object (0: it doesn't vary)
+};
+typedef struct disk_hit dhit;
+
+/* Structure of a disk tier consists of the preallocated cache file,
+ * used as a circular log of records, the in-memory index of the
+ * records in it (with a Bloom filter in front so misses don't take the
+ * lock), the write-behind queue and its thread, and statistics.
+ */
+struct disk_tier {
+  int fd;
+  size_t size;            // file bytes (whole blocks)
+  off_t head;             // where the next record goes
+  unsigned long seq;
+  pthread_mutex_t lock;   // guards everything but the Bloom filter
+  pthread_cond_t queued;  // signaled when the write queue grows
+  dentry **buckets;       // index by hash
+  size_t nbuckets;        // power of 2
+  dentry *oldest, *newest;   // log order
+  size_t nentries;
+  unsigned char *bloom;
+  size_t nbits;           // power of 2
+  size_t stale;           // dropped entries still set in the filter
+  dentry *qhead, *qtail;  // write queue
+  size_t qbytes, qmax;
+  /* Statistics */
+  unsigned long hits, misses, filtered, writes, skipped, errors;
+};
+typedef struct disk_tier disk;
+
+/* Function prototypes for disk tier operations */
+void disk_init(disk *dk, char *path, size_t size);
+void disk_spill(cache *cash, line *lion, void *arg);
+int disk_find(disk *dk, char *host, char *path, dhit *hit);
+void disk_forget(disk *dk, char *host, char *path);
+ssize_t disk_read(disk *dk, dhit *hit, size_t pos, char *buf, size_t n);
+void disk_stats(disk *dk, FILE *fp);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ * pfetch.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the split fetch of the proxy: a big object coming from a slow
+ * origin is fetched over several connections at once, one range of its
+ * body per connection, instead of one stream. The response that started
+ * it brings the first segment; threads of the fetch get the others into
+ * buffers of their own, and the caller takes them in order as they're
+ * done, so the client is still served (and the cache filled) front to
+ * back. Every range carries the object's validator as If-Range, so a
+ * segment of an object that changed meanwhile fails instead of being
+ * mixed in; a failed segment (or one no thread could be started for)
+ * is fetched again by the caller. The buffers of all split fetches are
+ * kept under FETCH_MAX_BYTES: a fetch that would go over it is left to
+ * one stream, which needs none.
+ */
+
+#include "csapp.h"
+#include "pfetch.h"
+
+/* Bytes of a segment read at a time (a fetch given up on stops then) */
+#define FETCH_CHUNK 65536
+
+/* Counts of this process' split fetches (see fetch_stats) */
+static unsigned long splits, segs_done, segs_failed, segs_retried;
+static unsigned long over_limit;
+
+/* Bytes of segment buffers the running split fetches may fill */
+static size_t buffered;
+
+static void *fetch_thread(void *vargp);
+static int fetch_seg(sfetch *sf, struct fetch_seg *seg);
+static int read_206(rio_t *rio, struct fetch_seg *seg);
+static void fetch_drop(sfetch *sf);
+
+
+/*****************
+ * FETCH FUNCTIONS
+ *****************/
+
+/*
+ * fetch_split - split the fetch of the [body] bytes of the object at
+ *               [host]:[port] into segments, requested with [req]
+ *               ([rlen] bytes of head, blank line aside) as long as
+ *               validator [ifr] ([iflen] bytes) holds, and start the
+ *               fetch of all but the first one (connections come from
+ *               [open]); returns the fetch, or NULL if the body is too
+ *               small to split, its segments would take the buffers
+ *               over FETCH_MAX_BYTES (or no thread can be started for
+ *               it)
+ */
+sfetch *fetch_split(int (*open)(char *host, char *port), char *host,
+                    char *port, char *req, size_t rlen, char *ifr,
+                    size_t iflen, size_t body)
+{
+  size_t n = body / FETCH_SEG_MIN, each, held;
+  size_t hl = strlen(host) + 1, pl = strlen(port) + 1;
+  sfetch *sf;
+  pthread_t tid;
+  int i, started = 0;
+
+  if (n > FETCH_SEGS) n = FETCH_SEGS;
+  if (n < 2) return NULL;
+  /* Room for all but the first segment (it's read from the stream) */
+  each = body / n;
+  held = body - each;
+  if (__atomic_add_fetch(&buffered, held, __ATOMIC_RELAXED) > 
+      FETCH_MAX_BYTES) {
+    __atomic_sub_fetch(&buffered, held, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&over_limit, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  /* The fetch & its strings in one block */
+  sf = Malloc(sizeof(sfetch) + hl + pl + rlen + iflen + 2);
+  sf->host = (char *)(sf + 1);
+  sf->port = sf->host + hl;
+  sf->req = sf->port + pl;
+  sf->ifr = sf->req + rlen + 1;
+  strcpy(sf->host, host);
+  strcpy(sf->port, port);
+  memcpy(sf->req, req, rlen);
+  sf->req[rlen] = '\0';
+  memcpy(sf->ifr, ifr, iflen);
+  sf->ifr[iflen] = '\0';
+  sf->rlen = rlen;
+  sf->iflen = iflen;
+  sf->open = open;
+  /* Equal segments (the last one takes what's left over) */
+  sf->held = held;
+  sf->nsegs = n;
+  for (i = 0; i < sf->nsegs; i++) {
+    sf->seg[i].owner = sf;
+    sf->seg[i].first = i * each;
+    sf->seg[i].last = i == sf->nsegs - 1 ? body - 1 : (i + 1) * each - 1;
+    sf->seg[i].buf = NULL;
+    sf->seg[i].state = SEG_RUNNING;
+  }
+  sf->refcnt = sf->nsegs; // the caller's & one per thread
+  sf->gone = 0;
+  pthread_mutex_init(&sf->lock, NULL);
+  pthread_cond_init(&sf->done, NULL);
+  /* A segment whose thread won't start is left to the caller, unless
+     none will: then it's one stream after all */
+  for (i = 1; i < sf->nsegs; i++)
+    if (pthread_create(&tid, NULL, fetch_thread, &sf->seg[i]) == 0)
+      started++;
+    else {
+      pthread_mutex_lock(&sf->lock);
+      sf->seg[i].state = SEG_FAILED;
+      sf->refcnt--;
+      pthread_mutex_unlock(&sf->lock);
+    }
+  if (started == 0) {
+    fetch_drop(sf);
+    return NULL;
+  }
+  __atomic_fetch_add(&splits, 1, __ATOMIC_RELAXED);
+  return sf;
+}
+
+/*
+ * fetch_wait - wait for segment [i] (> 0) of split fetch [sf], and
+ *              fetch it again here if it failed; returns its bytes, or
+ *              NULL if it can't be had
+ */
+char *fetch_wait(sfetch *sf, int i)
+{
+  struct fetch_seg *seg = &sf->seg[i];
+  int tries;
+
+  pthread_mutex_lock(&sf->lock);
+  while (seg->state == SEG_RUNNING)
+    pthread_cond_wait(&sf->done, &sf->lock);
+  pthread_mutex_unlock(&sf->lock);
+  /* Its thread is done with it: it's ours now */
+  for (tries = 0; seg->state == SEG_FAILED && tries < FETCH_RETRIES; tries++) {
+    __atomic_fetch_add(&segs_retried, 1, __ATOMIC_RELAXED);
+    if (fetch_seg(sf, seg) == 0)
+      seg->state = SEG_DONE;
+  }
+  return seg->state == SEG_DONE ? seg->buf : NULL;
+}
+
+/*
+ * fetch_put - give up on split fetch [sf] (done with it, or not): the
+ *             segments still running stop at their next chunk
+ */
+void fetch_put(sfetch *sf)
+{
+  __atomic_store_n(&sf->gone, 1, __ATOMIC_RELAXED);
+  fetch_drop(sf);
+}
+
+/*
+ * fetch_thread - fetch segment [vargp] of its split fetch
+ */
+static void *fetch_thread(void *vargp)
+{
+  struct fetch_seg *seg = (struct fetch_seg *)vargp;
+  sfetch *sf = seg->owner;
+  int ok;
+
+  Pthread_detach(pthread_self());
+  ok = fetch_seg(sf, seg) == 0;
+  pthread_mutex_lock(&sf->lock);
+  seg->state = ok ? SEG_DONE : SEG_FAILED;
+  pthread_cond_broadcast(&sf->done);
+  pthread_mutex_unlock(&sf->lock);
+  fetch_drop(sf);
+  return NULL;
+}
+
+/*
+ * fetch_seg - fetch segment [seg] of split fetch [sf] over a connection
+ *             of its own (one read waits FETCH_TIMEOUT seconds at most);
+ *             returns 0 if all of it came, -1 otherwise
+ */
+static int fetch_seg(sfetch *sf, struct fetch_seg *seg)
+{
+  struct timeval timeout = { FETCH_TIMEOUT, 0 };
+  char range[128];
+  rio_t rio;
+  int fd, rc = -1;
+
+  if ((fd = sf->open(sf->host, sf->port)) < 0) {
+    __atomic_fetch_add(&segs_failed, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  // An origin gone silent fails the segment instead of hanging it
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  snprintf(range, sizeof(range), "Range: bytes=%zu-%zu\r\nIf-Range: ",
+           seg->first, seg->last);
+  if (rio_writen(fd, sf->req, sf->rlen) >= 0 &&
+      rio_writen(fd, range, strlen(range)) >= 0 &&
+      rio_writen(fd, sf->ifr, sf->iflen) >= 0 &&
+      rio_writen(fd, "\r\n\r\n", 4) >= 0) {
+    rio_readinitb(&rio, fd);
+    rc = read_206(&rio, seg);
+  }
+  close(fd);
+  __atomic_fetch_add(rc == 0 ? &segs_done : &segs_failed, 1,
+                     __ATOMIC_RELAXED);
+  return rc;
+}
+
+/*
+ * read_206 - read the response to the range request of segment [seg]
+ *            from [rio]: a 206 of exactly its bytes (anything else
+ *            means the origin won't, or the object changed);
+ *            returns 0 if all of them came, -1 otherwise
+ */
+static int read_206(rio_t *rio, struct fetch_seg *seg)
+{
+  char line[MAXLINE];
+  size_t len = seg->last - seg->first + 1, got = 0, want, a, b;
+  int status = 0, match = 0;
+  ssize_t n;
+
+  /* The head: its status & Content-Range */
+  if (rio_readlineb(rio, line, MAXLINE) <= 0 ||
+      sscanf(line, "HTTP/%*s %d", &status) != 1 || status != 206)
+    return -1;
+  while ((n = rio_readlineb(rio, line, MAXLINE)) > 0 &&
+         strcmp(line, "\r\n") && strcmp(line, "\n"))
+    if (!strncasecmp(line, "Content-Range:", 14) &&
+        sscanf(line + 14, " bytes %zu-%zu", &a, &b) == 2)
+      match = a == seg->first && b == seg->last;
+  if (n <= 0 || !match) return -1;
+  /* The body, a chunk at a time (no memory just fails the segment) */
+  if (seg->buf == NULL && (seg->buf = malloc(len)) == NULL)
+    return -1;
+  while (got < len) {
+    if (__atomic_load_n(&seg->owner->gone, __ATOMIC_RELAXED))
+      return -1;
+    want = len - got < FETCH_CHUNK ? len - got : FETCH_CHUNK;
+    if ((n = rio_readnb(rio, seg->buf + got, want)) <= 0)
+      return -1;
+    got += n;
+  }
+  return 0;
+}
+
+/*
+ * fetch_drop - drop a reference to split fetch [sf], freeing it with
+ *              the last one
+ */
+static void fetch_drop(sfetch *sf)
+{
+  int i, last;
+
+  pthread_mutex_lock(&sf->lock);
+  last = --sf->refcnt == 0;
+  pthread_mutex_unlock(&sf->lock);
+  if (!last) return;
+  for (i = 0; i < sf->nsegs; i++)
+    if (sf->seg[i].buf != NULL)
+      Free(sf->seg[i].buf);
+  __atomic_sub_fetch(&buffered, sf->held, __ATOMIC_RELAXED);
+  pthread_mutex_destroy(&sf->lock);
+  pthread_cond_destroy(&sf->done);
+  Free(sf);
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * fetch_stats - print this process' split fetches to [fp]
+ */
+void fetch_stats(FILE *fp)
+{
+  fprintf(fp, "- SPLIT FETCHES -\n");
+  fprintf(fp, "split fetches: %lu, %lu left whole (buffers full) | "
+              "segments: %lu done, %lu failed, %lu fetched again\n",
+          __atomic_load_n(&splits, __ATOMIC_RELAXED),
+          __atomic_load_n(&over_limit, __ATOMIC_RELAXED),
+          __atomic_load_n(&segs_done, __ATOMIC_RELAXED),
+          __atomic_load_n(&segs_failed, __ATOMIC_RELAXED),
+          __atomic_load_n(&segs_retried, __ATOMIC_RELAXED));
+  fprintf(fp, "------------------\n");
+}
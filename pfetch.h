@@ -0,0 +1,73 @@
+/*
+ * pfetch.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pfetch.c (segmented origin fetches)
+ */
+#ifndef __PFETCH_H__
+#define __PFETCH_H__
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* Limits */
+#define FETCH_SEGS      4        // segments of one object fetched at once
+#define FETCH_SEG_MIN   262144   // smallest segment (objects of 2 split)
+#define FETCH_RETRIES   1        // times a failed segment is fetched again
+#define FETCH_TIMEOUT   10       // seconds a segment's origin may go silent
+#define FETCH_MAX_BYTES 67108864 // 64 Mb of segments buffered at once
+
+/* States of a segment */
+#define SEG_RUNNING 0
+#define SEG_DONE    1
+#define SEG_FAILED  2
+
+/* Structure of a fetch segment consists of the fetch it's part of, the
+ * body bytes it holds (first to last), the buffer they arrive in & its
+ * state.
+ */
+struct fetch_seg {
+  struct split_fetch *owner;
+  size_t first, last;
+  char *buf;
+  int state;               // SEG_RUNNING, SEG_DONE or SEG_FAILED
+};
+
+/* Structure of a split fetch consists of the function that connects
+ * to the origin, where the object is & the request for it (its head,
+ * blank line aside, and the validator every segment must still match:
+ * see If-Range; its strings follow the fetch in the same block), the
+ * segments (the first one comes with the response that started it all,
+ * so it's not fetched here) & the bytes of buffer they count against
+ * FETCH_MAX_BYTES, the references to the fetch (its caller's
+ * & each running thread's; the last one frees it), whether the caller
+ * gave up on it, and the lock & condition segments are waited on with.
+ */
+struct split_fetch {
+  int (*open)(char *host, char *port);
+  char *host, *port;
+  char *req, *ifr;
+  size_t rlen, iflen;
+  struct fetch_seg seg[FETCH_SEGS];
+  int nsegs;
+  size_t held;
+  int refcnt;
+  int gone;
+  pthread_mutex_t lock;
+  pthread_cond_t done;     // signaled when a segment is done or failed
+};
+typedef struct split_fetch sfetch;
+
+/* Function prototypes for split fetch operations */
+sfetch *fetch_split(int (*open)(char *host, char *port), char *host,
+                    char *port, char *req, size_t rlen, char *ifr,
+                    size_t iflen, size_t body);
+char *fetch_wait(sfetch *sf, int i);
+void fetch_put(sfetch *sf);
+void fetch_stats(FILE *fp);
+
+#endif
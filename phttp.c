@@ -0,0 +1,626 @@
+/*
+ * phttp.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is what the proxy knows about HTTP responses: finding the head
+ * of a response, its status & its headers, and from those, how long a
+ * shared cache may serve it (RFC 9111). A response is only cacheable 
+ * with a cacheable status & without no-store, private or no-cache; 
+ * it stays fresh for its s-maxage, max-age or Expires (counted from 
+ * its Date, less its Age), or failing all of those for a tenth of 
+ * the time since it was last modified, or for a default TTL. A 404 or
+ * a 410 (a negative response) is cached by the same rules, but never
+ * for more than a short TTL of its own. A stale response with a 
+ * validator (ETag or Last-Modified) can be refreshed by a 304 to a
+ * conditional request, and a client's own conditional request can be
+ * answered from the cache. For a while after it's gone stale, a 
+ * response may still be served as is while it's refreshed in
+ * the background (stale-while-revalidate), or while its origin can't
+ * be reached (stale-if-error), unless it must be revalidated (RFC 5861).
+ * A response with a Vary header is one variant of its object, picked
+ * by the values of the request headers that it names. A client may ask
+ * for byte ranges of a cached response (RFC 9110), as long as its 
+ * If-Range, if any, still names that response.
+ */
+
+#include <limits.h>
+#include "csapp.h"
+#include "phttp.h"
+
+static const char *months[12] = {
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static int cacheable_status(int status);
+static time_t fresh_until(char *resp, size_t len, time_t now, long ttl);
+static long lifetime(char *resp, size_t len, time_t date, long ttl);
+static void date_age(char *resp, size_t len, time_t now, time_t *date, 
+                     long *age);
+static int etag_match(char *list, size_t llen, char *etag, size_t elen);
+static int if_range(char *resp, struct http_desc *d, char *val, 
+                    size_t vlen);
+static void find_field(char *resp, size_t len, const char *name,
+                       struct http_field *f);
+static char *find_crlf2(char *s, size_t len);
+
+/* What lifetime finds when there's nothing explicit (see http_refresh) */
+#define LIFE_NONE -2
+
+
+/****************
+ * HEAD FUNCTIONS
+ ****************/
+
+/*
+ * http_head_len - bytes of the head of response [resp] ([len] bytes),
+ *                 the blank line included; returns 0 if the head 
+ *                 isn't all there
+ */
+size_t http_head_len(char *resp, size_t len)
+{
+  char *end = find_crlf2(resp, len);
+
+  return end == NULL ? 0 : (size_t)(end - resp) + 4;
+}
+
+/*
+ * http_status - status code of response [resp] ([len] bytes);
+ *               returns 0 if there's no status line
+ */
+int http_status(char *resp, size_t len)
+{
+  int status;
+
+  if (len < 12 || strncmp(resp, "HTTP/", 5))
+    return 0;
+  for (resp += 5, len -= 5; len > 0 && *resp != ' '; resp++, len--)
+    ;
+  if (len < 4 || sscanf(resp, " %3d", &status) != 1)
+    return 0;
+  return status;
+}
+
+/*
+ * http_header - find header [name] (any case) in the head of response
+ *               [resp] ([len] bytes), or in a block of request headers
+ *               ending in a blank line; its value's length goes in 
+ *               [vlen]; returns the value, or NULL if there's no such
+ *               header
+ */
+char *http_header(char *resp, size_t len, const char *name, size_t *vlen)
+{
+  size_t n = strlen(name), head = http_head_len(resp, len);
+  char *p = resp, *end = resp + head, *eol;
+
+  if (head == 0) return NULL;
+  /* One line at a time (a status line never looks like a header) */
+  for (; (eol = memchr(p, '\n', end - p)) != NULL; p = eol + 1) {
+    if ((size_t)(end - p) > n && !strncasecmp(p, name, n) && p[n] == ':') {
+      for (p += n + 1; *p == ' ' || *p == '\t'; p++)
+        ;
+      *vlen = (size_t)(eol - p);
+      while (*vlen > 0 && (p[*vlen - 1] == '\r' || p[*vlen - 1] == ' '))
+        (*vlen)--;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * http_describe - fill in descriptor [d] of response [resp] ([len] 
+ *                 bytes of it, the head at least) received at [now];
+ *                 a head that isn't all there has a [head] of 0
+ */
+void http_describe(char *resp, size_t len, time_t now, struct http_desc *d)
+{
+  memset(d, 0, sizeof(*d));
+  d->status = http_status(resp, len);
+  if ((d->head = http_head_len(resp, len)) == 0)
+    return;
+  date_age(resp, len, now, &d->date, &d->age);
+  find_field(resp, len, "Content-Type", &d->ctype);
+  find_field(resp, len, "ETag", &d->etag);
+  find_field(resp, len, "Last-Modified", &d->lastmod);
+  find_field(resp, len, "Vary", &d->vary);
+  find_field(resp, len, "Cache-Control", &d->cc);
+  find_field(resp, len, "Expires", &d->expires);
+  find_field(resp, len, "Age", &d->agehdr);
+}
+
+/*
+ * http_age - the Age of the response described by [d] at [now]: its
+ *            Age when it came, plus the time since its Date
+ */
+long http_age(struct http_desc *d, time_t now)
+{
+  return d->age + (now > d->date ? now - d->date : 0);
+}
+
+/*
+ * http_directive - find directive [name] in a Cache-Control value 
+ *                  [val] ([vlen] bytes); its argument, if it has one,
+ *                  goes in [arg] (-1 if it's malformed); returns 1 if
+ *                  it's there, 0 if it isn't
+ */
+int http_directive(char *val, size_t vlen, const char *name, long *arg)
+{
+  size_t n = strlen(name), i = 0;
+  char *end;
+
+  while (i < vlen) {
+    while (i < vlen && (val[i] == ' ' || val[i] == ',' || val[i] == '\t'))
+      i++;
+    if (vlen - i >= n && !strncasecmp(val + i, name, n) &&
+        (i + n == vlen || strchr(" ,=\t", val[i + n]))) {
+      if (arg != NULL && i + n < vlen && val[i + n] == '=') {
+        i += n + 1 + (i + n + 1 < vlen && val[i + n + 1] == '"');
+        *arg = strtol(val + i, &end, 10);
+        if (end == val + i || *arg < 0) *arg = -1;
+      }
+      return 1;
+    }
+    // Next directive (a quoted argument may hold commas)
+    while (i < vlen && val[i] != ',')
+      if (val[i++] == '"')
+        while (i < vlen && val[i++] != '"')
+          ;
+  }
+  return 0;
+}
+
+/*
+ * http_date - parse HTTP date [val] ([vlen] bytes) in any of the three
+ *             formats HTTP allows; returns the time, or -1 if it's 
+ *             malformed
+ */
+time_t http_date(char *val, size_t vlen)
+{
+  char buf[64], mon[4];
+  struct tm tm;
+  int i;
+
+  if (vlen >= sizeof(buf)) return -1;
+  memcpy(buf, val, vlen);
+  buf[vlen] = '\0';
+  memset(&tm, 0, sizeof(tm));
+  /* Sun, 06 Nov 1994 08:49:37 GMT | Sunday, 06-Nov-94 08:49:37 GMT |
+     Sun Nov  6 08:49:37 1994 */
+  if (sscanf(buf, "%*[^,], %d %3s %d %d:%d:%d", &tm.tm_mday, mon,
+             &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6 &&
+      sscanf(buf, "%*[^,], %d-%3s-%d %d:%d:%d", &tm.tm_mday, mon,
+             &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6 &&
+      sscanf(buf, "%*s %3s %d %d:%d:%d %d", mon, &tm.tm_mday,
+             &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &tm.tm_year) != 6)
+    return -1;
+  for (i = 0; i < 12 && strcmp(mon, months[i]); i++)
+    ;
+  if (i == 12) return -1;
+  tm.tm_mon = i;
+  if (tm.tm_year < 70) tm.tm_year += 2000;     // two digit years
+  else if (tm.tm_year < 100) tm.tm_year += 1900;
+  tm.tm_year -= 1900;
+  return timegm(&tm);
+}
+
+
+/*********************
+ * FRESHNESS FUNCTIONS
+ *********************/
+
+/*
+ * http_expiry - when response [resp] ([len] bytes, its head at least),
+ *               received at [now], stops being fresh in a shared 
+ *               cache; [ttl] seconds if it says nothing about it;
+ *               returns the time, or 0 if it may not be cached (or is
+ *               stale already)
+ */
+time_t http_expiry(char *resp, size_t len, time_t now, long ttl)
+{
+  if (!cacheable_status(http_status(resp, len)))
+    return 0;
+  return fresh_until(resp, len, now, ttl);
+}
+
+/*
+ * http_neg_expiry - when negative response [resp] ([len] bytes, its 
+ *                   head at least: a 404 or a 410), received at [now],
+ *                   stops being fresh in a shared cache: after [ttl]
+ *                   seconds at most, sooner if it says so;
+ *                   returns the time, or 0 if it's not a negative 
+ *                   response or may not be cached
+ */
+time_t http_neg_expiry(char *resp, size_t len, time_t now, long ttl)
+{
+  int status = http_status(resp, len);
+  time_t expires;
+
+  if ((status != 404 && status != 410) || ttl <= 0 ||
+      (expires = fresh_until(resp, len, now, ttl)) == 0)
+    return 0;
+  return expires < now + ttl ? expires : now + ttl;
+}
+
+/*
+ * http_refresh - when stored response [resp] ([len] bytes) stops being
+ *                fresh again after a 304 with head [head] ([hlen] 
+ *                bytes) at [now]: the 304's own freshness info wins,
+ *                or the stored response's is counted from the 304's
+ *                Date ([ttl] if neither says); returns the time, or 0
+ *                if it may not be kept
+ */
+time_t http_refresh(char *resp, size_t len, char *head, size_t hlen,
+                    time_t now, long ttl)
+{
+  char *cc;
+  size_t cclen;
+  long age, life;
+  time_t date;
+
+  if ((cc = http_header(head, hlen, "Cache-Control", &cclen)) != NULL &&
+      (http_directive(cc, cclen, "no-store", NULL) ||
+       http_directive(cc, cclen, "private", NULL)))
+    return 0;
+  date_age(head, hlen, now, &date, &age);
+  if ((life = lifetime(head, hlen, date, LIFE_NONE)) == LIFE_NONE)
+    life = lifetime(resp, len, date, ttl);
+  if (life < 0 || date + life - age <= now)
+    return 0;
+  return date + life - age;
+}
+
+/*
+ * http_not_modified - whether the conditional request headers [hdrs]
+ *                     ([hlen] bytes, ending in a blank line) are met by
+ *                     response [resp] (described by [d]), so the client
+ *                     gets a 304: If-None-Match holds its ETag, or else
+ *                     If-Modified-Since is no earlier than its
+ *                     Last-Modified
+ */
+int http_not_modified(char *resp, struct http_desc *d, char *hdrs,
+                      size_t hlen)
+{
+  char *inm, *ims;
+  size_t inmlen, imslen;
+  time_t since, modified;
+
+  if (d->status != 200)
+    return 0;
+  /* If-None-Match decides when there is one */
+  if ((inm = http_header(hdrs, hlen, "If-None-Match", &inmlen)) != NULL)
+    return d->etag.len != 0 &&
+           etag_match(inm, inmlen, resp + d->etag.off, d->etag.len);
+  if ((ims = http_header(hdrs, hlen, "If-Modified-Since", &imslen)) == NULL ||
+      d->lastmod.len == 0)
+    return 0;
+  since = http_date(ims, imslen);
+  modified = http_date(resp + d->lastmod.off, d->lastmod.len);
+  return since > 0 && modified > 0 && modified <= since;
+}
+
+/*
+ * http_stale - until when response [resp] ([len] bytes), stale from
+ *              [expires] on, may still be served for reason [name] 
+ *              ("stale-while-revalidate" or "stale-if-error"; NULL: 
+ *              either one): the directive's seconds, or else [swr] or
+ *              [sie] (0 unless the proxy opts in: RFC 9111 only allows
+ *              it when the origin says so); returns [expires] if it 
+ *              must be revalidated first
+ */
+time_t http_stale(char *resp, size_t len, time_t expires, const char *name,
+                  long swr, long sie)
+{
+  char *cc;
+  size_t cclen = 0;
+
+  /* s-maxage means proxy-revalidate to a shared cache */
+  if ((cc = http_header(resp, len, "Cache-Control", &cclen)) != NULL) {
+    if (http_directive(cc, cclen, "must-revalidate", NULL) ||
+        http_directive(cc, cclen, "proxy-revalidate", NULL) ||
+        http_directive(cc, cclen, "s-maxage", NULL))
+      return expires;
+    http_directive(cc, cclen, "stale-while-revalidate", &swr);
+    http_directive(cc, cclen, "stale-if-error", &sie);
+  }
+  if (swr < 0) swr = 0;
+  if (sie < 0) sie = 0;
+  if (name == NULL)
+    return expires + (swr > sie ? swr : sie);
+  return expires + (!strcmp(name, "stale-if-error") ? sie : swr);
+}
+
+/*
+ * http_variant - which variant of its object response [resp] ([len] 
+ *                bytes) is for request head [req] ([rlen] bytes): a 
+ *                hash of the request's values of the headers named by
+ *                its Vary (a header that's missing counts as empty);
+ *                returns the hash, or 0 if it doesn't vary
+ */
+unsigned long http_variant(char *resp, size_t len, char *req, size_t rlen)
+{
+  char *vary;
+  size_t vlen;
+
+  if ((vary = http_header(resp, len, "Vary", &vlen)) == NULL)
+    return 0;
+  return http_vary(vary, vlen, req, rlen);
+}
+
+/*
+ * http_vary - the variant (see http_variant) for request head [req] 
+ *             ([rlen] bytes) of a response whose Vary value is [vary]
+ *             ([vlen] bytes); returns the hash (never 0)
+ */
+unsigned long http_vary(char *vary, size_t vlen, char *req, size_t rlen)
+{
+  unsigned long hash = 14695981039346656037UL;
+  char name[64], *val;
+  size_t i = 0, n, k;
+
+  while (i < vlen) {
+    while (i < vlen && (vary[i] == ' ' || vary[i] == ','))
+      i++;
+    for (n = 0; i < vlen && vary[i] != ',' && vary[i] != ' '; i++)
+      if (n < sizeof(name) - 1)
+        name[n++] = tolower((unsigned char)vary[i]);
+    if (n == 0) continue;
+    name[n] = '\0';
+    /* Name & value go in the hash (FNV-1a) */
+    if ((val = http_header(req, rlen, name, &k)) == NULL)
+      k = 0;
+    for (n = 0; name[n]; n++)
+      hash = (hash ^ (unsigned char)name[n]) * 1099511628211UL;
+    hash = (hash ^ ':') * 1099511628211UL;
+    for (n = 0; n < k; n++)
+      hash = (hash ^ (unsigned char)val[n]) * 1099511628211UL;
+    hash = (hash ^ '\n') * 1099511628211UL;
+  }
+  return hash ? hash : 1;
+}
+
+/*
+ * http_ranges - which byte ranges of response [resp] (described by 
+ *               [d]), whose body has [size] bytes, request headers 
+ *               [hdrs] ([hlen] bytes) ask for: they go
+ *               in [r] (HTTP_RANGE_MAX at most), first to last as 
+ *               asked; returns how many, 0 if the whole response goes
+ *               (no Range, a malformed one, too many ranges, or an 
+ *               If-Range it doesn't meet), -1 if none can be served
+ */
+int http_ranges(char *resp, struct http_desc *d, size_t size, char *hdrs, 
+                size_t hlen, struct http_range *r)
+{
+  char *val, *p, *end, *num;
+  size_t vlen, ilen;
+  unsigned long long a, b;
+  int n = 0, asked = 0;
+
+  if (d->status != 200 ||
+      (val = http_header(hdrs, hlen, "Range", &vlen)) == NULL ||
+      vlen < 6 || strncasecmp(val, "bytes=", 6))
+    return 0;
+  if ((p = http_header(hdrs, hlen, "If-Range", &ilen)) != NULL &&
+      !if_range(resp, d, p, ilen))
+    return 0;
+  /* One spec at a time: "first-last", "first-" or "-suffix" */
+  for (p = val + 6, end = val + vlen; p < end; p++) {
+    while (p < end && (*p == ' ' || *p == ','))
+      p++;
+    if (p == end) break;
+    a = b = ULLONG_MAX;
+    if (*p != '-') {
+      if (!isdigit((unsigned char)*p)) return 0;
+      a = strtoull(p, &num, 10);
+      p = num;
+    }
+    if (p == end || *p++ != '-') return 0;
+    if (p < end && isdigit((unsigned char)*p)) {
+      b = strtoull(p, &num, 10);
+      p = num;
+    }
+    while (p < end && *p == ' ')
+      p++;
+    if ((p < end && *p != ',') || (a == ULLONG_MAX && b == ULLONG_MAX) ||
+        (a != ULLONG_MAX && b < a))
+      return 0;
+    if (++asked > HTTP_RANGE_MAX) return 0;
+    /* Suffix: the last [b] bytes */
+    if (a == ULLONG_MAX) {
+      if (b == 0 || size == 0) continue;
+      r[n].first = b < size ? size - b : 0;
+      r[n++].last = size - 1;
+    }
+    else if (a < size) {
+      r[n].first = a;
+      r[n++].last = b < size ? b : size - 1;
+    }
+  }
+  if (asked == 0) return 0;
+  return n > 0 ? n : -1;
+}
+
+/*
+ * lifetime - freshness lifetime of response [resp] ([len] bytes) sent
+ *            at [date]: its s-maxage, max-age or Expires, or a tenth
+ *            of its time since Last-Modified, or else [ttl]; returns 
+ *            the seconds (-1: expired already)
+ */
+static long lifetime(char *resp, size_t len, time_t date, long ttl)
+{
+  char *cc, *val;
+  size_t cclen, vlen;
+  long arg = -1, life;
+  time_t t, lm;
+
+  if ((cc = http_header(resp, len, "Cache-Control", &cclen)) != NULL &&
+      (http_directive(cc, cclen, "s-maxage", &arg) ||
+       http_directive(cc, cclen, "max-age", &arg)))
+    life = arg;
+  else if ((val = http_header(resp, len, "Expires", &vlen)) != NULL) {
+    // A bad Expires (like "0") means it's expired already
+    if ((t = http_date(val, vlen)) < 0) return -1;
+    life = t > date ? (long)(t - date) : -1;
+  }
+  else if ((val = http_header(resp, len, "Last-Modified", &vlen)) != NULL &&
+           (lm = http_date(val, vlen)) > 0 && lm < date) {
+    life = (long)(date - lm) / 10;
+    if (life > HTTP_HEURISTIC_MAX) life = HTTP_HEURISTIC_MAX;
+  }
+  else
+    life = ttl;
+  return life > HTTP_MAX_TTL ? HTTP_MAX_TTL : life;
+}
+
+/*
+ * date_age - the Date of response [resp] ([len] bytes), never ahead of
+ *            [now] (which it is without one), into [date] & its Age
+ *            into [age]
+ */
+static void date_age(char *resp, size_t len, time_t now, time_t *date, 
+                     long *age)
+{
+  char *val;
+  size_t vlen;
+  time_t t;
+
+  *date = now;
+  *age = 0;
+  if ((val = http_header(resp, len, "Date", &vlen)) != NULL &&
+      (t = http_date(val, vlen)) > 0 && t < now)
+    *date = t;
+  if ((val = http_header(resp, len, "Age", &vlen)) != NULL && 
+      (*age = atol(val)) < 0)
+    *age = 0;
+}
+
+/*
+ * etag_match - whether If-None-Match list [list] ([llen] bytes) holds
+ *              ETag [etag] ([elen] bytes), comparing weakly (W/ aside)
+ */
+static int etag_match(char *list, size_t llen, char *etag, size_t elen)
+{
+  size_t i = 0, j;
+
+  if (elen > 2 && !strncmp(etag, "W/", 2)) {
+    etag += 2;
+    elen -= 2;
+  }
+  while (i < llen) {
+    while (i < llen && (list[i] == ' ' || list[i] == ','))
+      i++;
+    if (i < llen && list[i] == '*') return 1;
+    if (llen - i > 2 && !strncmp(list + i, "W/", 2))
+      i += 2;
+    for (j = i; j < llen && list[j] != ',' && list[j] != ' '; j++)
+      ;
+    if (j - i == elen && !memcmp(list + i, etag, elen))
+      return 1;
+    i = j;
+  }
+  return 0;
+}
+
+/*
+ * if_range - whether If-Range value [val] ([vlen] bytes) still names 
+ *            response [resp] (described by [d]): its ETag (strongly) or
+ *            its Last-Modified date
+ */
+static int if_range(char *resp, struct http_desc *d, char *val, 
+                    size_t vlen)
+{
+  char *etag = resp + d->etag.off;
+  time_t t;
+
+  if (vlen > 0 && (val[0] == '"' || val[0] == 'W'))
+    return d->etag.len == vlen && etag[0] == '"' && 
+           !memcmp(etag, val, vlen);
+  return d->lastmod.len != 0 && (t = http_date(val, vlen)) > 0 && 
+         t == http_date(resp + d->lastmod.off, d->lastmod.len);
+}
+
+/*
+ * find_field - where the value of header [name] of response [resp] 
+ *              ([len] bytes) is: it goes in [f] (left alone if there's
+ *              no such header)
+ */
+static void find_field(char *resp, size_t len, const char *name,
+                       struct http_field *f)
+{
+  char *val;
+  size_t vlen;
+
+  if ((val = http_header(resp, len, name, &vlen)) != NULL) {
+    f->off = val - resp;
+    f->len = vlen;
+  }
+}
+
+/*
+ * fresh_until - when response [resp] ([len] bytes), received at [now],
+ *               stops being fresh in a shared cache, whatever its 
+ *               status ([ttl] seconds if it says nothing about it);
+ *               returns the time, or 0 if it may not be cached
+ */
+static time_t fresh_until(char *resp, size_t len, time_t now, long ttl)
+{
+  char *cc, *val;
+  size_t cclen = 0, vlen;
+  long age, life;
+  time_t date;
+
+  if (!http_head_len(resp, len))
+    return 0;
+  /* What the origin says about caching it */
+  cc = http_header(resp, len, "Cache-Control", &cclen);
+  if (cc != NULL && (http_directive(cc, cclen, "no-store", NULL) ||
+                     http_directive(cc, cclen, "private", NULL) ||
+                     http_directive(cc, cclen, "no-cache", NULL)))
+    return 0;
+  if (cc == NULL && (val = http_header(resp, len, "Pragma", &vlen)) != NULL &&
+      http_directive(val, vlen, "no-cache", NULL))
+    return 0;
+  /* Varies on something other than the request (like "*") */
+  if ((val = http_header(resp, len, "Vary", &vlen)) != NULL &&
+      memchr(val, '*', vlen) != NULL)
+    return 0;
+  date_age(resp, len, now, &date, &age);
+  if ((life = lifetime(resp, len, date, ttl)) < 0 ||
+      date + life - age <= now)
+    return 0;
+  return date + life - age;
+}
+
+/*
+ * cacheable_status - whether a response with [status] may be cached
+ *                    without being told so explicitly
+ */
+static int cacheable_status(int status)
+{
+  switch (status) {
+    case 200: case 203: case 204: case 300: case 301: case 308:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*
+ * find_crlf2 - find the first blank line ("\r\n\r\n") in the [len]
+ *              bytes at [s]; returns NULL if there's none
+ */
+static char *find_crlf2(char *s, size_t len)
+{
+  char *p = s, *end = s + len;
+
+  while (end - p >= 4 && (p = memchr(p, '\r', end - p - 3)) != NULL) {
+    if (!memcmp(p, "\r\n\r\n", 4))
+      return p;
+    p++;
+  }
+  return NULL;
+}
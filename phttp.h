@@ -0,0 +1,75 @@
+/*
+ * phttp.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for phttp.c (HTTP response heads & freshness)
+ */
+#ifndef __PHTTP_H__
+#define __PHTTP_H__
+
+#include <stddef.h>
+#include <time.h>
+
+/* Freshness limits (seconds) */
+#define HTTP_DEFAULT_TTL   3600     // no freshness info & no Last-Modified
+#define HTTP_HEURISTIC_MAX 86400    // Last-Modified heuristic cap (1 day)
+#define HTTP_MAX_TTL       31536000 // nothing is fresh for more than a year
+#define HTTP_SWR_DEFAULT   0        // stale-while-revalidate if not given
+#define HTTP_SIE_DEFAULT   0        // stale-if-error if not given
+#define HTTP_NEG_TTL       10       // 404s & 410s fresh at most this long
+#define HTTP_ERROR_TTL     5        // the proxy's own 502 (origin unreachable)
+/* Ranges of one request served (more get the whole object) */
+#define HTTP_RANGE_MAX     16
+
+/* Structure of a byte range consists of its first & last body bytes */
+struct http_range {
+  size_t first, last;
+};
+
+/* Structure of a header field consists of where its value starts in a
+ * response & how long it is (a length of 0: there's no such header).
+ */
+struct http_field {
+  unsigned int off, len;
+};
+
+/* Structure of a response descriptor consists of what serving a stored
+ * response takes, found once when it's stored: its status, the bytes 
+ * of its head (its body follows), its Date (or when it came, if it 
+ * has none) & Age then, and where the headers the proxy answers with
+ * are (see http_describe).
+ */
+struct http_desc {
+  int status;
+  size_t head;
+  time_t date;
+  long age;
+  struct http_field ctype, etag, lastmod, vary, cc, expires, agehdr;
+};
+
+/* Function prototypes for HTTP response operations */
+size_t http_head_len(char *resp, size_t len);
+int http_status(char *resp, size_t len);
+char *http_header(char *resp, size_t len, const char *name, size_t *vlen);
+void http_describe(char *resp, size_t len, time_t now, struct http_desc *d);
+long http_age(struct http_desc *d, time_t now);
+int http_directive(char *val, size_t vlen, const char *name, long *arg);
+time_t http_date(char *val, size_t vlen);
+time_t http_expiry(char *resp, size_t len, time_t now, long ttl);
+time_t http_neg_expiry(char *resp, size_t len, time_t now, long ttl);
+time_t http_refresh(char *resp, size_t len, char *head, size_t hlen,
+                    time_t now, long ttl);
+int http_not_modified(char *resp, struct http_desc *d, char *hdrs,
+                      size_t hlen);
+time_t http_stale(char *resp, size_t len, time_t expires, const char *name,
+                  long swr, long sie);
+unsigned long http_variant(char *resp, size_t len, char *req, size_t rlen);
+unsigned long http_vary(char *vary, size_t vlen, char *req, size_t rlen);
+int http_ranges(char *resp, struct http_desc *d, size_t size, char *hdrs, 
+                size_t hlen, struct http_range *r);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * phuge.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is where the cache's big regions get their memory. A region is
+ * mapped with regular pages, aligned to a huge page, and madvised so the
+ * kernel may back it with transparent huge pages as it's touched. Asked
+ * for (-H), it's backed by hugetlb pages instead when the administrator
+ * has set enough aside; they're committed when the region is mapped (so
+ * running short shows up here and not as a SIGBUS later) and can't be
+ * given back. Either way, fewer TLB entries cover a multi-GB cache. How
+ * much of a region really is in huge pages is read back from
+ * /proc/self/smaps.
+ */
+
+#include "csapp.h"
+#include "phuge.h"
+
+static size_t hpsize = 0; // huge page size (0 until it's looked up)
+
+static size_t smaps_kb(char *line, const char *field);
+
+
+/****************
+ * HUGE FUNCTIONS
+ ****************/
+
+/*
+ * huge_map - map a region of at least [*len] bytes (rounded up to a
+ *            huge page, the size mapped goes back in [*len]), shared
+ *            with processes forked later on if [shared], from hugetlb
+ *            pages if [tlb] and there are enough of them; what backs
+ *            it goes in [kind]; returns the region
+ *
+ * Note: a region that isn't HUGE_TLB is reserved, not committed
+ */
+void *huge_map(size_t *len, int shared, int tlb, int *kind)
+{
+  size_t hp = huge_page_size(), head;
+  int flags = (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS;
+  char *p;
+
+  *len = (*len + hp - 1) / hp * hp;
+  /* hugetlb pages, if they're asked for & there are enough of them */
+  if (tlb) {
+    p = mmap(NULL, *len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      *kind = HUGE_TLB;
+      return p;
+    }
+  }
+
+  /* Regular pages: align the region so all of it can go huge */
+  p = Mmap(NULL, *len + hp, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE,
+           -1, 0);
+  head = (hp - (size_t)p % hp) % hp;
+  if (head > 0)
+    munmap(p, head);
+  if (hp - head > 0)
+    munmap(p + head + *len, hp - head);
+  p += head;
+  *kind = madvise(p, *len, MADV_HUGEPAGE) == 0 ? HUGE_THP : HUGE_NONE;
+  return p;
+}
+
+/*
+ * huge_backed - bytes of the [len] byte region at [addr], mapped by
+ *               huge_map as [kind], that are in huge pages right now
+ */
+size_t huge_backed(void *addr, size_t len, int kind)
+{
+  unsigned long start, end, lo = (unsigned long)addr, hi = lo + len;
+  size_t kb = 0;
+  int in = 0;
+  char line[MAXLINE];
+  FILE *fp;
+
+  if (kind == HUGE_TLB) return len;
+  if (kind == HUGE_NONE || (fp = fopen(HUGE_SMAPS, "r")) == NULL)
+    return 0;
+  /* The region may be split in several mappings (see numa_bind) */
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+      in = start < hi && end > lo;
+    else if (in)
+      kb += smaps_kb(line, "AnonHugePages:") +
+            smaps_kb(line, "ShmemPmdMapped:");
+  }
+  fclose(fp);
+  return kb * 1024;
+}
+
+/*
+ * huge_page_size - size of a huge page on this host
+ */
+size_t huge_page_size(void)
+{
+  char line[MAXLINE];
+  FILE *fp;
+
+  if (hpsize != 0) return hpsize;
+  hpsize = HUGE_PAGE_SIZE;
+  if ((fp = fopen(HUGE_MEMINFO, "r")) == NULL)
+    return hpsize;
+  while (fgets(line, sizeof(line), fp) != NULL)
+    if (smaps_kb(line, "Hugepagesize:") > 0)
+      hpsize = smaps_kb(line, "Hugepagesize:") * 1024;
+  fclose(fp);
+  return hpsize;
+}
+
+/*
+ * huge_name - what a region of [kind] is backed by, for stats
+ */
+const char *huge_name(int kind)
+{
+  switch (kind) {
+    case HUGE_TLB: return "hugetlb";
+    case HUGE_THP: return "transparent";
+    default:       return "none";
+  }
+}
+
+/*
+ * smaps_kb - the kB count of [line] if it's the line of [field] in
+ *            /proc/self/smaps (or /proc/meminfo); 0 if it isn't
+ */
+static size_t smaps_kb(char *line, const char *field)
+{
+  size_t n = strlen(field);
+
+  if (strncmp(line, field, n))
+    return 0;
+  return (size_t)strtoul(line + n, NULL, 10);
+}
@@ -0,0 +1,31 @@
+/*
+ * phuge.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for phuge.c (huge-page backed regions)
+ */
+#ifndef __PHUGE_H__
+#define __PHUGE_H__
+
+#include <stddef.h>
+
+#define HUGE_PAGE_SIZE 2097152 // if /proc/meminfo doesn't say (2 Mb)
+#define HUGE_MEMINFO   "/proc/meminfo"
+#define HUGE_SMAPS     "/proc/self/smaps"
+
+/* What a region is backed by */
+#define HUGE_NONE 0 // regular pages
+#define HUGE_THP  1 // transparent huge pages (madvised, best effort)
+#define HUGE_TLB  2 // hugetlb pages set aside by the administrator
+
+/* Function prototypes for huge page operations */
+void *huge_map(size_t *len, int shared, int tlb, int *kind);
+size_t huge_backed(void *addr, size_t len, int kind);
+size_t huge_page_size(void);
+const char *huge_name(int kind);
+
+#endif
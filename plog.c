@@ -0,0 +1,314 @@
+/*
+ * plog.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the log-structured store the web object cache can use
+ * instead of the slab allocator. The budget is reserved as one region
+ * and cut into large segments; records are appended to the open
+ * segment with a plain memcpy, and a full segment is sealed onto a
+ * FIFO. Memory is reclaimed a whole segment at a time: the oldest one
+ * is walked and the owner of every record still in it is evicted (or
+ * moved to the open segment, if the evict callback finds it hot). A
+ * segment whose records were all freed earlier goes back to the free
+ * list without waiting for its turn.
+ */
+
+#include "csapp.h"
+#include "plog.h"
+#include "phuge.h"
+
+/* Segment <-> address conversions */
+#define SEG_OF(lg, p)     (&(lg)->segs[((char *)(p) - (lg)->base) / \
+                                       (lg)->segsize])
+#define SEG_BASE(lg, sg)  ((lg)->base + \
+                           (size_t)((sg) - (lg)->segs) * (lg)->segsize)
+#define LOG_ROUND(n)      (((n) + LOG_ALIGN - 1) & ~(size_t)(LOG_ALIGN - 1))
+
+static void seg_push(lseg **oldest, lseg **newest, lseg *sg);
+static void seg_del(lseg **oldest, lseg **newest, lseg *sg);
+static void seg_release(logstore *lg, lseg *sg);
+static void log_clear(logstore *lg);
+
+
+/***************
+ * LOG FUNCTIONS
+ ***************/
+
+/*
+ * log_init - reserve [budget] bytes for log store [lg] holding records
+ *            of up to [maxsize] bytes; segments shrink from
+ *            LOG_SEG_SIZE until there are LOG_MIN_SEGS of them (but
+ *            always hold the largest record); if [shared], the region
+ *            & segment metadata are shared with processes forked later;
+ *            if [tlb], the region is in hugetlb pages when it can be
+ */
+void log_init(logstore *lg, size_t budget, size_t maxsize, int shared,
+              int tlb)
+{
+  size_t min = LOG_ROUND(maxsize + LOG_REC_HDR);
+
+  /* Pick the segment size */
+  lg->segsize = LOG_SEG_SIZE;
+  while (lg->segsize / 2 >= min && budget / lg->segsize < LOG_MIN_SEGS)
+    lg->segsize /= 2;
+  while (lg->segsize < min)
+    lg->segsize *= 2;
+  /* Reserve the region */
+  lg->nsegs = budget / lg->segsize;
+  if (lg->nsegs < 2) lg->nsegs = 2; // one open & one to evict
+  lg->shared = shared;
+  lg->maplen = lg->nsegs * lg->segsize;
+  lg->base = huge_map(&lg->maplen, shared, tlb, &lg->huge);
+  if (shared)
+    lg->segs = Mmap(NULL, lg->nsegs * sizeof(lseg), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  else
+    lg->segs = Calloc(lg->nsegs, sizeof(lseg));
+  lg->maxsegs = lg->nsegs;
+  log_clear(lg);
+}
+
+/*
+ * log_reset - empty log store [lg]: every segment goes back on the
+ *             free list & its memory is given back to the system
+ *
+ * Note: whatever was allocated from it is gone
+ */
+void log_reset(logstore *lg)
+{
+  madvise(lg->base, lg->maplen, lg->shared ? MADV_REMOVE : MADV_DONTNEED);
+  memset(lg->segs, 0, lg->nsegs * sizeof(lseg));
+  log_clear(lg);
+}
+
+/*
+ * log_clear - put every segment of log store [lg] on the free list
+ */
+static void log_clear(logstore *lg)
+{
+  size_t i;
+
+  lg->head = lg->oldest = lg->newest = lg->free = NULL;
+  for (i = lg->nsegs; i-- > 0; ) {
+    lg->segs[i].state = LOG_FREE;
+    lg->segs[i].next = lg->free;
+    lg->free = &lg->segs[i];
+  }
+  lg->nfree = lg->nsegs;
+  lg->walking = NULL;
+  lg->evicted = lg->reinserted = lg->draining = 0;
+}
+
+/*
+ * log_alloc - append a record for an object of [size] bytes owned by
+ *             [owner] (NULL: the record owns itself) to log store [lg];
+ *             returns the record's data, or NULL if the open segment
+ *             is full and no segment is free (caller must evict)
+ */
+void *log_alloc(logstore *lg, size_t size, void *owner)
+{
+  size_t rsize = LOG_ROUND(size + LOG_REC_HDR);
+  lseg *sg = lg->head;
+  struct log_rec *rec;
+
+  if (rsize > lg->segsize) return NULL;
+  /* Open segment is full: seal it & open a free one */
+  if (sg == NULL || sg->used + rsize > lg->segsize) {
+    if (lg->free == NULL || lg->nsegs - lg->nfree >= lg->maxsegs)
+      return NULL;
+    if (sg != NULL) {
+      sg->state = LOG_SEALED;
+      seg_push(&lg->oldest, &lg->newest, sg);
+      if (sg->live == 0) seg_release(lg, sg);
+    }
+    sg = lg->head = lg->free;
+    lg->free = sg->next;
+    lg->nfree--;
+    sg->used = sg->live = sg->reqbytes = 0;
+    sg->state = LOG_OPEN;
+  }
+  /* Append the record */
+  rec = (struct log_rec *)(SEG_BASE(lg, sg) + sg->used);
+  sg->used += rsize;
+  sg->live++;
+  sg->reqbytes += size;
+  rec->size = rsize;
+  rec->owner = owner ? owner : (void *)(rec + 1);
+  return rec + 1;
+}
+
+/*
+ * log_free - free record [ptr] (holding [size] bytes) of log store
+ *            [lg]; its segment is released once its last record goes
+ *            (unless it's still being appended to)
+ */
+void log_free(logstore *lg, void *ptr, size_t size)
+{
+  struct log_rec *rec = (struct log_rec *)ptr - 1;
+  lseg *sg = SEG_OF(lg, rec);
+
+  rec->owner = NULL;
+  sg->reqbytes -= size;
+  if (--sg->live == 0 && sg->state != LOG_OPEN && sg != lg->walking)
+    seg_release(lg, sg);
+}
+
+/*
+ * log_evict - empty the oldest segment of log store [lg]: [evict] is
+ *             called on the owner of every record still in it, and may
+ *             free the owner or move it with log_alloc;
+ *             returns 1 if a segment was evicted, 0 if none are sealed
+ *
+ * Note: a segment whose records are still read by someone is released
+ *       by the last log_free instead
+ */
+int log_evict(logstore *lg, void (*evict)(void *owner, void *arg), void *arg)
+{
+  lseg *sg = lg->oldest;
+  struct log_rec *rec;
+  size_t off;
+
+  if (sg == NULL) return 0;
+  seg_del(&lg->oldest, &lg->newest, sg);
+  sg->state = LOG_DRAINING;
+  lg->draining++;
+  lg->evicted++;
+
+  /* Walk the records in the order they were appended */
+  lg->walking = sg;
+  for (off = 0; off < sg->used && sg->live > 0; off += rec->size) {
+    rec = (struct log_rec *)(SEG_BASE(lg, sg) + off);
+    if (rec->owner != NULL)
+      evict(rec->owner, arg);
+  }
+  lg->walking = NULL;
+
+  if (sg->live == 0) seg_release(lg, sg);
+  return 1;
+}
+
+/*
+ * log_capacity - bytes of memory log store [lg] may hand out (its limit)
+ */
+size_t log_capacity(logstore *lg)
+{
+  return lg->maxsegs * lg->segsize;
+}
+
+/*
+ * log_limit - let log store [lg] use [bytes] of segments at most (at
+ *             least two, at most the whole region); returns the new 
+ *             limit in bytes
+ *
+ * Note: segments over a lower limit stay in use until they're evicted;
+ *       while the limit is below the region, a released segment's 
+ *       memory is given back to the system
+ */
+size_t log_limit(logstore *lg, size_t bytes)
+{
+  lg->maxsegs = bytes / lg->segsize;
+  if (lg->maxsegs < 2) lg->maxsegs = 2;
+  if (lg->maxsegs > lg->nsegs) lg->maxsegs = lg->nsegs;
+  return log_capacity(lg);
+}
+
+/*
+ * log_used - bytes of segments of log store [lg] in use (open, sealed
+ *            or still draining)
+ */
+size_t log_used(logstore *lg)
+{
+  return (lg->nsegs - lg->nfree) * lg->segsize;
+}
+
+
+/************************
+ * SEGMENT LIST FUNCTIONS
+ ************************/
+
+/*
+ * seg_push - append segment [sg] to the FIFO [oldest]..[newest]
+ */
+static void seg_push(lseg **oldest, lseg **newest, lseg *sg)
+{
+  sg->next = NULL;
+  sg->prev = *newest;
+  if (*newest) (*newest)->next = sg;
+  else         *oldest = sg;
+  *newest = sg;
+}
+
+/*
+ * seg_del - unlink segment [sg] from the FIFO [oldest]..[newest]
+ */
+static void seg_del(lseg **oldest, lseg **newest, lseg *sg)
+{
+  if (sg->prev) sg->prev->next = sg->next;
+  else          *oldest = sg->next;
+  if (sg->next) sg->next->prev = sg->prev;
+  else          *newest = sg->prev;
+  sg->prev = sg->next = NULL;
+}
+
+/*
+ * seg_release - put empty segment [sg] of [lg] back on the free list
+ */
+static void seg_release(logstore *lg, lseg *sg)
+{
+  if (sg->state == LOG_SEALED)
+    seg_del(&lg->oldest, &lg->newest, sg);
+  else if (sg->state == LOG_DRAINING)
+    lg->draining--;
+  sg->state = LOG_FREE;
+  sg->next = lg->free;
+  lg->free = sg;
+  lg->nfree++;
+  // Shrunk: the memory goes back to the system right away
+  if (lg->maxsegs < lg->nsegs &&
+      madvise(SEG_BASE(lg, sg), lg->segsize, 
+              lg->shared ? MADV_REMOVE : MADV_DONTNEED) < 0)
+    fprintf(stderr, "seg_release: can't give back a segment: %s\n",
+            strerror(errno));
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * log_stats - print segment usage of log store [lg] to [fp]
+ */
+void log_stats(logstore *lg, FILE *fp)
+{
+  unsigned long sealed = 0, used = 0, reqbytes = 0;
+  lseg *sg;
+
+  for (sg = lg->oldest; sg != NULL; sg = sg->next) {
+    sealed++;
+    used += sg->used;
+    reqbytes += sg->reqbytes;
+  }
+  if ((sg = lg->head) != NULL) {
+    used += sg->used;
+    reqbytes += sg->reqbytes;
+  }
+  fprintf(fp, "- LOG SEGMENTS -\n");
+  fprintf(fp, "segments: %lu sealed, %lu draining, %lu free, %lu total, "
+              "%lu allowed (%lu byte segments)\n",
+          sealed, lg->draining, (unsigned long)lg->nfree,
+          (unsigned long)lg->nsegs, (unsigned long)lg->maxsegs, 
+          (unsigned long)lg->segsize);
+  fprintf(fp, "live: %.1f%% of %lu appended bytes\n",
+          used ? 100.0 * reqbytes / used : 0.0, used);
+  fprintf(fp, "evicted: %lu segments | reinserted: %lu objects\n",
+          lg->evicted, lg->reinserted);
+  fprintf(fp, "huge pages: %lu of %lu bytes (%s)\n",
+          (unsigned long)huge_backed(lg->base, lg->maplen, lg->huge),
+          (unsigned long)lg->maplen, huge_name(lg->huge));
+  fprintf(fp, "----------------\n");
+}
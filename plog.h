@@ -0,0 +1,87 @@
+/*
+ * plog.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for plog.c (log-structured store for cache
+ * lines)
+ */
+#ifndef __PLOG_H__
+#define __PLOG_H__
+
+#include <stdio.h>
+
+/* Log geometry */
+#define LOG_SEG_SIZE  1048576 // largest segment (1 Mb)
+#define LOG_MIN_SEGS  8       // segments are halved until there are this many
+#define LOG_ALIGN     16      // records start on 16 byte boundaries
+
+/* Every record starts with a header naming the object that owns it
+ * (NULL once it's freed) and its size, so a segment can be walked
+ * and emptied by evicting the owners of its records.
+ */
+struct log_rec {
+  void *owner;
+  size_t size;            // record bytes (header & padding included)
+};
+#define LOG_REC_HDR sizeof(struct log_rec)
+
+/* States of a log segment */
+#define LOG_FREE     0    // on the free list
+#define LOG_OPEN     1    // being appended to
+#define LOG_SEALED   2    // full, waiting in the FIFO
+#define LOG_DRAINING 3    // evicted, waiting for its last reader
+
+/* Structure of a log segment consists of how much of it is appended,
+ * how many of its records are still in use and their bytes, its state
+ * and links for the FIFO (oldest first) or the free list.
+ */
+struct log_seg {
+  size_t used;
+  unsigned long live;      // records not freed yet
+  unsigned long reqbytes;  // bytes actually requested by those records
+  int state;
+  struct log_seg *prev;
+  struct log_seg *next;
+};
+typedef struct log_seg lseg;
+
+/* Structure of a log store consists of one region reserved up front
+ * for the whole budget, cut into equal segments; the segment being
+ * appended to, the FIFO of full ones, the free ones, the one being
+ * evicted (it can't be reused until the walk is over), and statistics.
+ */
+struct log_store {
+  char *base;
+  size_t maplen;           // bytes mapped (the segments, rounded up)
+  int huge;                // HUGE_* backing of the region (phuge.c)
+  size_t segsize;
+  size_t nsegs;
+  lseg *segs;              // per-segment metadata
+  lseg *head;              // open segment (NULL before the first record)
+  lseg *oldest, *newest;   // FIFO of sealed segments
+  lseg *free;
+  size_t nfree;
+  size_t maxsegs;          // most segments in use (see log_limit)
+  lseg *walking;           // segment log_evict is emptying
+  int shared;              // mapped shared (prefork workers)
+  unsigned long evicted, reinserted, draining;
+};
+typedef struct log_store logstore;
+
+/* Function prototypes for log store operations */
+void log_init(logstore *lg, size_t budget, size_t maxsize, int shared,
+              int tlb);
+void log_reset(logstore *lg);
+void *log_alloc(logstore *lg, size_t size, void *owner);
+void log_free(logstore *lg, void *ptr, size_t size);
+int log_evict(logstore *lg, void (*evict)(void *owner, void *arg), void *arg);
+size_t log_capacity(logstore *lg);
+size_t log_limit(logstore *lg, size_t bytes);
+size_t log_used(logstore *lg);
+void log_stats(logstore *lg, FILE *fp);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * pnuma.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the NUMA placement for the proxy: the topology is read from
+ * sysfs, threads (or whole worker processes) are pinned to the CPUs of
+ * one node, and memory ranges are bound to a node before they're
+ * touched. There's no libnuma here, just the system calls; a host that
+ * doesn't expose any nodes counts as one node holding every CPU.
+ */
+
+#define _GNU_SOURCE // cpu_set_t (csapp.h doesn't build with it)
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include "pnuma.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1 // from <numaif.h>
+#endif
+
+/* The topology: how many nodes & the CPUs of each one */
+static int nnodes = 1;
+static cpu_set_t node_cpus[NUMA_MAX_NODES];
+
+static void parse_cpulist(char *list, cpu_set_t *set);
+
+
+/****************
+ * NUMA FUNCTIONS
+ ****************/
+
+/*
+ * numa_init - read the NUMA topology of the host;
+ *             returns the number of nodes (1 if there's no topology)
+ */
+int numa_init(void)
+{
+  char path[256], list[4096];
+  FILE *fp;
+  int n;
+
+  nnodes = 0;
+  for (n = 0; n < NUMA_MAX_NODES; n++) {
+    snprintf(path, sizeof(path), "%s/node%d/cpulist", NUMA_SYSFS, n);
+    if ((fp = fopen(path, "r")) == NULL)
+      break;
+    CPU_ZERO(&node_cpus[n]);
+    if (fgets(list, sizeof(list), fp) != NULL)
+      parse_cpulist(list, &node_cpus[n]);
+    fclose(fp);
+    // A node without CPUs (memory only) can't run anything
+    if (CPU_COUNT(&node_cpus[n]) == 0)
+      break;
+    nnodes++;
+  }
+  /* No topology: one node with every CPU we may run on */
+  if (nnodes == 0) {
+    nnodes = 1;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &node_cpus[0]) < 0)
+      CPU_ZERO(&node_cpus[0]);
+  }
+  return nnodes;
+}
+
+/*
+ * numa_pin - pin the calling thread (and the threads it creates later)
+ *            to the CPUs of [node]; returns 0 on success, -1 on error
+ */
+int numa_pin(int node)
+{
+  if (node < 0 || node >= nnodes || CPU_COUNT(&node_cpus[node]) == 0)
+    return -1;
+  return sched_setaffinity(0, sizeof(cpu_set_t), &node_cpus[node]);
+}
+
+/*
+ * numa_bind - have the pages of [len] bytes at [addr] (page aligned)
+ *             allocated on [node] from now on (or elsewhere if it's
+ *             out of memory); returns 0 on success, -1 on error
+ */
+int numa_bind(void *addr, size_t len, int node)
+{
+  unsigned long mask = 1UL << node;
+
+  return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask,
+                 sizeof(mask) * 8, 0) < 0 ? -1 : 0;
+}
+
+/*
+ * parse_cpulist - add the CPUs of sysfs list [list] ("0-3,8,10-11")
+ *                 to [set]
+ */
+static void parse_cpulist(char *list, cpu_set_t *set)
+{
+  char *p = list, *end;
+  long lo, hi;
+
+  while (*p != '\0' && *p != '\n') {
+    lo = hi = strtol(p, &end, 10);
+    if (end == p) return;
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+    for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+      CPU_SET(lo, set);
+    p = (*end == ',') ? end + 1 : end;
+  }
+}
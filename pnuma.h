@@ -0,0 +1,24 @@
+/*
+ * pnuma.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pnuma.c (NUMA topology & placement)
+ */
+#ifndef __PNUMA_H__
+#define __PNUMA_H__
+
+#include <stddef.h>
+
+#define NUMA_MAX_NODES 8 // nodes beyond this aren't used
+#define NUMA_SYSFS     "/sys/devices/system/node"
+
+/* Function prototypes for NUMA operations */
+int numa_init(void);
+int numa_pin(int node);
+int numa_bind(void *addr, size_t len, int node);
+
+#endif
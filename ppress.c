@@ -0,0 +1,216 @@
+/*
+ * ppress.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the memory pressure monitor that sizes the cache. Every few
+ * seconds it reads the proxy's cgroup v2 files (memory.current against
+ * memory.high, or memory.max) and its PSI memory pressure, and decides
+ * on a cache budget: under pressure the budget shrinks by a fraction
+ * (the cache evicts down to it), and once things have been calm for a
+ * while it grows back a step at a time, up to the budget it was given.
+ * The thresholds to shrink & to grow are apart, a shrink is followed by
+ * a few checks without another, and growing takes several calm checks
+ * in a row, so the budget doesn't flap.
+ */
+
+#include "csapp.h"
+#include "ppress.h"
+
+static int find_cgroup(char *dir, size_t len);
+static int press_path(char *path, size_t len, char *dir, char *file);
+static int read_size(char *path, size_t *size);
+static int read_stall(char *path, double *stall);
+
+
+/********************
+ * PRESSURE FUNCTIONS
+ ********************/
+
+/*
+ * pressure_init - set up monitor [pr] for a cache given [budget] bytes;
+ *                 returns 0, or -1 if there's nothing to monitor (no
+ *                 cgroup v2 memory controller and no PSI)
+ */
+int pressure_init(pressure *pr, size_t budget)
+{
+  char dir[PATH_MAX];
+
+  memset(pr, 0, sizeof(*pr));
+  pr->max_budget = pr->budget = budget;
+  pr->min_budget = budget / PRESS_MIN;
+  // A cgroup whose paths don't fit isn't read at all
+  if (find_cgroup(dir, sizeof(dir)) == 0 &&
+      (press_path(pr->current, sizeof(pr->current), dir, "memory.current") ||
+       press_path(pr->high, sizeof(pr->high), dir, "memory.high") ||
+       press_path(pr->max, sizeof(pr->max), dir, "memory.max") ||
+       press_path(pr->psi, sizeof(pr->psi), dir, "memory.pressure")))
+    pr->current[0] = pr->high[0] = pr->max[0] = pr->psi[0] = '\0';
+  if (pr->psi[0] == '\0' || access(pr->psi, R_OK) < 0)
+    snprintf(pr->psi, sizeof(pr->psi), "%s", PRESS_PSI_HOST);
+  if (access(pr->psi, R_OK) < 0)
+    pr->psi[0] = '\0';
+  return (pr->current[0] || pr->psi[0]) ? 0 : -1;
+}
+
+/*
+ * pressure_check - read the memory use & pressure and move the budget
+ *                  of monitor [pr]; returns the budget in effect
+ */
+size_t pressure_check(pressure *pr)
+{
+  size_t step;
+  int tight, roomy;
+
+  /* Read what there is to read */
+  pr->used = pr->limit = 0;
+  pr->stall = 0;
+  if (pr->current[0] && read_size(pr->current, &pr->used) == 0 &&
+      read_size(pr->high, &pr->limit) < 0)
+    read_size(pr->max, &pr->limit);
+  if (pr->psi[0])
+    read_stall(pr->psi, &pr->stall);
+  tight = pr->stall >= PRESS_HIGH ||
+          (pr->limit && pr->used >= pr->limit / 100 * PRESS_FULL);
+  roomy = pr->stall <= PRESS_LOW &&
+          (!pr->limit || pr->used < pr->limit / 100 * PRESS_ROOM);
+
+  /* Under pressure: shrink, then give eviction time to show */
+  if (pr->hold > 0) pr->hold--;
+  if (tight) {
+    pr->calm = 0;
+    if (pr->hold == 0 && pr->budget > pr->min_budget) {
+      step = pr->budget / PRESS_SHRINK;
+      pr->budget = pr->budget - step > pr->min_budget ? 
+                   pr->budget - step : pr->min_budget;
+      pr->hold = PRESS_HOLD;
+      pr->shrinks++;
+    }
+    return pr->budget;
+  }
+  /* Calm for long enough: grow, as far as the limit leaves room */
+  if (!roomy) {
+    pr->calm = 0;
+    return pr->budget;
+  }
+  if (++pr->calm < PRESS_CALM || pr->budget >= pr->max_budget)
+    return pr->budget;
+  step = pr->max_budget / PRESS_GROW;
+  if (pr->limit && step > pr->limit / 100 * PRESS_ROOM - pr->used)
+    step = pr->limit / 100 * PRESS_ROOM - pr->used;
+  pr->budget = pr->budget + step < pr->max_budget ? 
+               pr->budget + step : pr->max_budget;
+  pr->calm = 0;
+  pr->grows++;
+  return pr->budget;
+}
+
+/*
+ * find_cgroup - put the directory of the proxy's cgroup v2 in [dir]
+ *               ([len] bytes); returns 0, or -1 if it has no memory
+ *               controller files there
+ */
+static int find_cgroup(char *dir, size_t len)
+{
+  const char *roots[] = { PRESS_CGROUP, PRESS_CGROUP_HYB };
+  char line[MAXLINE], path[PATH_MAX];
+  FILE *fp;
+  unsigned int i;
+  int n;
+
+  if ((fp = fopen("/proc/self/cgroup", "r")) == NULL)
+    return -1;
+  // The v2 hierarchy is the "0::" line
+  while (fgets(line, sizeof(line), fp) != NULL)
+    if (!strncmp(line, "0::", 3))
+      break;
+  fclose(fp);
+  if (strncmp(line, "0::", 3))
+    return -1;
+  line[strcspn(line, "\n")] = '\0';
+  for (i = 0; i < sizeof(roots) / sizeof(roots[0]); i++) {
+    n = snprintf(path, sizeof(path), "%s%s/memory.current", 
+                 roots[i], line + 3);
+    if (n < 0 || (size_t)n >= sizeof(path) || access(path, R_OK) < 0)
+      continue;
+    n = snprintf(dir, len, "%s%s", roots[i], line + 3);
+    return (n < 0 || (size_t)n >= len) ? -1 : 0;
+  }
+  return -1;
+}
+
+/*
+ * press_path - put the path of cgroup file [file] in directory [dir]
+ *              into [path] ([len] bytes); returns 0, or -1 (and an
+ *              empty [path]) if it doesn't fit
+ */
+static int press_path(char *path, size_t len, char *dir, char *file)
+{
+  int n = snprintf(path, len, "%s/%s", dir, file);
+
+  if (n < 0 || (size_t)n >= len) {
+    path[0] = '\0';
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * read_size - read the byte count in cgroup file [path] into [size];
+ *             returns 0, or -1 if it can't be read or says "max"
+ */
+static int read_size(char *path, size_t *size)
+{
+  char buf[64];
+  FILE *fp;
+  int ok;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+  ok = fgets(buf, sizeof(buf), fp) != NULL && buf[0] >= '0' && buf[0] <= '9';
+  fclose(fp);
+  if (!ok) return -1;
+  *size = (size_t)strtoull(buf, NULL, 10);
+  return 0;
+}
+
+/*
+ * read_stall - read the "some" avg10 of PSI file [path] into [stall];
+ *              returns 0, or -1 if it can't be read
+ */
+static int read_stall(char *path, double *stall)
+{
+  char buf[256];
+  FILE *fp;
+  int ok;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+  ok = fgets(buf, sizeof(buf), fp) != NULL &&
+       sscanf(buf, "some avg10=%lf", stall) == 1;
+  fclose(fp);
+  return ok ? 0 : -1;
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * pressure_stats - print what monitor [pr] read last & its budget
+ *                  to [fp]
+ */
+void pressure_stats(pressure *pr, FILE *fp)
+{
+  fprintf(fp, "- MEMORY PRESSURE -\n");
+  fprintf(fp, "memory: %lu of %lu bytes | stalled: %.2f%% (avg10)\n",
+          (unsigned long)pr->used, (unsigned long)pr->limit, pr->stall);
+  fprintf(fp, "budget: %lu bytes (%lu - %lu) | shrinks: %lu | grows: %lu\n",
+          (unsigned long)pr->budget, (unsigned long)pr->min_budget,
+          (unsigned long)pr->max_budget, pr->shrinks, pr->grows);
+  fprintf(fp, "-------------------\n");
+}
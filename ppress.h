@@ -0,0 +1,59 @@
+/*
+ * ppress.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for ppress.c (memory pressure monitor)
+ */
+#ifndef __PPRESS_H__
+#define __PPRESS_H__
+
+#include <stdio.h>
+#include <limits.h>
+
+/* Where to look */
+#define PRESS_CGROUP     "/sys/fs/cgroup"          // cgroup v2 mount
+#define PRESS_CGROUP_HYB "/sys/fs/cgroup/unified"  // ...on a hybrid host
+#define PRESS_PSI_HOST   "/proc/pressure/memory"   // without a cgroup
+
+/* Policy (percentages, checks & fractions of the budget given) */
+#define PRESS_EVERY  5     // seconds between checks
+#define PRESS_HIGH   10.0  // % of time stalled on memory (avg10) to shrink
+#define PRESS_LOW    1.0   // ...& under which the cache may grow again
+#define PRESS_FULL   95    // % of memory.high (or .max) used to shrink
+#define PRESS_ROOM   85    // ...& under which the cache may grow again
+#define PRESS_HOLD   2     // checks after a shrink before the next one
+#define PRESS_CALM   6     // calm checks in a row before growing
+#define PRESS_SHRINK 8     // a shrink takes 1/8 of the budget in effect
+#define PRESS_GROW   16    // a growth adds 1/16 of the budget given
+#define PRESS_MIN    8     // never below 1/8 of the budget given
+
+/* Structure of a pressure monitor consists of the files it reads (an
+ * empty path if there's no such file), the budgets it moves between &
+ * the one in effect, what it read last, and the state that keeps the
+ * budget from flapping: checks to sit out after a shrink and calm 
+ * checks in a row so far.
+ */
+struct pressure {
+  char current[PATH_MAX];  // memory.current
+  char high[PATH_MAX];     // memory.high
+  char max[PATH_MAX];      // memory.max
+  char psi[PATH_MAX];      // memory.pressure (or the host's)
+  size_t max_budget, min_budget, budget;
+  double stall;            // "some" avg10: % of time stalled on memory
+  size_t used, limit;      // memory.current & memory.high (0: no limit)
+  int hold;
+  int calm;
+  unsigned long shrinks, grows;
+};
+typedef struct pressure pressure;
+
+/* Function prototypes for pressure monitor operations */
+int pressure_init(pressure *pr, size_t budget);
+size_t pressure_check(pressure *pr);
+void pressure_stats(pressure *pr, FILE *fp);
+
+#endif
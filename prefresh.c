@@ -0,0 +1,183 @@
+/*
+ * prefresh.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the background refresher of the proxy: objects that should be
+ * fetched again (say, a stale one that was just served as is) are
+ * queued, and a few threads of its own fetch them while clients carry
+ * on. The queue is bounded and an object is only queued once; a job
+ * waits while its origin (host:port) already has REFRESH_PER_ORIGIN
+ * running, so one slow origin can't take every thread, nor be hit by
+ * all of them at once.
+ */
+
+#include "csapp.h"
+#include "prefresh.h"
+
+static void *refresh_thread(void *vargp);
+static struct refresh_job *next_job(refresher *rf);
+static int same_origin(struct refresh_job *a, struct refresh_job *b);
+
+
+/*******************
+ * REFRESH FUNCTIONS
+ *******************/
+
+/*
+ * refresh_init - set up refresher [rf] & start its REFRESH_THREADS
+ *                threads, which call [fetch] for every job
+ */
+void refresh_init(refresher *rf,
+                  void (*fetch)(char *host, char *port, char *path,
+                                char *req))
+{
+  pthread_t tid;
+  int i;
+
+  rf->fetch = fetch;
+  rf->head = rf->tail = rf->running = NULL;
+  rf->waiting = 0;
+  rf->queued = rf->refused = rf->done = 0;
+  pthread_mutex_init(&rf->lock, NULL);
+  pthread_cond_init(&rf->ready, NULL);
+  for (i = 0; i < REFRESH_THREADS; i++)
+    Pthread_create(&tid, NULL, refresh_thread, rf);
+}
+
+/*
+ * refresh_push - have refresher [rf] fetch [host]:[port]/[path] again
+ *                with request [req]; returns 1 if it will be (it's 
+ *                queued now, or it was already), 0 if the queue is full
+ */
+int refresh_push(refresher *rf, char *host, char *port, char *path,
+                 char *req)
+{
+  struct refresh_job *job;
+  size_t hl = strlen(host) + 1, pl = strlen(port) + 1;
+  size_t tl = strlen(path) + 1;
+  int lists;
+
+  pthread_mutex_lock(&rf->lock);
+  /* One refresh of an object (variant) at a time is enough */
+  for (lists = 0; lists < 2; lists++)
+    for (job = lists ? rf->running : rf->head; job; job = job->next)
+      if (!strcmp(job->path, path) && !strcmp(job->host, host) &&
+          !strcmp(job->port, port) && !strcmp(job->req, req)) {
+        pthread_mutex_unlock(&rf->lock);
+        return 1;
+      }
+  if (rf->waiting >= REFRESH_QUEUE) {
+    rf->refused++;
+    pthread_mutex_unlock(&rf->lock);
+    return 0;
+  }
+  /* The job & its strings in one block */
+  job = Malloc(sizeof(struct refresh_job) + hl + pl + tl + strlen(req) + 1);
+  job->host = (char *)(job + 1);
+  job->port = job->host + hl;
+  job->path = job->port + pl;
+  job->req = job->path + tl;
+  strcpy(job->host, host);
+  strcpy(job->port, port);
+  strcpy(job->path, path);
+  strcpy(job->req, req);
+  job->next = NULL;
+  if (rf->tail) rf->tail->next = job;
+  else          rf->head = job;
+  rf->tail = job;
+  rf->waiting++;
+  rf->queued++;
+  pthread_cond_broadcast(&rf->ready);
+  pthread_mutex_unlock(&rf->lock);
+  return 1;
+}
+
+/*
+ * refresh_thread - run the jobs of refresher [vargp], one at a time
+ */
+static void *refresh_thread(void *vargp)
+{
+  refresher *rf = (refresher *)vargp;
+  struct refresh_job *job, **pp;
+
+  Pthread_detach(pthread_self());
+  pthread_mutex_lock(&rf->lock);
+  while (1) {
+    while ((job = next_job(rf)) == NULL)
+      pthread_cond_wait(&rf->ready, &rf->lock);
+    job->next = rf->running;
+    rf->running = job;
+    pthread_mutex_unlock(&rf->lock);
+
+    rf->fetch(job->host, job->port, job->path, job->req);
+
+    pthread_mutex_lock(&rf->lock);
+    for (pp = &rf->running; *pp != job; pp = &(*pp)->next)
+      ;
+    *pp = job->next;
+    Free(job);
+    rf->done++;
+    // Its origin may have room for a waiting job now
+    pthread_cond_broadcast(&rf->ready);
+  }
+  return NULL;
+}
+
+/*
+ * next_job - take the oldest waiting job of refresher [rf] whose origin
+ *            has fewer than REFRESH_PER_ORIGIN jobs running; returns
+ *            it, or NULL if there's none
+ *
+ * Note: hold the refresher's lock
+ */
+static struct refresh_job *next_job(refresher *rf)
+{
+  struct refresh_job *job, *run, *prev = NULL;
+  int busy;
+
+  for (job = rf->head; job != NULL; prev = job, job = job->next) {
+    busy = 0;
+    for (run = rf->running; run != NULL; run = run->next)
+      busy += same_origin(job, run);
+    if (busy < REFRESH_PER_ORIGIN)
+      break;
+  }
+  if (job == NULL) return NULL;
+  /* Unlink it from the queue */
+  if (prev) prev->next = job->next;
+  else      rf->head = job->next;
+  if (rf->tail == job) rf->tail = prev;
+  rf->waiting--;
+  return job;
+}
+
+/*
+ * same_origin - whether jobs [a] & [b] fetch from the same host:port
+ */
+static int same_origin(struct refresh_job *a, struct refresh_job *b)
+{
+  return !strcmp(a->host, b->host) && !strcmp(a->port, b->port);
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * refresh_stats - print the jobs of refresher [rf] to [fp]
+ */
+void refresh_stats(refresher *rf, FILE *fp)
+{
+  pthread_mutex_lock(&rf->lock);
+  fprintf(fp, "- BACKGROUND REFRESH -\n");
+  fprintf(fp, "refreshes: %lu queued, %lu done, %lu turned down | "
+              "%d waiting\n", rf->queued, rf->done, rf->refused,
+          rf->waiting);
+  fprintf(fp, "----------------------\n");
+  pthread_mutex_unlock(&rf->lock);
+}
@@ -0,0 +1,56 @@
+/*
+ * prefresh.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for prefresh.c (background refreshes)
+ */
+#ifndef __PREFRESH_H__
+#define __PREFRESH_H__
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* Limits */
+#define REFRESH_THREADS    4   // refreshes running at once
+#define REFRESH_QUEUE      64  // refreshes waiting (more are turned down)
+#define REFRESH_PER_ORIGIN 2   // refreshes running at once per host:port
+
+/* Structure of a refresh job consists of the object to fetch again &
+ * the request that fetches it (the variant), whose strings follow the
+ * job in the same block, and the next job.
+ */
+struct refresh_job {
+  char *host, *port, *path;
+  char *req;
+  struct refresh_job *next;
+};
+
+/* Structure of a refresher consists of the function that refetches an
+ * object, the jobs waiting (oldest first) & running, and the lock &
+ * condition the threads running them wait on, plus counts of the jobs
+ * queued, turned down (the queue was full) & done.
+ */
+struct refresher {
+  void (*fetch)(char *host, char *port, char *path, char *req);
+  struct refresh_job *head, *tail;  // waiting
+  struct refresh_job *running;
+  int waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;    // signaled when a job may be startable
+  unsigned long queued, refused, done;
+};
+typedef struct refresher refresher;
+
+/* Function prototypes for refresher operations */
+void refresh_init(refresher *rf,
+                  void (*fetch)(char *host, char *port, char *path,
+                                char *req));
+int refresh_push(refresher *rf, char *host, char *port, char *path,
+                 char *req);
+void refresh_stats(refresher *rf, FILE *fp);
+
+#endif
@@ -11,19 +11,52 @@
  * 
  * This is a concurrent web proxy with a 1 MiB web object cache.
  * The cache can handle objects up to 10 KiB in size, and is implemented 
- * with a LRU eviction policy. It runs concurrently by creating a new thread 
- * for each new client that makes a request to a server, and features 
+ * with a GDSF eviction policy that weighs hit count, object size and
+ * origin fetch latency (-b optimizes byte hit ratio instead). It runs
+ * concurrently by creating a new thread for each new client that 
+ * makes a request to a server, and features 
  * read-write locks for concurrent cache reading & writing, favoring writers.  
  * This was my favorite lab and I'm beyond proud of what I've written.
  */
 
 #include <stdio.h>
+#include <sys/prctl.h>
+#include <sys/uio.h>
 #include "csapp.h"
 #include "pcache.h"
+#include "parena.h"
+#include "pdisk.h"
+#include "psnap.h"
+#include "pupgrade.h"
+#include "pnuma.h"
+#include "phuge.h"
+#include "ppress.h"
+#include "phttp.h"
+#include "prefresh.h"
+#include "pfetch.h"
 
-/* String constant macros */
-#define MAXPORT    8 // max port length (no larger than 6 digits)
-#define BIGBUF 16384 // max buf length (16 Kb)
+/* Thread stack size: request buffers live in arenas, not on the stack */
+#define THREAD_STACK 131072 // 128 Kb
+/* Request threads wait this long for another connection (keeping their
+   L1 of hot lines, swept of evicted ones every so often), this many at
+   most */
+#define THREAD_IDLE_WAIT  30 // seconds
+#define THREAD_IDLE_SWEEP 1  // seconds
+#define THREAD_IDLE_MAX   32
+/* Bytes written per step when serving from disk or a snapshot */
+#define SERVE_CHUNK  65536  // 64 Kb
+/* Bytes of a request line read per step (see read_line) */
+#define LINE_CHUNK   256
+/* An origin that doesn't take the connection by then is down */
+#define ORIGIN_TIMEOUT 3    // seconds
+/* Slices of a cached object written per writev (see serve_ranges) */
+#define RANGE_IOV    64
+/* Negative responses (see neg_add) are kept apart, in a cache this big
+   (two log segments), this many bytes each at most & this many bytes
+   each on average */
+#define NEG_CACHE_SIZE 1048576 // 1 Mb
+#define NEG_MAX_OBJECT 16384   // 16 Kb
+#define NEG_AVG_SIZE   512
 
 /* Global var's */
 static const char *user_agent_hdr = 
@@ -36,36 +69,192 @@ static const char *pconn_hdr = "Proxy-Connection: close\r\n";
 static const char *end_hdr = "\r\n";
 static const char *web_port = "80";
 
+/* Structure of the command line options */
+struct proxy_opts {
+  cconfig cfg;     // cache limits, store & stale windows (-m, -o, -n, -l,
+                   // -W, -E)
+  int objective;   // GDSF objective (-b)
+  char *port;      // port to listen on
+  char *disk_path; // disk tier file (-d; NULL: no disk tier)
+  size_t disk_size;   // disk tier size (-D)
+  char *snap_path; // snapshot file (-s; NULL: no snapshots)
+  int snap_every;  // seconds between snapshots (-S; 0: at shutdown only)
+  char *upgrade_path; // hot upgrade control socket (-u; NULL: none)
+  int workers;     // worker processes sharing the cache (-w; 0: none)
+  int numa;        // place threads & cache memory by NUMA node (-N)
+  int autosize;    // size the cache by memory pressure (-a)
+  long ttl;        // freshness of responses that don't say (-t)
+  long neg_ttl;    // longest a negative response is cached (-e; 0: never)
+};
+
+/* Structure of a client request consists of its method, where it goes
+ * (host, port & path), the client's headers and the request the proxy
+ * sends to the origin for it (a GET, which picks the variant of an
+ * object that varies; see pass_req for other methods), all in the
+ * request's arena.
+ */
+struct client_req {
+  char *meth;
+  char *host, *port, *path;
+  char *hdrs;              // client headers, blank line included
+  size_t hlen;
+  char *fwd;               // request to the origin
+  size_t flen;
+};
+
+/* Structure of a cache fill in progress consists of the line being
+ * filled (NULL until the first chunk's worth has arrived), the bytes 
+ * not in the cache yet, how many bytes the next chunk takes, whether
+ * the object is still being cached, and the request it answers (NULL
+ * if it's not known: see http_variant).
+ */
+struct cache_fill {
+  line *lion;
+  abuf stage;
+  size_t room;
+  int ok;
+  char *req;
+  size_t rlen;
+  time_t expires;         // expiry kept by a slower tier (0: see its head)
+};
+
+/* Structure of a vectored write consists of the socket it goes to and
+ * the slices waiting to go out (see iov_add).
+ */
+struct iov_out {
+  int fd;
+  struct iovec iov[RANGE_IOV];
+  int n;
+};
+
+/* Structure of an idle request thread consists of the connection 
+ * handed to it (-1 until then), the condition it waits on, and the
+ * next idle thread.
+ */
+struct idle_thread {
+  int conn;
+  pthread_cond_t wake;
+  struct idle_thread *next;
+};
+
 /* Request handling functions */
 void *thread(void *fd);
+int idle_wait(void);
+int idle_handoff(int conn);
+void *signal_thread(void *vargp);
+void *snap_thread(void *vargp);
+void *pressure_thread(void *vargp);
+void pressure_apply(void);
+void *upgrade_thread(void *vargp);
+void upgrade_drain(void);
+void wake_main(int sig);
+void run_workers(struct proxy_opts *opts);
+pid_t start_worker(int node);
+void numa_setup(void);
+void stop_workers(pid_t *pids, int n);
 void connect_req(int connected_fd);
-int parse_req(int connection, rio_t *rio, 
-              char *host, char *port, char *path);
+int parse_req(int connection, rio_t *rio, arena *ar, char **methp,
+              char **hostp, char **portp, char **pathp);
+char *read_hdrs(rio_t *rio, arena *ar, size_t *lenp);
+ssize_t read_line(rio_t *rio, abuf *buf, size_t max);
+void build_req(struct client_req *rq, arena *ar);
 int is_dir(char *path);
-int not_error(char *obj);
-void forward_req(int server, int client, rio_t *requio,
-                 char *host, char *path);
+void fetch_origin(int client, struct client_req *rq, arena *ar, 
+                  line *stale);
+int open_origin(char *host, char *port);
+void revalidate(char *host, char *port, char *path, char *fwd);
+int stale_ok(line *lion, const char *why);
+void pass_req(int client, rio_t *rio, struct client_req *rq, arena *ar);
+void invalidate(char *host, char *path);
+void origin_down(int client, struct client_req *rq, arena *ar);
+void neg_add(char *host, char *path, char *resp, size_t len, 
+             unsigned long cost, time_t expires, unsigned long vary);
+line *neg_find(struct client_req *rq);
+void neg_stats(FILE *fp);
+int forward_req(int server, int client, struct client_req *rq, arena *ar,
+                line *stale);
+sfetch *split_fetch(struct client_req *rq, char *resp, size_t len);
+void forward_segs(int client, int client_ok, sfetch *sf, 
+                  struct cache_fill *fill, char *host, char *path, 
+                  unsigned long start);
 int ignore_hdr(char *hdr);
+void add_hdr(abuf *buf, const char *name, char *val, size_t vlen);
+unsigned long now_usec(void);
+void reset_conn(int fd);
+int serve_line(int client, line *lion, arena *ar, char *hdrs, size_t hlen);
+int serve_304(int client, line *lion, arena *ar);
+int serve_line_head(int client, line *lion, arena *ar, char *hdrs,
+                    size_t hlen);
+int serve_head(struct iov_out *out, line *lion, arena *ar);
+int serve_ranges(int client, line *lion, arena *ar, size_t head,
+                 struct http_range *r, int n);
+int range_slices(struct iov_out *out, line *lion, size_t off, size_t len);
+int iov_add(struct iov_out *out, void *base, size_t len);
+int iov_flush(struct iov_out *out);
+void fill_bytes(struct cache_fill *fill, char *host, char *path,
+                char *buf, size_t n, unsigned long start);
+void fill_stop(struct cache_fill *fill);
+void fill_init(struct cache_fill *fill, arena *ar, char *host, char *path,
+               char *req, size_t rlen);
+void fill_done(struct cache_fill *fill, char *host, char *path,
+               unsigned long start);
+int serve_disk(int client, dhit *hit, struct client_req *rq, arena *ar);
+void serve_snap(int client, struct client_req *rq, arena *ar, char *obj,
+                size_t len, unsigned long cost, time_t expires);
 
 /* Error handling functions */
 void check_argc(int argc, int check, char **argv);
+void parse_args(int argc, char **argv, struct proxy_opts *opts);
+size_t parse_size(char *str);
 
 void bad_request(int fd, char *cause);
+void length_required(int fd);
 
 void flush_str(char *str);
 void flush_strs(char *str1, char *str2, char *str3);
 
-/* Function prototypes for wrapper functions */
-int Pthread_rwlock_init(pthread_rwlock_t *rwlock, 
-                       const pthread_rwlockattr_t *attr);
-int Pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
-int Pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
-int Pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+/* Function prototypes for wrapper functions (see also pcache.h) */
 int Pthread_rwlock_destroy(pthread_rwlock_t *rwlock);
 
-/* Global web cache */
+/* Global web cache (in shared memory with -w) */
 cache *C;   
-pthread_rwlock_t lock;
+pthread_rwlock_t *lock;
+/* Disk tier behind it (NULL if there's none) */
+disk *D = NULL;
+/* Snapshot it was warmed from (NULL if there's none) */
+snap *S = NULL;
+/* Seconds a response that says nothing about its freshness is fresh */
+long default_ttl = HTTP_DEFAULT_TTL;
+/* Memory pressure monitor sizing it (NULL with a fixed budget) & the
+   budget it last set */
+pressure *M = NULL;
+size_t press_budget;
+/* Background refreshes of stale lines (per process) */
+refresher *R = NULL;
+/* Negative responses, in a small cache of their own (NULL with -e 0), 
+   & how long they're kept at most */
+cache *N = NULL;
+pthread_rwlock_t *nlock;
+long neg_ttl = HTTP_NEG_TTL;
+
+/* Listening socket (inherited from the old proxy on a hot upgrade) */
+int plisten;
+/* Hot upgrade state: clients still being served & whether a new proxy
+   took over (2 once main has stopped accepting) */
+int nclients = 0;
+volatile sig_atomic_t draining = 0;
+pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t clients_done = PTHREAD_COND_INITIALIZER;
+pthread_t main_tid;
+/* Request threads waiting for a connection */
+struct idle_thread *idle = NULL;
+int nidle = 0;
+pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+/* NUMA nodes threads are spread over (0: no placement), the node of
+   this worker (-1: each thread takes the next one) */
+int numa_nodes = 0;
+int worker_node = -1;
+unsigned int next_node = 0;
 
 /*
  * main - main proxy routine: listens for client requests
@@ -75,33 +264,150 @@ pthread_rwlock_t lock;
 int main(int argc, char **argv)
 {
   /* Main routine variables */
-  int plisten, *connection;      // File descriptors
+  int *connection, connfd;       // File descriptor
   struct sockaddr_storage caddr; // Client info
   socklen_t clen;
   pthread_t tid;                 // Thread 
+  pthread_attr_t attr;
+  struct proxy_opts opts;
+  cconfig ncfg;                  // negative cache
+  sigset_t mask;
+  struct sigaction sa;
+  char handed[MAXLINE];          // snapshot from the old proxy
 
   /* Some setup.. */
-  check_argc(argc, 2, argv);
-  C = Malloc(sizeof(struct web_cache));
-  cache_init(C, &lock);
+  parse_args(argc, argv, &opts);
+  default_ttl = opts.ttl;
+  C = cache_map(sizeof(struct web_cache), opts.cfg.shared);
+  lock = cache_map(sizeof(pthread_rwlock_t), opts.cfg.shared);
+  cache_init(C, lock, &opts.cfg);
+  C->objective = opts.objective;
+  /* 404s & unreachable origins don't take room from real content */
+  neg_ttl = opts.neg_ttl;
+  if (neg_ttl > 0) {
+    N = cache_map(sizeof(struct web_cache), opts.cfg.shared);
+    nlock = cache_map(sizeof(pthread_rwlock_t), opts.cfg.shared);
+    ncfg = opts.cfg;
+    ncfg.capacity = NEG_CACHE_SIZE;
+    ncfg.max_object = NEG_MAX_OBJECT;
+    ncfg.max_lines = NEG_CACHE_SIZE / NEG_AVG_SIZE;
+    ncfg.store = STORE_LOG; // short lives: FIFO will do
+    ncfg.hugetlb = 0;       // 1 Mb isn't worth pages that stay committed
+    cache_init(N, nlock, &ncfg);
+  }
+  /* Split the cache's memory over the NUMA nodes before it's touched */
+  if (opts.numa && (numa_nodes = numa_init()) > 1 && 
+      opts.cfg.store == STORE_SLAB)
+    numa_setup();
   Signal(SIGPIPE, SIG_IGN);
+  /* SIGUSR1 dumps cache stats & SIGINT/SIGTERM shut down (after a
+     snapshot); only signal_thread (or the parent of the workers, 
+     which forks them before any thread is running) may receive them */
+  Sigemptyset(&mask);
+  Sigaddset(&mask, SIGUSR1);
+  Sigaddset(&mask, SIGINT);
+  Sigaddset(&mask, SIGTERM);
+  Sigprocmask(SIG_BLOCK, &mask, NULL);
+  if (opts.workers == 0)
+    Pthread_create(&tid, NULL, signal_thread, &opts);
+  /* Evicted lines spill to the disk tier (its thread
+     inherits the signal mask) */
+  if (opts.disk_path != NULL) {
+    D = Malloc(sizeof(struct disk_tier));
+    disk_init(D, opts.disk_path, opts.disk_size);
+    C->spill = disk_spill;
+    C->spill_arg = D;
+  }
+  /* Take over from a running proxy: its socket & its snapshot */
+  plisten = -1;
+  handed[0] = '\0';
+  if (opts.upgrade_path != NULL &&
+      (plisten = upgrade_request(opts.upgrade_path, handed, MAXLINE)) >= 0)
+    fprintf(stderr, "upgrade: took over listening socket\n");
+  /* Serve from the last snapshot until the cache warms up */
+  if (handed[0] != '\0' || opts.snap_path != NULL) {
+    S = Malloc(sizeof(struct snapshot));
+    if (snap_open(S, handed[0] ? handed : opts.snap_path,
+                  opts.cfg.shared) == 0)
+      fprintf(stderr, "warm start: %lu objects in %s\n", S->count, 
+              handed[0] ? handed : opts.snap_path);
+    else {
+      Free(S);
+      S = NULL;
+    }
+  }
+  if (opts.snap_path != NULL && opts.snap_every > 0 && opts.workers == 0)
+    Pthread_create(&tid, NULL, snap_thread, &opts);
+  /* Shrink & grow the cache with memory pressure */
+  if (opts.autosize) {
+    M = Malloc(sizeof(struct pressure));
+    // Hugetlb pages can't be given back a slab page at a time
+    if ((opts.cfg.store == STORE_LOG ? C->log.huge : C->mem.huge) 
+        == HUGE_TLB) {
+      fprintf(stderr, "pressure: the cache is in hugetlb pages, "
+                      "keeping a fixed budget\n");
+      Free(M);
+      M = NULL;
+    }
+    else if (pressure_init(M, opts.cfg.capacity) < 0) {
+      fprintf(stderr, "pressure: no cgroup v2 or PSI to watch, "
+                      "keeping a fixed budget\n");
+      Free(M);
+      M = NULL;
+    }
+    else if (opts.workers == 0)
+      Pthread_create(&tid, NULL, pressure_thread, NULL);
+    press_budget = opts.cfg.capacity;
+  }
+
+  /* Request threads get small stacks */
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, THREAD_STACK);
 
   /* Listen on port specified by user */
-  plisten = Open_listenfd(argv[1]);
-  clen = sizeof(caddr);
+  if (plisten < 0)
+    plisten = Open_listenfd(opts.port);
+  /* Prefork: the parent stays in run_workers, the workers go on */
+  if (opts.workers > 0)
+    run_workers(&opts);
+  /* Stale lines are refreshed in the background (by each worker) */
+  R = Malloc(sizeof(struct refresher));
+  refresh_init(R, revalidate);
+  /* Hand over to the next proxy when it asks (SIGUSR2 stops accept) */
+  if (opts.upgrade_path != NULL) {
+    main_tid = pthread_self();
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = wake_main; // no SA_RESTART
+    sigaction(SIGUSR2, &sa, NULL);
+    Pthread_create(&tid, NULL, upgrade_thread, &opts);
+  }
 
-  /* Infinite proxy loop */
-  while (1) {
+  /* Proxy loop (until a new proxy takes over) */
+  while (!draining) {
   /* Wait for client to send request */
+    clen = sizeof(caddr);
+    if ((connfd = accept(plisten, (SA *)&caddr, &clen)) < 0) {
+      if (errno == EINTR) continue;
+      unix_error("Accept error");
+    }
+    pthread_mutex_lock(&clients_lock);
+    nclients++;
+    pthread_mutex_unlock(&clients_lock);
+  /* Hand the request to an idle thread, or create a new one */
+    if (idle_handoff(connfd))
+      continue;
     connection = Malloc(sizeof(int));
-    *connection = Accept(plisten, (SA *)&caddr, &clen);
-  /* Create new thread to process the request */
-    Pthread_create(&tid, NULL, thread, connection);           
+    *connection = connfd;
+    Pthread_create(&tid, &attr, thread, connection);           
   }
+  /* The new proxy accepts on plisten now */
+  upgrade_drain();
+  return 0;
 }
 
 /*
- * thread - connect to the client on [fd] & forward request
+ * thread - connect to the client on [fd] & forward request, then 
+ *          wait for the next connection while there's one coming
  */
 void *thread(void *fd) 
 {
@@ -110,10 +416,455 @@ void *thread(void *fd)
   Free(fd); 
   /* Detach thread to avoid memory leaks */
   Pthread_detach(pthread_self()); 
-  /* Attempt to connect to server */
-  connect_req(connection);    
-  /* Close thread's connection to client */
-  Close(connection);  
+  /* Run on one node & allocate from its memory */
+  if (numa_nodes > 1) {
+    int node = worker_node >= 0 ? worker_node :
+               (int)(__sync_fetch_and_add(&next_node, 1) % numa_nodes);
+    numa_pin(node);
+    slab_set_node(node);
+  }
+  do {
+    /* Lines evicted from the L1 since the last request go back */
+    l1_sweep(C);
+    /* Attempt to connect to server */
+    connect_req(connection);    
+    /* Close thread's connection to client */
+    Close(connection);  
+    /* One less client to drain */
+    pthread_mutex_lock(&clients_lock);
+    if (--nclients == 0)
+      pthread_cond_broadcast(&clients_done);
+    pthread_mutex_unlock(&clients_lock);
+  } while ((connection = idle_wait()) >= 0);
+  l1_clear(C);
+  arena_release();
+  return NULL;
+}
+
+/*
+ * idle_wait - wait (up to THREAD_IDLE_WAIT seconds) for main to hand
+ *             the calling thread a connection; returns the connection,
+ *             or -1 if none came (or enough threads are waiting)
+ *
+ * Note: the thread's L1 lets go of its evicted lines before it waits
+ *       & every THREAD_IDLE_SWEEP seconds while it does, so an idle
+ *       thread doesn't keep them allocated
+ */
+int idle_wait(void)
+{
+  struct idle_thread me, **prev;
+  struct timespec deadline;
+  int waited;
+
+  l1_sweep(C);
+  pthread_mutex_lock(&idle_lock);
+  if (nidle >= THREAD_IDLE_MAX || draining) {
+    pthread_mutex_unlock(&idle_lock);
+    return -1;
+  }
+  me.conn = -1;
+  pthread_cond_init(&me.wake, NULL);
+  me.next = idle;
+  idle = &me;
+  nidle++;
+  for (waited = 0; me.conn < 0 && waited < THREAD_IDLE_WAIT;
+       waited += THREAD_IDLE_SWEEP) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += THREAD_IDLE_SWEEP;
+    while (me.conn < 0 &&
+           pthread_cond_timedwait(&me.wake, &idle_lock, &deadline) == 0)
+      ;
+    // Still on the list: a connection handed meanwhile isn't missed
+    if (me.conn < 0) {
+      pthread_mutex_unlock(&idle_lock);
+      l1_sweep(C);
+      pthread_mutex_lock(&idle_lock);
+    }
+  }
+  /* Timed out: take ourselves off the list */
+  if (me.conn < 0) {
+    for (prev = &idle; *prev != &me; prev = &(*prev)->next)
+      ;
+    *prev = me.next;
+    nidle--;
+  }
+  pthread_mutex_unlock(&idle_lock);
+  pthread_cond_destroy(&me.wake);
+  return me.conn;
+}
+
+/*
+ * idle_handoff - hand connection [conn] to an idle thread;
+ *                returns 1 if one took it, 0 if none is waiting
+ */
+int idle_handoff(int conn)
+{
+  struct idle_thread *it;
+
+  pthread_mutex_lock(&idle_lock);
+  if ((it = idle) != NULL) {
+    idle = it->next;
+    nidle--;
+    it->conn = conn;
+    pthread_cond_signal(&it->wake);
+  }
+  pthread_mutex_unlock(&idle_lock);
+  return it != NULL;
+}
+
+
+/*
+ * signal_thread - print cache statistics to stderr every time the
+ *                 proxy receives SIGUSR1; on SIGINT or SIGTERM, write
+ *                 a snapshot (if [vargp]'s options ask for one) & exit
+ */
+void *signal_thread(void *vargp)
+{
+  struct proxy_opts *opts = (struct proxy_opts *)vargp;
+  sigset_t mask;
+  int sig;
+
+  Pthread_detach(pthread_self());
+  Sigemptyset(&mask);
+  Sigaddset(&mask, SIGUSR1);
+  Sigaddset(&mask, SIGINT);
+  Sigaddset(&mask, SIGTERM);
+  while (1) {
+    if (sigwait(&mask, &sig) != 0)
+      continue;
+    /* Shutting down */
+    if (sig != SIGUSR1) {
+      if (opts->snap_path != NULL)
+        fprintf(stderr, "shutdown: %ld objects saved to %s\n", 
+                snap_write(C, S, opts->snap_path), opts->snap_path);
+      exit(0);
+    }
+    /* READING */
+    Pthread_rwlock_rdlock(lock);
+    cache_stats(C, stderr);
+    Pthread_rwlock_unlock(lock);
+    if (D != NULL)
+      disk_stats(D, stderr);
+    if (S != NULL)
+      snap_stats(S, stderr);
+    if (M != NULL)
+      pressure_stats(M, stderr);
+    if (R != NULL)
+      refresh_stats(R, stderr);
+    if (N != NULL)
+      neg_stats(stderr);
+    fetch_stats(stderr);
+  }
+  return NULL;
+}
+
+/*
+ * snap_thread - write a snapshot of the cache every [snap_every]
+ *               seconds (options in [vargp])
+ */
+void *snap_thread(void *vargp)
+{
+  struct proxy_opts *opts = (struct proxy_opts *)vargp;
+
+  Pthread_detach(pthread_self());
+  while (1) {
+    sleep(opts->snap_every);
+    snap_write(C, S, opts->snap_path);
+  }
+  return NULL;
+}
+
+/*
+ * pressure_thread - check the memory pressure every PRESS_EVERY 
+ *                   seconds & resize the cache accordingly
+ */
+void *pressure_thread(void *vargp)
+{
+  Pthread_detach(pthread_self());
+  while (1) {
+    sleep(PRESS_EVERY);
+    pressure_apply();
+  }
+  return vargp;
+}
+
+/*
+ * pressure_apply - check the memory pressure & resize the cache if 
+ *                  the monitor moved its budget
+ */
+void pressure_apply(void)
+{
+  size_t budget = pressure_check(M), was = press_budget;
+
+  if (budget == was) return;
+  /* WRITING */
+  Pthread_rwlock_wrlock(lock);
+  cache_resize(C, budget);
+  Pthread_rwlock_unlock(lock);
+  press_budget = budget;
+  fprintf(stderr, "pressure: cache budget %lu -> %lu bytes "
+                  "(%.2f%% stalled, %lu of %lu bytes used)\n",
+          (unsigned long)was, (unsigned long)budget, M->stall,
+          (unsigned long)M->used, (unsigned long)M->limit);
+}
+
+
+/*
+ * upgrade_thread - wait for a new proxy on the control socket in the
+ *                  options [vargp], then snapshot the cache, hand it
+ *                  the listening socket & stop the main loop
+ */
+void *upgrade_thread(void *vargp)
+{
+  struct proxy_opts *opts = (struct proxy_opts *)vargp;
+  char *snap = opts->snap_path;
+  int ctl, conn;
+
+  Pthread_detach(pthread_self());
+  /* Without a snapshot file of our own, use one next to the socket */
+  if (snap == NULL) {
+    snap = Malloc(strlen(opts->upgrade_path) + 6);
+    sprintf(snap, "%s.snap", opts->upgrade_path);
+  }
+  ctl = upgrade_listen(opts->upgrade_path);
+  while (1) {
+    conn = upgrade_wait(ctl);
+    fprintf(stderr, "upgrade: handing over to a new proxy\n");
+    if (upgrade_send(conn, plisten, snap_write(C, S, snap) >= 0 ? snap : "") 
+        == 0)
+      break;
+    fprintf(stderr, "upgrade_send error: %s\n", strerror(errno));
+    Close(conn);
+  }
+  Close(conn);
+  Close(ctl);
+
+  /* Knock main out of accept until it notices */
+  draining = 1;
+  while (draining == 1) {
+    pthread_kill(main_tid, SIGUSR2);
+    usleep(100000);
+  }
+  return NULL;
+}
+
+/*
+ * upgrade_drain - stop listening & wait (up to UPGRADE_DRAIN seconds)
+ *                 for the clients still being served, then exit
+ */
+void upgrade_drain(void)
+{
+  struct timespec deadline;
+
+  draining = 2;
+  Close(plisten);
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += UPGRADE_DRAIN;
+  pthread_mutex_lock(&clients_lock);
+  while (nclients > 0 &&
+         pthread_cond_timedwait(&clients_done, &clients_lock, &deadline) == 0)
+    ;
+  fprintf(stderr, "upgrade: exiting with %d clients left\n", nclients);
+  pthread_mutex_unlock(&clients_lock);
+  exit(0);
+}
+
+/*
+ * wake_main - SIGUSR2 handler: does nothing, but interrupts accept
+ */
+void wake_main(int sig)
+{
+  (void)sig;
+}
+
+
+/******************
+ * PREFORK ROUTINES
+ ******************/
+
+/*
+ * run_workers - fork the worker processes asked for in [opts]; each
+ *               accepts on the listening socket & serves from the 
+ *               shared cache. The parent stays behind: it restarts 
+ *               workers that die, prints cache stats on SIGUSR1, 
+ *               writes the periodic snapshots, and on SIGINT/SIGTERM
+ *               stops the workers, writes a snapshot & exits. It also
+ *               resizes the cache with memory pressure (-a).
+ *               Returns only in a worker.
+ */
+void run_workers(struct proxy_opts *opts)
+{
+  pid_t *pids = Calloc(opts->workers, sizeof(pid_t)), pid;
+  time_t *born = Calloc(opts->workers, sizeof(time_t));
+  unsigned long restarts = 0;
+  struct timespec every;
+  time_t snap_due = time(NULL) + opts->snap_every;
+  int snaps = opts->snap_path != NULL && opts->snap_every > 0;
+  sigset_t mask;
+  int i, sig, status;
+
+  /* The parent waits for SIGCHLD too (the others are blocked already) */
+  Sigemptyset(&mask);
+  Sigaddset(&mask, SIGUSR1);
+  Sigaddset(&mask, SIGINT);
+  Sigaddset(&mask, SIGTERM);
+  Sigaddset(&mask, SIGCHLD);
+  Sigprocmask(SIG_BLOCK, &mask, NULL);
+  for (i = 0; i < opts->workers; i++) {
+    if ((pids[i] = start_worker(i)) == 0) return;
+    born[i] = time(NULL);
+  }
+  fprintf(stderr, "prefork: %d workers sharing the cache\n", opts->workers);
+
+  while (1) {
+    /* Snapshots are due every snap_every seconds, pressure checks 
+       every PRESS_EVERY */
+    every.tv_sec = M != NULL ? PRESS_EVERY : opts->snap_every;
+    every.tv_nsec = 0;
+    if (snaps || M != NULL)
+      sig = sigtimedwait(&mask, NULL, &every);
+    else
+      sig = sigwaitinfo(&mask, NULL);
+    if (sig < 0) {
+      if (errno != EAGAIN) continue;
+      if (M != NULL)
+        pressure_apply();
+      if (snaps && time(NULL) >= snap_due) {
+        snap_write(C, S, opts->snap_path);
+        snap_due = time(NULL) + opts->snap_every;
+      }
+      continue;
+    }
+
+    /* Stats */
+    if (sig == SIGUSR1) {
+      /* READING */
+      Pthread_rwlock_rdlock(lock);
+      cache_stats(C, stderr);
+      Pthread_rwlock_unlock(lock);
+      fprintf(stderr, "workers: %d | restarts: %lu\n", opts->workers, 
+              restarts);
+      if (N != NULL)
+        neg_stats(stderr);
+      if (M != NULL)
+        pressure_stats(M, stderr);
+    }
+    /* A worker died: clean up after it & start another */
+    else if (sig == SIGCHLD) {
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (i = 0; i < opts->workers && pids[i] != pid; i++)
+          ;
+        if (i == opts->workers) continue;
+        if (WIFSIGNALED(status))
+          fprintf(stderr, "prefork: worker %d killed by signal %d\n", 
+                  (int)pid, WTERMSIG(status));
+        else
+          fprintf(stderr, "prefork: worker %d exited with status %d\n",
+                  (int)pid, WEXITSTATUS(status));
+        restarts++;
+        /* It held a cache lock: nobody can use the caches anymore */
+        if (cache_recover(C, pid) < 0 ||
+            (N != NULL && cache_recover(N, pid) < 0)) {
+          fprintf(stderr, "prefork: cache lock lost with worker %d, "
+                          "starting over with an empty cache\n", (int)pid);
+          pids[i] = 0;
+          stop_workers(pids, opts->workers);
+          cache_reset(C);
+          if (N != NULL) cache_reset(N);
+          for (i = 0; i < opts->workers; i++) {
+            if ((pids[i] = start_worker(i)) == 0) return;
+            born[i] = time(NULL);
+          }
+          break;
+        }
+        // Don't spin on a worker that dies right away
+        if (time(NULL) - born[i] < 1)
+          sleep(1);
+        if ((pids[i] = start_worker(i)) == 0) return;
+        born[i] = time(NULL);
+      }
+    }
+    /* Shutting down: the snapshot needs the workers out of the cache */
+    else {
+      stop_workers(pids, opts->workers);
+      for (i = 0; i < opts->workers; i++)
+        if (pids[i] != 0 && cache_recover(C, pids[i]) < 0)
+          break;
+      if (opts->snap_path != NULL && i == opts->workers)
+        fprintf(stderr, "shutdown: %ld objects saved to %s\n", 
+                snap_write(C, S, opts->snap_path), opts->snap_path);
+      Free(pids);
+      Free(born);
+      exit(0);
+    }
+  }
+}
+
+/*
+ * start_worker - fork worker process [i]; returns its pid in the parent
+ *                and 0 in the worker, which dies with the parent, 
+ *                leaves stats to it & can be stopped by any signal.
+ *                With NUMA placement, workers go round the nodes. The
+ *                worker takes pin table [i] of the shared caches.
+ */
+pid_t start_worker(int i)
+{
+  sigset_t mask;
+  pid_t parent = getpid(), pid;
+
+  if ((pid = Fork()) != 0)
+    return pid;
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (getppid() != parent) // it's already gone
+    exit(0);
+  Signal(SIGUSR1, SIG_IGN);
+  Sigemptyset(&mask);
+  Sigprocmask(SIG_SETMASK, &mask, NULL);
+  if (numa_nodes > 1) {
+    worker_node = i % numa_nodes;
+    numa_pin(worker_node);
+  }
+  /* Its references are dropped for it if it dies (see cache_recover) */
+  cache_attach(C, i);
+  if (N != NULL) cache_attach(N, i);
+  return 0;
+}
+
+/*
+ * numa_setup - give each NUMA node a range of the cache's slab pages,
+ *              bound to its memory
+ */
+void numa_setup(void)
+{
+  size_t len;
+  char *base;
+  int i;
+
+  slab_nodes(&C->mem, numa_nodes);
+  numa_nodes = C->mem.nnodes;
+  for (i = 0; i < numa_nodes; i++) {
+    base = slab_range(&C->mem, i, &len);
+    if (numa_bind(base, len, i) < 0)
+      fprintf(stderr, "numa: can't bind node %d's pages (%s)\n", i, 
+              strerror(errno));
+  }
+  fprintf(stderr, "numa: cache split over %d nodes\n", numa_nodes);
+}
+
+/*
+ * stop_workers - kill the [n] worker processes in [pids] (0: none) & 
+ *                wait for them
+ */
+void stop_workers(pid_t *pids, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (pids[i] != 0)
+      kill(pids[i], SIGTERM);
+  for (i = 0; i < n; i++)
+    if (pids[i] != 0)
+      waitpid(pids[i], NULL, 0);
 }
 
 
@@ -125,63 +876,389 @@ void *thread(void *fd)
  * sconnect - check for errors in the client request, parse the request,
  *            open a connection with the server, and finally forward 
  *            the request to the server.
+ *            All of the request's memory comes from one arena that is
+ *            handed back when the request is done. A HEAD is answered
+ *            from the cache's copy without its body if there's a fresh
+ *            one; methods other than GET & HEAD go through to the 
+ *            origin as they are (see pass_req).
  */
 void connect_req(int connection)                
 { 
   /* Core var's of connect_req */                                     
-  int middleman;            // File descriptor
-  char host[MAXLINE] = {0}, // Server info
-       port[MAXPORT] = {0}, 
-       path[MAXLINE] = {0};       
+  struct client_req rq;     // Server info & headers (in the arena)
+  char *host, *port, *path;
   /* Rio to parse client request */
   rio_t rio;                                        
+  /* Per-connection memory */
+  arena *ar = arena_get();
+  dhit hit;
+  char *obj;
+  size_t len;
+  unsigned long cost, vary;
+  time_t expires;
+  line *stale = NULL;       // Stale copy in the cache
+  line *neg;                // What the origin said it hasn't got
+  int head;                 // HEAD: no body
 
-  /* Parse client request into host, port, and path */
-  if (parse_req(connection, &rio, host, port, path) < 0) {
+  /* Parse client request into method, host, port, and path */
+  if (parse_req(connection, &rio, ar, &rq.meth, &rq.host, &rq.port, 
+                &rq.path) < 0 ||
+      (rq.hdrs = read_hdrs(&rio, ar, &rq.hlen)) == NULL)
     fprintf(stderr, "Cannot read this request path..\n");
-    flush_strs(host, port, path);
+  /* Not a GET nor a HEAD: straight through, uncached */
+  else if (strcmp(rq.meth, "GET") && strcmp(rq.meth, "HEAD")) {
+    build_req(&rq, ar);
+    pass_req(connection, &rio, &rq, ar);
   }
   /* Parsing succeeded.. continue */
   else {
-    /* READING */
-    Pthread_rwlock_rdlock(&lock);
-    line *lion = in_cache(C, host, path);
-    Pthread_rwlock_unlock(&lock);
-    /* If in cache, don't connect to server */
+    host = rq.host;
+    port = rq.port;
+    path = rq.path;
+    head = !strcmp(rq.meth, "HEAD");
+    build_req(&rq, ar);
+    /* This thread's hot lines first (no lock), then the cache (in the
+       variant for what we'd ask the origin) */
+    line *lion = l1_find(C, host, path, rq.fwd, rq.flen);
+    int hot = lion != NULL;
+    if (!hot) {
+      /* READING */
+      Pthread_rwlock_rdlock(lock);
+      lion = in_cache(C, host, path, rq.fwd, rq.flen);
+      if (lion == NULL)
+        stale = stale_line(C, host, path, rq.fwd, rq.flen);
+      Pthread_rwlock_unlock(lock);
+    }
+    /* If in cache, don't connect to server (but a hot line about to
+       expire may be refreshed ahead of time, in the background) */
     if (lion != NULL) {
-      if (rio_writen(connection, lion->obj, lion->size) < 0)
+      if (line_ahead(C, lion))
+        refresh_push(R, host, port, path, rq.fwd);
+      if ((head ? serve_line_head : serve_line)(connection, lion, ar, 
+                                                rq.hdrs, rq.hlen) < 0)
         fprintf(stderr, "rio_writen error: bad connection");
-      flush_strs(host, port, path);
+      // The L1 takes our reference (or drops it)
+      if (!hot) l1_keep(C, lion);
     }
-    /* Otherwise, connect to server & forward request */
-    else {
-      if ((middleman = Open_clientfd(host, port)) < 0) {
-        bad_request(middleman, host);
-        flush_strs(host, port, path);
-      } 
-      else {
-        forward_req(middleman, connection, &rio, host, path);
-        /* Clean up & close connection to server */
-        flush_strs(host, port, path); 
-        Close(middleman);
-      }
+    /* Just gone stale: serve it as is & refresh it in the background */
+    else if (stale != NULL && stale_ok(stale, "stale-while-revalidate") &&
+             refresh_push(R, host, port, path, rq.fwd)) {
+      if ((head ? serve_line_head : serve_line)(connection, stale, ar,
+                                                rq.hdrs, rq.hlen) < 0)
+        fprintf(stderr, "rio_writen error: bad connection");
     }
+    /* The origin just said it hasn't got it (or couldn't be reached) */
+    else if (N != NULL && (neg = neg_find(&rq)) != NULL) {
+      if ((head ? serve_line_head : serve_line)(connection, neg, ar,
+                                                rq.hdrs, rq.hlen) < 0)
+        fprintf(stderr, "rio_writen error: bad connection");
+      line_put(N, neg);
+    }
+    /* A HEAD the cache can't answer goes to the origin as is (fetching
+       the body to cache it is more than was asked for) */
+    else if (head)
+      pass_req(connection, &rio, &rq, ar);
+    /* Next best: the snapshot we started from (if it's still fresh, 
+       by the expiry its line had, & the variant asked for) */
+    else if (S != NULL && 
+             snap_find(S, host, path, &obj, &len, &cost, &expires, &vary) &&
+             expires > time(NULL) &&
+             (vary == 0 || vary == http_variant(obj, len, rq.fwd, rq.flen)))
+      serve_snap(connection, &rq, ar, obj, len, cost, expires);
+    /* Then the disk tier (the same goes) */
+    else if (D != NULL && disk_find(D, host, path, &hit) &&
+             hit.expires > time(NULL) &&
+             serve_disk(connection, &hit, &rq, ar) == 0) {
+      // Served (and brought back into the cache) from disk
+    }
+    /* Otherwise, connect to server & forward request (asking if 
+       a stale copy we have is still good) */
+    else
+      fetch_origin(connection, &rq, ar, stale);
+    if (stale != NULL) line_put(C, stale);
   }
+  /* Clean-up */
+  arena_put(ar);
+}
+
+/*
+ * fetch_origin - get the object of request [rq] from its origin for
+ *                [client] (-1: for the cache only), with buffers from
+ *                arena [ar]; a [stale] copy is revalidated, or served
+ *                instead if the origin can't be reached (see stale_ok),
+ *                which otherwise gets the client a 502 (see origin_down)
+ */
+void fetch_origin(int client, struct client_req *rq, arena *ar, 
+                  line *stale)
+{
+  int middleman;
+
+  if ((middleman = open_origin(rq->host, rq->port)) >= 0) {
+    /* Close connection to server (unless a split fetch did) */
+    if (forward_req(middleman, client, rq, ar, stale) == 0)
+      Close(middleman);
+  }
+  /* Origin is down: a stale copy beats an error */
+  else if (client < 0)
+    return;
+  else if (stale != NULL && stale_ok(stale, "stale-if-error")) {
+    if (serve_line(client, stale, ar, rq->hdrs, rq->hlen) < 0)
+      fprintf(stderr, "rio_writen error: bad connection");
+  }
+  else
+    origin_down(client, rq, ar);
+}
+
+/*
+ * open_origin - open a connection to [host]:[port] like open_clientfd,
+ *               but give up on an address that doesn't answer within
+ *               ORIGIN_TIMEOUT seconds; returns the socket, or -1 if
+ *               no address could be reached
+ */
+int open_origin(char *host, char *port)
+{
+  struct addrinfo hints, *listp = NULL, *p;
+  struct timeval timeout = { ORIGIN_TIMEOUT, 0 }, none = { 0, 0 };
+  int fd = -1;
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  if (getaddrinfo(host, port, &hints, &listp) != 0) {
+    fprintf(stderr, "Getaddrinfo error");
+    return -1;
+  }
+  for (p = listp; p; p = p->ai_next) {
+    if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    // connect gives up after the send timeout
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) {
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &none, sizeof(none));
+      break;
+    }
+    Close(fd);
+    fd = -1;
+  }
+  Freeaddrinfo(listp);
+  if (fd < 0)
+    fprintf(stderr, "open_clientfd error");
+  return fd;
+}
+
+/*
+ * revalidate - fetch [host]:[port]/[path] again for the cache with 
+ *              request [fwd], in the background (see prefresh.c), 
+ *              whether its line has gone stale or is about to: 
+ *              conditionally, if it has validators; a line that's gone
+ *              (or never was: see forward_req) is fetched whole
+ */
+void revalidate(char *host, char *port, char *path, char *fwd)
+{
+  struct client_req rq = { "GET", host, port, path, "", 0, fwd, 
+                           strlen(fwd) };
+  arena *ar;
+  line *copy;
+
+  /* READING */
+  Pthread_rwlock_rdlock(lock);
+  copy = peek_line(C, host, path, rq.fwd, rq.flen);
+  Pthread_rwlock_unlock(lock);
+  ar = arena_get();
+  fetch_origin(-1, &rq, ar, copy);
+  if (copy != NULL) line_put(C, copy);
+  arena_put(ar);
+}
+
+/*
+ * stale_ok - whether stale line [lion] may still be served for reason
+ *            [why] ("stale-while-revalidate" or "stale-if-error")
+ */
+int stale_ok(line *lion, const char *why)
+{
+  return time(NULL) < http_stale(lion->obj, lion->olen, lion->expires, why,
+                                 C->cfg.swr, C->cfg.sie);
+}
+
+/*
+ * pass_req - pass client request [rq] through to its origin under its
+ *            own method, with its body (Content-Length bytes of it, 
+ *            read from [rio]; a chunked one gets the client a 411 and
+ *            isn't sent) & its credentials, and the response back
+ *            to [client], a buffer at a time from arena [ar]: nothing
+ *            is cached. One that may change the object (anything but a
+ *            HEAD) and doesn't fail drops the cached copies of it (see 
+ *            invalidate); an origin that can't be reached gets the 
+ *            client a 502 (see origin_down)
+ */
+void pass_req(int client, rio_t *rio, struct client_req *rq, arena *ar)
+{
+  const char *keep[] = { "Content-Type", "Content-Length", 
+                         "Content-Encoding", "Authorization", "Cookie" };
+  char *buf = arena_alloc(ar, MAXLINE), *val;
+  size_t vlen, left = 0;
+  int server, status = 0, i;
+  rio_t respio;
+  ssize_t n;
+  abuf req;
+
+  /* A body of unknown length can't be passed on by Content-Length (nor
+     may it change the object when it isn't) */
+  if (http_header(rq->hdrs, rq->hlen, "Transfer-Encoding", &vlen)) {
+    length_required(client);
+    return;
+  }
+  /* The request built for the client (a GET, blank line aside), under
+     its own method & with what describes its body & who sends it */
+  abuf_init(&req, ar, rq->flen + 256);
+  abuf_puts(&req, rq->meth);
+  abuf_append(&req, rq->fwd + 3, rq->flen - 3 - strlen(end_hdr));
+  for (i = 0; i < (int)(sizeof(keep) / sizeof(keep[0])); i++)
+    if ((val = http_header(rq->hdrs, rq->hlen, keep[i], &vlen)))
+      add_hdr(&req, keep[i], val, vlen);
+  if ((val = http_header(rq->hdrs, rq->hlen, "Content-Length", &vlen)))
+    left = strtoul(val, NULL, 10);
+  abuf_puts(&req, end_hdr);
+  if ((server = open_origin(rq->host, rq->port)) < 0) {
+    origin_down(client, rq, ar);
+    return;
+  }
+  if (rio_writen(server, req.data, req.len) < 0) {
+    Close(server);
+    return;
+  }
+  /* The body, as it comes */
+  while (left > 0 &&
+         (n = rio_readnb(rio, buf, left < MAXLINE ? left : MAXLINE)) > 0 &&
+         rio_writen(server, buf, n) >= 0)
+    left -= n;
+  /* The response, as it comes (the cache is done with the object once
+     it's known to have changed) */
+  Rio_readinitb(&respio, server);
+  while (left == 0 && (n = rio_readnb(&respio, buf, MAXLINE)) > 0) {
+    if (status == 0 && (status = http_status(buf, n)) >= 200 && 
+        status < 400 && strcmp(rq->meth, "HEAD"))
+      invalidate(rq->host, rq->path);
+    if (rio_writen(client, buf, n) < 0)
+      break;
+  }
+  Close(server);
+}
+
+/*
+ * invalidate - drop every copy of [host]/[path] the proxy has: its 
+ *              lines in the cache (& the negative cache), its disk 
+ *              records & its snapshot record
+ */
+void invalidate(char *host, char *path)
+{
+  /* WRITING */
+  Pthread_rwlock_wrlock(lock);
+  remove_loc(C, host, path);
+  Pthread_rwlock_unlock(lock);
+  if (N != NULL) {
+    /* WRITING */
+    Pthread_rwlock_wrlock(nlock);
+    remove_loc(N, host, path);
+    Pthread_rwlock_unlock(nlock);
+  }
+  if (D != NULL) disk_forget(D, host, path);
+  if (S != NULL) snap_forget(S, host, path);
+}
+
+/*
+ * origin_down - tell [client] that the origin of request [rq] can't be
+ *               reached: a 502, built in arena [ar], that's kept in 
+ *               the negative cache for HTTP_ERROR_TTL seconds (or -e,
+ *               if that's less), so the origin isn't tried again by
+ *               every request meanwhile
+ */
+void origin_down(int client, struct client_req *rq, arena *ar)
+{
+  char *body = arena_alloc(ar, MAXLINE), *hdr = arena_alloc(ar, 128);
+  long ttl = neg_ttl < HTTP_ERROR_TTL ? neg_ttl : HTTP_ERROR_TTL;
+  abuf resp;
+  int n;
+
+  n = snprintf(body, MAXLINE, "<html><title>Error 502: bad gateway"
+               "</title>\r\n<body><h1>Error 502: bad gateway</h1>\r\n"
+               "<h3>Caused by <em>%.256s</em></h3></body></html>\r\n",
+               rq->host);
+  abuf_init(&resp, ar, n + 256);
+  abuf_puts(&resp, "HTTP/1.0 502 Bad Gateway\r\n");
+  abuf_puts(&resp, "Content-Type: text/html\r\n");
+  snprintf(hdr, 128, "Content-Length: %d\r\nCache-Control: max-age=%ld\r\n",
+           n, ttl);
+  abuf_puts(&resp, hdr);
+  abuf_puts(&resp, end_hdr);
+  abuf_puts(&resp, body);
+  if (N != NULL)
+    neg_add(rq->host, rq->path, resp.data, resp.len, 0, time(NULL) + ttl,
+            0);
+  if (rio_writen(client, resp.data, resp.len) < 0)
+    fprintf(stderr, "rio_writen error: bad connection");
+}
+
+/*
+ * neg_add - keep negative response [resp] ([len] bytes, fetched in 
+ *           [cost] usec) for [host]/[path] (variant [vary]) in the
+ *           negative cache until [expires]; a new one replaces the 
+ *           last, and only other negative responses are evicted for it
+ */
+void neg_add(char *host, char *path, char *resp, size_t len, 
+             unsigned long cost, time_t expires, unsigned long vary)
+{
+  /* WRITING */
+  Pthread_rwlock_wrlock(nlock);
+  add_line(N, make_line(N, host, path, resp, len, cost, expires, vary));
+  Pthread_rwlock_unlock(nlock);
+}
+
+/*
+ * neg_find - find a fresh negative response to client request [rq]; 
+ *            returns its line (with a reference: drop it with line_put
+ *            on N), or NULL if there's none
+ */
+line *neg_find(struct client_req *rq)
+{
+  line *lion;
+
+  /* READING */
+  Pthread_rwlock_rdlock(nlock);
+  lion = in_cache(N, rq->host, rq->path, rq->fwd, rq->flen);
+  Pthread_rwlock_unlock(nlock);
+  return lion;
+}
+
+/*
+ * neg_stats - print the negative cache to [fp]
+ */
+void neg_stats(FILE *fp)
+{
+  /* READING */
+  Pthread_rwlock_rdlock(nlock);
+  fprintf(fp, "- NEGATIVE CACHE -\n");
+  fprintf(fp, "lines: %zu | object bytes: %zu / %zu | kept for %lds "
+              "at most\n", N->nlines, N->size, N->cfg.capacity, neg_ttl);
+  fprintf(fp, "------------------\n");
+  Pthread_rwlock_unlock(nlock);
 }
 
 /*
- * parse_req - parse client request into method, uri, and version,
- *             then parse the uri into host, port (if specified), and path;
+ * parse_req - parse client request into method ([methp]), uri, and 
+ *             version, then parse the uri into [host], [port] (if 
+ *             specified), and [path], all allocated from arena [ar];
  *             returns -1 on error, 0 otherwise.
  */
-int parse_req(int connection, rio_t *rio, 
-              char *host, char *port, char *path)  
+int parse_req(int connection, rio_t *rio, arena *ar, char **methp,
+              char **hostp, char **portp, char **pathp)  
 {  
   /* Parse request into method, uri, and version */
-  char meth[MAXLINE] = {0},
-       uri[MAXLINE]  = {0},          
-       vers[MAXLINE] = {0};   
-  char rbuf[MAXLINE] = {0};
+  char *meth, *uri, *vers;
+  char *rbuf;
+  char *host, *port, *path;
+  size_t len;
+  abuf rline;
   /* Strings to keep track of uri parsing */
   char *spec, *check;           // port specified ?
   char *buf, *p, *save; // used for explicit uri parse
@@ -192,22 +1269,34 @@ int parse_req(int connection, rio_t *rio,
   /* SETUP FOR PARSING -- */
   /* Initialize rio */
   Rio_readinitb(rio, connection); 
-  if (Rio_readlineb(rio, rbuf, MAXLINE) <= 0) {
-    bad_request(connection, rbuf);
-    flush_str(rbuf);
+  abuf_init(&rline, ar, 256);
+  if (read_line(rio, &rline, MAXLINE - 1) <= 0) {
+    bad_request(connection, rline.data);
     return -1;
   } 
-  /* Splice the request */
+  rbuf = rline.data;
+  /* Splice the request (no piece is longer than the line) */
+  len = strlen(rbuf) + 1;
+  meth = arena_alloc(ar, len);
+  uri  = arena_alloc(ar, len);
+  vers = arena_alloc(ar, len);
+  meth[0] = uri[0] = vers[0] = '\0';
   sscanf(rbuf, "%s %s %s", meth, uri, vers);
-  flush_str(rbuf);  
-  /* Error: HTTP request that isn't GET or 'http://' not found */
-  if (strcmp(meth, "GET") || !(strstr(uri, "http://"))) {                   
+  /* Error: method we don't handle or 'http://' not found */
+  if ((strcmp(meth, "GET") && strcmp(meth, "HEAD") && 
+       strcmp(meth, "POST") && strcmp(meth, "PUT") && 
+       strcmp(meth, "DELETE") && strcmp(meth, "PATCH")) || 
+      !(strstr(uri, "http://"))) {                   
     bad_request(connection, uri);
-    flush_strs(meth, uri, vers);
     return -1;
   } 
   /* PARSE URI */
   else {
+    *methp = meth;
+    host = *hostp = arena_alloc(ar, len);
+    port = *portp = arena_alloc(ar, len);
+    path = *pathp = arena_alloc(ar, len + 1); // room for a trailing '/'
+    path[0] = '\0';
     buf = uri + 7; // ignore 'http://' 
     spec = index(buf, ':'); 
     check = rindex(buf, ':');
@@ -215,13 +1304,11 @@ int parse_req(int connection, rio_t *rio,
   /* Port is specified.. */
     if (spec) {  
     // Get host name
-      p = strtok_r(buf, colon, &save);
-      // Copy if successful
+      if ((p = strtok_r(buf, colon, &save)) == NULL) return -1;
       strcpy(host, p); 
     // Get port from buf
       buf = strtok_r(NULL, colon, &save);
-      p = strtok_r(buf, bslash, &save);
-      // Copy if successful
+      if ((p = strtok_r(buf, bslash, &save)) == NULL) return -1;
       strcpy(port, p);
     // Get path (rest of buf)
       while ((p = strtok_r(NULL, bslash, &save)) != NULL) 
@@ -232,7 +1319,7 @@ int parse_req(int connection, rio_t *rio,
   /* Port not specified.. */
     else { 
     // Get host name
-      p = strtok_r(buf, bslash, &save);  
+      if ((p = strtok_r(buf, bslash, &save)) == NULL) return -1;
       strcpy(host, p);
     // Get path
       while ((p = strtok_r(NULL, bslash, &save)) != NULL) 
@@ -242,14 +1329,110 @@ int parse_req(int connection, rio_t *rio,
     // Set port as unspecified
       strcpy(port, web_port);
     }
-  /* Clean-up */
-    flush_strs(meth, uri, vers);
-    flush_strs(spec, buf, p);
-    flush_str(save);
     return 0;
   }
 }
 
+/*
+ * read_hdrs - read the client's request headers from [rio] into arena
+ *             [ar], up to & including the blank line that ends them;
+ *             returns them (their length goes in [lenp]), or NULL on
+ *             a read error
+ */
+char *read_hdrs(rio_t *rio, arena *ar, size_t *lenp)
+{
+  size_t start = 0;
+  abuf hdrs;
+  ssize_t n;
+
+  abuf_init(&hdrs, ar, 512);
+  while ((n = read_line(rio, &hdrs, MAXLINE - 1)) != 0) {
+    if (n < 0) return NULL;
+    if (!strcmp(hdrs.data + start, "\r\n")) 
+      break; // empty line found => end of headers
+    start = hdrs.len;
+  }
+  *lenp = hdrs.len;
+  return hdrs.data;
+}
+
+/*
+ * read_line - append a line from [rio] to buffer [buf], a chunk at a
+ *             time, up to [max] bytes of it (the rest of a longer line
+ *             is left for the next read);
+ *             returns the bytes appended (0 at EOF), or -1 on error
+ */
+ssize_t read_line(rio_t *rio, abuf *buf, size_t max)
+{
+  char part[LINE_CHUNK];
+  size_t got = 0, room;
+  ssize_t n;
+
+  while (got < max) {
+    room = max - got + 1 < sizeof(part) ? max - got + 1 : sizeof(part);
+    if ((n = rio_readlineb(rio, part, room)) < 0)
+      return -1;
+    if (n == 0) 
+      break;
+    abuf_append(buf, part, n);
+    got += n;
+    if (part[n - 1] == '\n')
+      break;
+  }
+  return got;
+}
+
+/*
+ * build_req - build the request the proxy sends to the origin for 
+ *             client request [rq] (its [fwd]), in arena [ar]: the 
+ *             client's headers go through ignore_hdr, then come the 
+ *             proxy's own (the client's Accept-Encoding is kept, so
+ *             each encoding gets its own variant)
+ */
+void build_req(struct client_req *rq, arena *ar)
+{
+  char *p, *eol, *val;
+  size_t n = 0, vlen, mark;
+  abuf req;
+
+  abuf_init(&req, ar, 1024);
+  abuf_puts(&req, "GET ");
+  abuf_puts(&req, rq->path);
+  abuf_puts(&req, " HTTP/1.0\r\n");
+  /* Build client headers */
+  for (p = rq->hdrs; p < rq->hdrs + rq->hlen; p += n)
+  { 
+    eol = memchr(p, '\n', rq->hdrs + rq->hlen - p);
+    n = eol ? (size_t)(eol - p) + 1 : (size_t)(rq->hdrs + rq->hlen - p);
+    // The line goes in as is (NUL-terminated), & back out if ignored
+    mark = req.len;
+    abuf_append(&req, p, n);
+    if (!strcmp(req.data + mark, "\r\n")) {
+      req.data[req.len = mark] = '\0';
+      break; // empty line found => end of headers
+    }
+    if (ignore_hdr(req.data + mark))
+      req.data[req.len = mark] = '\0';
+    else
+      abuf_puts(&req, "\r\n");
+  }      
+  /* Build proxy headers */
+  abuf_puts(&req, "Host: ");
+  abuf_puts(&req, rq->host);
+  abuf_puts(&req, "\r\n");
+  abuf_puts(&req, user_agent_hdr);
+  abuf_puts(&req, accept_hdr);
+  if ((val = http_header(rq->hdrs, rq->hlen, "Accept-Encoding", &vlen)))
+    add_hdr(&req, "Accept-Encoding", val, vlen);
+  else
+    abuf_puts(&req, accept_encoding_hdr);
+  abuf_puts(&req, conn_hdr);
+  abuf_puts(&req, pconn_hdr);
+  abuf_puts(&req, end_hdr); 
+  rq->fwd = req.data;
+  rq->flen = req.len;
+}
+
 /*
  * is_dir - determine if path is a directory or contains a file name;
  *          returns 1 if directory, 0 if not 
@@ -279,82 +1462,697 @@ int is_dir(char *path)
 }  
 
 /*
- * forward_request - Forward the client's request to the server;
- *                   use file descriptor server & read client headers
- *                   from &requio
+ * forward_request - Forward the client's request [rq] to the server;
+ *                   use file descriptor server; buffers come from arena
+ *                   [ar] and only grow as far as the request & response
+ *                   need. With a [stale] copy of the object, the 
+ *                   request is made conditional on its validators, and
+ *                   a 304 refreshes & serves that copy instead (as does
+ *                   a failing origin, see stale_ok). A [client] of -1
+ *                   only fills the cache;
+ *                   returns 1 if it closed [server] itself (the rest of
+ *                   a big object came in segments: see split_fetch), 0
+ *                   otherwise
  */
-void forward_req(int server, int client, rio_t *requio, 
-                 char *host, char *path) 
+int forward_req(int server, int client, struct client_req *rq, arena *ar,
+                line *stale)
 {
   /* Client-side reading */
-  char buf[BIGBUF] = {0}; 
-  char cbuf[MAXLINE] = {0};    
-  ssize_t n = 0;               
+  char *cbuf = arena_alloc(ar, MAXLINE); // also reused for the response
+  char *host = rq->host, *path = rq->path;
+  abuf req;
+  char *val;
+  size_t vlen;
   /* Server-side reading */
-  char svbuf[MAXLINE] = {0}; 
   rio_t respio;              
   ssize_t m = 0;             
   /* Implementing web object cache */
-  char object[MAX_OBJECT_SIZE] = {0};  
-  size_t obj_size = 0;
+  struct cache_fill fill;
+  size_t total = 0;
+  int client_ok = client >= 0;
+  /* Big objects: the rest of the body in segments (see pfetch.c) */
+  sfetch *sf = NULL;
+  size_t limit = (size_t)-1; // bytes read from this connection
+  unsigned long start = now_usec(); // fetch cost for GDSF
+  time_t expires;
 
   /* BUILD & FORWARD REQUEST TO SERVER -- */
-  sprintf(buf, "GET %s HTTP/1.0\r\n", path);
-  /* Build client headers */
-  while((n = rio_readlineb(requio, cbuf, MAXLINE)) != 0) 
-  { 
-    if (n < 0) {
-      flush_str(cbuf); return;
-    }
-    if (!strcmp(cbuf, "\r\n")) 
-      break; // empty line found => end of headers
-    if (!ignore_hdr(cbuf))
-      sprintf(buf, "%s%s\r\n", buf, cbuf);
-    flush_str(cbuf); // flush line after copied
-  }      
-  /* Build proxy headers */
-  sprintf(buf, "%sHost: %s\r\n", buf, host);
-  sprintf(buf, "%s%s", buf, user_agent_hdr);
-  sprintf(buf, "%s%s", buf, accept_hdr);
-  sprintf(buf, "%s%s", buf, accept_encoding_hdr);
-  sprintf(buf, "%s%s", buf, conn_hdr);
-  sprintf(buf, "%s%s", buf, pconn_hdr);
-  sprintf(buf, "%s%s", buf, end_hdr); 
-  /* Forward request to server */
-  if (rio_writen(server, buf, strlen(buf)) < 0) {
-    flush_str(buf); return;
+  /* The request built for the client (blank line aside) */
+  abuf_init(&req, ar, rq->flen + 256);
+  abuf_append(&req, rq->fwd, rq->flen - strlen(end_hdr));
+  /* Ask if our stale copy is still good */
+  if (stale != NULL) {
+    if (stale->desc.etag.len)
+      add_hdr(&req, "If-None-Match", stale->obj + stale->desc.etag.off,
+              stale->desc.etag.len);
+    if (stale->desc.lastmod.len)
+      add_hdr(&req, "If-Modified-Since", 
+              stale->obj + stale->desc.lastmod.off, stale->desc.lastmod.len);
+  }
+  /* No copy at all: a range goes to the origin as is (see below) */
+  else if (client_ok &&
+           (val = http_header(rq->hdrs, rq->hlen, "Range", &vlen))) {
+    add_hdr(&req, "Range", val, vlen);
+    if ((val = http_header(rq->hdrs, rq->hlen, "If-Range", &vlen)))
+      add_hdr(&req, "If-Range", val, vlen);
   }
+  abuf_puts(&req, end_hdr); 
+  /* Forward request to server */
+  if (rio_writen(server, req.data, req.len) < 0) return 0;
 
   /* BUILD & FORWARD SERVER RESPONSE TO CLIENT -- */ 
   /* Initialize rio to read server's response */          
   Rio_readinitb(&respio, server);
+  m = Rio_readnb(&respio, cbuf, MAXLINE);
+  /* Not modified: refresh our copy & serve it */
+  if (stale != NULL && m > 0 && http_status(cbuf, m) == 304) {
+    expires = http_refresh(stale->obj, stale->olen, cbuf, m, time(NULL),
+                           default_ttl);
+    /* WRITING */
+    Pthread_rwlock_wrlock(lock);
+    if (expires != 0) line_refresh(C, stale, expires);
+    else              remove_line(C, stale); // served once more, though
+    Pthread_rwlock_unlock(lock);
+    if (client_ok && serve_line(client, stale, ar, rq->hdrs, rq->hlen) < 0)
+      fprintf(stderr, "rio_writen error: bad connection");
+    return 0;
+  }
+  /* Origin is failing: a stale copy beats an error */
+  if (stale != NULL && (m < 0 || http_status(cbuf, m) >= 500) &&
+      stale_ok(stale, "stale-if-error")) {
+    if (client_ok && serve_line(client, stale, ar, rq->hdrs, rq->hlen) < 0)
+      fprintf(stderr, "rio_writen error: bad connection");
+    return 0;
+  }
+  /* Just a range (it isn't cached): the whole object is fetched for the
+     cache in the background, so the next range is served from there */
+  if (m > 0 && http_status(cbuf, m) == 206)
+    refresh_push(R, host, rq->port, path, rq->fwd);
+  fill_init(&fill, ar, host, path, rq->fwd, rq->flen);
+  /* Only the first segment of a big object comes from here */
+  if (m > 0 && (sf = split_fetch(rq, cbuf, m)) != NULL)
+    limit = http_head_len(cbuf, m) + sf->seg[0].last + 1;
   /* Read from fd [server] & write to fd [client] */
-  while ((m = Rio_readlineb(&respio, svbuf, MAXLINE)) != 0)
+  while (m != 0)
   { 
   // Rio error check
     if (m < 0) {
-      flush_str(svbuf); return; 
+      fill_stop(&fill);
+      if (sf) fetch_put(sf);
+      return 0; 
     }
-  // For cache
-    obj_size += m; 
-    sprintf(object, "%s%s", object, svbuf); 
-  // Write to client
-    if (rio_writen(client, svbuf, m) < 0) {
-      flush_str(svbuf); return;
+  // For cache (give up once it's too big)
+    total += m;
+    if (fill.ok && total > C->cfg.max_object)
+      fill_stop(&fill);
+    if (fill.ok)
+      fill_bytes(&fill, host, path, cbuf, m, start);
+  // Write to client (keep filling the cache if it hung up)
+    if (client_ok && rio_writen(client, cbuf, m) < 0)
+      client_ok = 0;
+    if (!client_ok && !fill.ok) {
+      if (sf) fetch_put(sf);
+      return 0;
     }
-    flush_str(svbuf);
+    if (total == limit) break;
+    m = Rio_readnb(&respio, cbuf, 
+                   limit - total < MAXLINE ? limit - total : MAXLINE);
   }
+  /* Then the other segments, in order (cut short like the origin was
+     if its first one was); the origin's stream is done with, so it
+     doesn't send them twice */
+  if (sf != NULL) {
+    if (total < limit) {
+      fill_stop(&fill);
+      fetch_put(sf);
+      return 0;
+    }
+    Close(server);
+    forward_segs(client, client_ok, sf, &fill, host, path, start);
+    fetch_put(sf);
+    return 1;
+  }
+  fill_done(&fill, host, path, start);
+  return 0;
+}
+
+/*
+ * split_fetch - start fetching the body of response [resp] ([len] bytes
+ *               of it so far) to request [rq] in segments over parallel
+ *               connections (see pfetch.c), if it's a cacheable object
+ *               of known size its origin sends in ranges, and big 
+ *               enough; returns the fetch, or NULL if it's all read 
+ *               from the first connection
+ */
+sfetch *split_fetch(struct client_req *rq, char *resp, size_t len)
+{
+  size_t head = http_head_len(resp, len), body, vlen, iflen;
+  char *val, *ifr;
+
+  if (head == 0 || http_status(resp, len) != 200 ||
+      http_expiry(resp, len, time(NULL), default_ttl) == 0)
+    return NULL;
+  /* Ranges of a body we know the size of (& can cache) */
+  if ((val = http_header(resp, len, "Accept-Ranges", &vlen)) == NULL ||
+      vlen < 5 || strncasecmp(val, "bytes", 5) ||
+      (val = http_header(resp, len, "Content-Length", &vlen)) == NULL ||
+      (body = strtoul(val, NULL, 10)) == 0 || 
+      head + body > C->cfg.max_object)
+    return NULL;
+  /* Of this very object: a strong validator holds the segments together */
+  if (((ifr = http_header(resp, len, "ETag", &iflen)) == NULL ||
+       ifr[0] != '"') &&
+      (ifr = http_header(resp, len, "Last-Modified", &iflen)) == NULL)
+    return NULL;
+  return fetch_split(open_origin, rq->host, rq->port, rq->fwd,
+                     rq->flen - strlen(end_hdr), ifr, iflen, body);
+}
+
+/*
+ * forward_segs - take the segments of split fetch [sf] after the first
+ *                in order, writing each to [client] (if [client_ok]) &
+ *                cache fill [fill] for [host]/[path] as soon as it's 
+ *                done; if one can't be had (the object changed, say),
+ *                the fill is dropped & the client's connection is reset
+ *                (what it got isn't the whole object)
+ */
+void forward_segs(int client, int client_ok, sfetch *sf, 
+                  struct cache_fill *fill, char *host, char *path, 
+                  unsigned long start)
+{
+  char *buf;
+  size_t n;
+  int i;
+
+  for (i = 1; i < sf->nsegs; i++) {
+    if ((buf = fetch_wait(sf, i)) == NULL) {
+      fill_stop(fill);
+      if (client_ok) reset_conn(client);
+      return;
+    }
+    n = sf->seg[i].last - sf->seg[i].first + 1;
+    if (fill->ok)
+      fill_bytes(fill, host, path, buf, n, start);
+    if (client_ok && rio_writen(client, buf, n) < 0)
+      client_ok = 0;
+    if (!client_ok && !fill->ok) return;
+  }
+  fill_done(fill, host, path, start);
+}
+
+/*
+ * serve_disk - write the object of disk hit [hit] for request [rq] to
+ *              [client], bringing it back into the cache on the way
+ *              (fresh until the hit's expiry);
+ *              returns -1 if none of it could be read (go to the origin
+ *              instead), 0 otherwise
+ *
+ * Note: if the record can't be read to the end, the connection is reset
+ *       (so the client can't take what it got for the whole object)
+ */
+int serve_disk(int client, dhit *hit, struct client_req *rq, arena *ar)
+{
+  char *buf = arena_alloc(ar, SERVE_CHUNK);
+  struct cache_fill fill;
+  size_t pos = 0;
+  ssize_t n;
+  int client_ok = 1;
+  unsigned long start = now_usec() - hit->cost; // keep the origin's cost
+
+  fill_init(&fill, ar, rq->host, rq->path, rq->fwd, rq->flen);
+  fill.expires = hit->expires;
+  while ((n = disk_read(D, hit, pos, buf, SERVE_CHUNK)) > 0) {
+    // Another variant than the one asked for: the origin has that one
+    if (pos == 0 && hit->vary != 0 &&
+        http_variant(buf, n, rq->fwd, rq->flen) != hit->vary) {
+      fill_stop(&fill);
+      return -1;
+    }
+    pos += n;
+    if (fill.ok)
+      fill_bytes(&fill, rq->host, rq->path, buf, n, start);
+    if (client_ok && rio_writen(client, buf, n) < 0)
+      client_ok = 0;
+    if (!client_ok && !fill.ok) return 0;
+  }
+  /* Record was overwritten under us (or the read failed) */
+  if (n < 0) {
+    fill_stop(&fill);
+    if (pos == 0) return -1;
+    fprintf(stderr, "serve_disk error: %s%s cut short after %lu bytes\n",
+            rq->host, rq->path, (unsigned long)pos);
+    reset_conn(client);
+  }
+  else
+    fill_done(&fill, rq->host, rq->path, start);
+  return 0;
+}
+
+/*
+ * serve_snap - write object [obj] of [len] bytes (in the snapshot) for
+ *              request [rq] to [client], bringing it back into the
+ *              cache with its fetch cost [cost] & its expiry [expires]
+ *              on the way
+ */
+void serve_snap(int client, struct client_req *rq, arena *ar, char *obj,
+                size_t len, unsigned long cost, time_t expires)
+{
+  struct cache_fill fill;
+  size_t pos, n;
+  int client_ok = 1;
+  unsigned long start = now_usec() - cost; // keep the origin's cost
+
+  fill_init(&fill, ar, rq->host, rq->path, rq->fwd, rq->flen);
+  fill.expires = expires;
+  for (pos = 0; pos < len; pos += n) {
+    n = len - pos < SERVE_CHUNK ? len - pos : SERVE_CHUNK;
+    if (fill.ok)
+      fill_bytes(&fill, rq->host, rq->path, obj + pos, n, start);
+    if (client_ok && rio_writen(client, obj + pos, n) < 0)
+      client_ok = 0;
+    if (!client_ok && !fill.ok) return;
+  }
+  fill_done(&fill, rq->host, rq->path, start);
+}
+
+/*
+ * fill_init - start cache fill [fill] for [host]/[path] answering 
+ *             request head [req] ([rlen] bytes), staging in arena [ar]
+ */
+void fill_init(struct cache_fill *fill, arena *ar, char *host, char *path,
+               char *req, size_t rlen)
+{
+  fill->lion = NULL;
+  fill->room = line_room(host, path);
+  fill->ok = 1;
+  fill->req = req;
+  fill->rlen = rlen;
+  fill->expires = 0;
+  abuf_init(&fill->stage, ar, 0);
+}
+
+/*
+ * fill_done - finish cache fill [fill] for [host]/[path] once the whole
+ *             object is in: a small one is cached now (if it may be;
+ *             a negative response goes to the negative cache), a big
+ *             one gets its tail & is marked complete
+ */
+void fill_done(struct cache_fill *fill, char *host, char *path,
+               unsigned long start)
+{
+  time_t expires;
+
   /* Object is not cached.
-     If it's small enough & not a sever error, cache it */
-  if (obj_size <= MAX_OBJECT_SIZE && not_error(object)) {
+     If it's small enough & cacheable (fresh for a while), cache it */
+  if (fill->ok && fill->lion == NULL && 
+      (expires = fill->expires ? fill->expires :
+                 http_expiry(fill->stage.data, fill->stage.len, 
+                             time(NULL), default_ttl)) != 0) {
     /* WRITING */
-    Pthread_rwlock_wrlock(&lock);
-    add_line(C, make_line(host, path, object, obj_size));
-    Pthread_rwlock_unlock(&lock);
+    Pthread_rwlock_wrlock(lock);
+    add_line(C, make_line(C, host, path, fill->stage.data, fill->stage.len,
+                          now_usec() - start, expires,
+                          http_variant(fill->stage.data, fill->stage.len,
+                                       fill->req, fill->rlen)));
+    Pthread_rwlock_unlock(lock);
   }
-  /* Clean-up */
-  flush_strs(buf, cbuf, svbuf);
-  flush_strs(host, path, object);
+  /* Origin hasn't got it: that's kept apart, & not for long */
+  else if (fill->ok && fill->lion == NULL && N != NULL &&
+           (expires = http_neg_expiry(fill->stage.data, fill->stage.len,
+                                      time(NULL), neg_ttl)) != 0)
+    neg_add(host, path, fill->stage.data, fill->stage.len, 
+            now_usec() - start, expires,
+            http_variant(fill->stage.data, fill->stage.len, fill->req,
+                         fill->rlen));
+  /* Big object: store its tail & mark it complete */
+  else if (fill->ok && fill->lion != NULL) {
+    /* WRITING */
+    Pthread_rwlock_wrlock(lock);
+    if (fill->stage.len > 0 &&
+        line_append(C, fill->lion, fill->stage.data, fill->stage.len) < 0)
+      remove_line(C, fill->lion);
+    else
+      line_finish(C, fill->lion, now_usec() - start);
+    Pthread_rwlock_unlock(lock);
+    line_put(C, fill->lion);
+  }
+}
+
+/*
+ * fill_bytes - add [n] bytes of [buf] to cache fill [fill]; each time a
+ *              chunk's worth is staged it's published: the first one
+ *              makes a filling line for [host]/[path] (if its head says
+ *              it may be cached), later ones become segments of that 
+ *              line
+ */
+void fill_bytes(struct cache_fill *fill, char *host, char *path,
+                char *buf, size_t n, unsigned long start)
+{
+  size_t take;
+  time_t expires;
+
+  while (n > 0 && fill->ok) {
+    /* Stage as much as the next chunk takes */
+    take = fill->room - fill->stage.len;
+    if (take > n) take = n;
+    abuf_append(&fill->stage, buf, take);
+    buf += take;
+    n -= take;
+    if (fill->stage.len < fill->room)
+      break;
+    /* Chunk is full: publish it */
+    /* WRITING */
+    Pthread_rwlock_wrlock(lock);
+    if (fill->lion == NULL) {
+      if ((expires = fill->expires ? fill->expires :
+                     http_expiry(fill->stage.data, fill->stage.len,
+                                 time(NULL), default_ttl)) != 0 &&
+          (fill->lion = make_line(C, host, path, fill->stage.data,
+                                  fill->stage.len, now_usec() - start,
+                                  expires, 
+                                  http_variant(fill->stage.data, 
+                                               fill->stage.len,
+                                               fill->req, fill->rlen)))) {
+        fill->lion->state = LINE_FILLING;
+        fill->lion->filler = getpid();
+        fill->lion->refcnt++; // the filler's reference
+        line_pin(C, fill->lion);
+        add_line(C, fill->lion);
+      }
+      else fill->ok = 0;
+    }
+    else if (line_append(C, fill->lion, fill->stage.data, 
+                         fill->stage.len) < 0) {
+      remove_line(C, fill->lion);
+      fill->ok = 0;
+    }
+    Pthread_rwlock_unlock(lock);
+    /* Start the next segment */
+    fill->stage.len = 0;
+    fill->stage.data[0] = '\0';
+    fill->room = SEG_DATA;
+  }
+  /* Gave up on a published line: let go of it */
+  if (!fill->ok && fill->lion != NULL) {
+    line_put(C, fill->lion);
+    fill->lion = NULL;
+  }
+}
+
+/*
+ * fill_stop - stop caching fill [fill]; a line already published is 
+ *             evicted (its readers see it end early)
+ */
+void fill_stop(struct cache_fill *fill)
+{
+  fill->ok = 0;
+  if (fill->lion != NULL) {
+    /* WRITING */
+    Pthread_rwlock_wrlock(lock);
+    remove_line(C, fill->lion);
+    Pthread_rwlock_unlock(lock);
+    line_put(C, fill->lion);
+    fill->lion = NULL;
+  }
+}
+
+/*
+ * serve_line - write the object of cached line [lion] to [client], its
+ *              Age brought up to date (see serve_head); if the line is
+ *              still filling, segments are written as soon as they 
+ *              arrive (a fill that's given up on ends the response 
+ *              early, like a dropped origin would); a client whose 
+ *              request headers [hdrs] ([hlen] bytes) are met by the 
+ *              object (see http_not_modified) just gets a 304, and one
+ *              asking for byte ranges of a complete line gets those 
+ *              (see serve_ranges); returns -1 on a write error
+ */
+int serve_line(int client, line *lion, arena *ar, char *hdrs, size_t hlen)
+{
+  struct segment *seg = NULL;
+  struct http_range r[HTTP_RANGE_MAX];
+  struct http_desc *d = &lion->desc;
+  struct iov_out out;
+  int n;
+
+  if (http_not_modified(lion->obj, d, hdrs, hlen))
+    return serve_304(client, lion, ar);
+  if (__atomic_load_n(&lion->state, __ATOMIC_ACQUIRE) == LINE_READY &&
+      (n = http_ranges(lion->obj, d, lion->size - d->head, hdrs, hlen, 
+                       r)) != 0)
+    return serve_ranges(client, lion, ar, d->head, r, n);
+  out.fd = client;
+  out.n = 0;
+  if (serve_head(&out, lion, ar) < 0 ||
+      iov_add(&out, lion->obj + d->head, lion->olen - d->head) < 0 ||
+      iov_flush(&out) < 0)
+    return -1;
+  while ((seg = line_next(C, lion, seg)) != NULL)
+    if (rio_writen(client, seg->data, seg->len) < 0)
+      return -1;
+  return 0;
+}
+
+/*
+ * serve_line_head - answer a HEAD from cached line [lion]: its head
+ *                   alone, Age brought up to date (see serve_head), or
+ *                   a 304 like serve_line; returns -1 on a write error
+ */
+int serve_line_head(int client, line *lion, arena *ar, char *hdrs,
+                    size_t hlen)
+{
+  struct iov_out out;
+
+  if (http_not_modified(lion->obj, &lion->desc, hdrs, hlen))
+    return serve_304(client, lion, ar);
+  out.fd = client;
+  out.n = 0;
+  if (serve_head(&out, lion, ar) < 0 || iov_flush(&out) < 0)
+    return -1;
+  return 0;
+}
+
+/*
+ * serve_304 - tell [client] that its copy of the object of cached line
+ *             [lion] is still good: a 304 with the line's validators &
+ *             freshness headers, built in arena [ar];
+ *             returns -1 on a write error
+ */
+int serve_304(int client, line *lion, arena *ar)
+{
+  struct http_desc *d = &lion->desc;
+  const char *name[] = { "ETag", "Last-Modified", "Cache-Control",
+                         "Expires", "Vary" };
+  struct http_field keep[] = { d->etag, d->lastmod, d->cc, d->expires,
+                               d->vary };
+  abuf resp;
+  int i;
+
+  abuf_init(&resp, ar, 256);
+  abuf_puts(&resp, "HTTP/1.0 304 Not Modified\r\n");
+  for (i = 0; i < 5; i++)
+    if (keep[i].len)
+      add_hdr(&resp, name[i], lion->obj + keep[i].off, keep[i].len);
+  abuf_puts(&resp, end_hdr);
+  return rio_writen(client, resp.data, resp.len) < 0 ? -1 : 0;
+}
+
+/*
+ * serve_head - add the head of cached line [lion] to vectored write
+ *              [out], with its Age header (built in arena [ar]) saying
+ *              how old the object is now, in place of the one it came
+ *              with; returns -1 on a write error
+ */
+int serve_head(struct iov_out *out, line *lion, arena *ar)
+{
+  struct http_desc *d = &lion->desc;
+  char *age = arena_alloc(ar, 32), *from, *to, *end;
+
+  /* Where the old one was (if it had one: just before the blank line) */
+  from = to = lion->obj + d->head - 2;
+  if (d->agehdr.len) {
+    for (from = lion->obj + d->agehdr.off; from[-1] != '\n'; from--)
+      ;
+    to = memchr(lion->obj + d->agehdr.off, '\n', d->head - d->agehdr.off);
+    to++;
+  }
+  end = lion->obj + d->head;
+  snprintf(age, 32, "Age: %ld\r\n", http_age(d, time(NULL)));
+  if (iov_add(out, lion->obj, from - lion->obj) < 0 ||
+      iov_add(out, age, strlen(age)) < 0)
+    return -1;
+  return iov_add(out, to, end - to);
+}
+
+/*
+ * serve_ranges - write the [n] byte ranges [r] of the body of complete
+ *                line [lion] (its head is [head] bytes) to [client]: 
+ *                a 206 with the line's headers, the range itself or a
+ *                multipart/byteranges body for several, built in arena
+ *                [ar] and written with writev straight from the cache;
+ *                [n] < 0 gets a 416; returns -1 on a write error
+ */
+int serve_ranges(int client, line *lion, arena *ar, size_t head,
+                 struct http_range *r, int n)
+{
+  size_t size = lion->size - head, len = 0, tlen = 0;
+  char *p, *eol, *end = lion->obj + head, *type;
+  char num[64], bound[40];
+  abuf resp, *parts = NULL, tail;
+  struct iov_out out;
+  int i;
+
+  abuf_init(&resp, ar, head + 256);
+  if (n < 0) {
+    abuf_puts(&resp, "HTTP/1.0 416 Range Not Satisfiable\r\n");
+    snprintf(num, sizeof(num), "bytes */%zu", size);
+    add_hdr(&resp, "Content-Range", num, strlen(num));
+    abuf_puts(&resp, "Content-Length: 0\r\n");
+    abuf_puts(&resp, end_hdr);
+    return rio_writen(client, resp.data, resp.len) < 0 ? -1 : 0;
+  }
+  abuf_puts(&resp, "HTTP/1.0 206 Partial Content\r\n");
+  /* The line's headers, but for those about the whole body (& its Age,
+     which is brought up to date) */
+  for (p = memchr(lion->obj, '\n', head) + 1; p < end - 2; p = eol + 1) {
+    eol = memchr(p, '\n', end - p);
+    if (!strncasecmp(p, "Content-Length:", 15) ||
+        !strncasecmp(p, "Content-Range:", 14) ||
+        !strncasecmp(p, "Age:", 4) ||
+        (n > 1 && !strncasecmp(p, "Content-Type:", 13)))
+      continue;
+    abuf_append(&resp, p, eol + 1 - p);
+  }
+  snprintf(num, sizeof(num), "%ld", http_age(&lion->desc, time(NULL)));
+  add_hdr(&resp, "Age", num, strlen(num));
+  /* One range: said in the head */
+  if (n == 1) {
+    snprintf(num, sizeof(num), "bytes %zu-%zu/%zu", r[0].first, r[0].last,
+             size);
+    add_hdr(&resp, "Content-Range", num, strlen(num));
+    len = r[0].last - r[0].first + 1;
+  }
+  /* Several: each one is a part with its own head */
+  else {
+    type = lion->desc.ctype.len ? lion->obj + lion->desc.ctype.off : NULL;
+    tlen = lion->desc.ctype.len;
+    snprintf(bound, sizeof(bound), "%08lx%016lx", lion->hash & 0xffffffff,
+             now_usec());
+    parts = arena_alloc(ar, n * sizeof(abuf));
+    for (i = 0; i < n; i++) {
+      abuf_init(&parts[i], ar, 128);
+      abuf_puts(&parts[i], "\r\n--");
+      abuf_puts(&parts[i], bound);
+      abuf_puts(&parts[i], "\r\n");
+      if (type != NULL)
+        add_hdr(&parts[i], "Content-Type", type, tlen);
+      snprintf(num, sizeof(num), "bytes %zu-%zu/%zu", r[i].first, 
+               r[i].last, size);
+      add_hdr(&parts[i], "Content-Range", num, strlen(num));
+      abuf_puts(&parts[i], end_hdr);
+      len += parts[i].len + r[i].last - r[i].first + 1;
+    }
+    abuf_init(&tail, ar, 64);
+    abuf_puts(&tail, "\r\n--");
+    abuf_puts(&tail, bound);
+    abuf_puts(&tail, "--\r\n");
+    len += tail.len;
+    abuf_puts(&resp, "Content-Type: multipart/byteranges; boundary=");
+    abuf_puts(&resp, bound);
+    abuf_puts(&resp, "\r\n");
+  }
+  snprintf(num, sizeof(num), "%zu", len);
+  add_hdr(&resp, "Content-Length", num, strlen(num));
+  abuf_puts(&resp, end_hdr);
+  /* Head, (part heads &) slices of the cached body, in as few writes
+     as RANGE_IOV allows */
+  out.fd = client;
+  out.n = 0;
+  if (iov_add(&out, resp.data, resp.len) < 0)
+    return -1;
+  for (i = 0; i < n; i++)
+    if ((parts && iov_add(&out, parts[i].data, parts[i].len) < 0) ||
+        range_slices(&out, lion, head + r[i].first, 
+                     r[i].last - r[i].first + 1) < 0)
+      return -1;
+  if (parts && iov_add(&out, tail.data, tail.len) < 0)
+    return -1;
+  return iov_flush(&out);
+}
+
+/*
+ * range_slices - add the [len] bytes at [off] of the object of complete
+ *                line [lion] to vectored write [out], a slice per chunk
+ *                they're in; returns -1 on a write error
+ */
+int range_slices(struct iov_out *out, line *lion, size_t off, size_t len)
+{
+  struct segment *seg = NULL;
+  char *data = lion->obj;
+  size_t have = lion->olen, take;
+
+  while (len > 0) {
+    if (off < have) {
+      take = have - off < len ? have - off : len;
+      if (iov_add(out, data + off, take) < 0)
+        return -1;
+      off += take;
+      len -= take;
+    }
+    if (len == 0) break;
+    /* On to the next chunk */
+    off -= have;
+    if ((seg = line_next(C, lion, seg)) == NULL)
+      return -1;
+    data = seg->data;
+    have = seg->len;
+  }
+  return 0;
+}
+
+/*
+ * iov_add - add the [len] bytes at [base] to vectored write [out], 
+ *           writing out what's waiting first if it's full;
+ *           returns -1 on a write error
+ */
+int iov_add(struct iov_out *out, void *base, size_t len)
+{
+  if (out->n == RANGE_IOV && iov_flush(out) < 0)
+    return -1;
+  out->iov[out->n].iov_base = base;
+  out->iov[out->n].iov_len = len;
+  out->n++;
+  return 0;
+}
+
+/*
+ * iov_flush - write out what's waiting in vectored write [out];
+ *             returns -1 on a write error
+ */
+int iov_flush(struct iov_out *out)
+{
+  struct iovec *iov = out->iov;
+  int n = out->n;
+  ssize_t w;
+
+  out->n = 0;
+  while (n > 0) {
+    if ((w = writev(out->fd, iov, n)) < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    /* Skip what went out (the last slice may have been cut short) */
+    while (n > 0 && (size_t)w >= iov->iov_len) {
+      w -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+  return 0;
 }
 
 /*
@@ -378,21 +2176,41 @@ int ignore_hdr(char *hdr)
 }
 
 /*
- * not_error - determines if obj is a server error or not;
- *             return 1 if it isn't, 0 if it is
+ * add_hdr - append header [name] with value [val] ([vlen] bytes) to
+ *           [buf]
  */
-int not_error(char *obj)
+void add_hdr(abuf *buf, const char *name, char *val, size_t vlen)
 {
-  size_t objsize = strlen(obj) + 1;
-  char object[objsize];
+  abuf_puts(buf, name);
+  abuf_puts(buf, ": ");
+  abuf_append(buf, val, vlen);
+  abuf_puts(buf, "\r\n");
+}
 
-  memset(object, 0, sizeof(object));
+/*
+ * now_usec - current wall clock time in microseconds
+ */
+unsigned long now_usec(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (unsigned long)tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+/*
+ * reset_conn - make closing connection [fd] reset it, so the response 
+ *              sent on it so far can't pass for a whole one
+ */
+void reset_conn(int fd)
+{
+  struct linger cut = { 1, 0 };
 
-  memcpy(object, obj, objsize);
-  return strstr(object, "200") != NULL ? 1 : 0;
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &cut, sizeof(cut));
 }
 
 
+
 /********************
  * CLEAN-UP FUNCTIONS
  ********************/
@@ -431,6 +2249,25 @@ void bad_request(int fd, char *cause)
   flush_str(buf);
 }
 
+/* Error: 411
+ * length_required - client error: a request body without Content-Length
+ */
+void length_required(int fd)
+{
+  const char *body = "<html><title>Error 411: length required</title>\r\n"
+                     "<body><h1>Error 411: length required</h1>\r\n"
+                     "<h3>Send the body with a Content-Length</h3>"
+                     "</body></html>\r\n";
+  char buf[MAXLINE];
+  int n;
+
+  n = snprintf(buf, MAXLINE, "HTTP/1.0 411 Length Required\r\n"
+               "Content-Type: text/html\r\nContent-Length: %zu\r\n\r\n%s",
+               strlen(body), body);
+  if (rio_writen(fd, buf, n) < 0)
+    fprintf(stderr, "rio_writen error: bad connection");
+}
+
 /*
  * check_argc - checks for incorrect argument count to command prompt;
  *              eliminates clutter in main function
@@ -438,11 +2275,168 @@ void bad_request(int fd, char *cause)
 void check_argc(int argc, int check, char **argv)
 {
   if (argc != check) {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    fprintf(stderr, "usage: %s [-b] [-l] [-m cache_bytes] [-o object_bytes] "
+                    "[-n objects] [-d disk_file [-D disk_bytes]] "
+                    "[-s snap_file [-S seconds]] [-u upgrade_socket] "
+                    "[-w workers] [-N] [-a] [-H] [-t ttl] [-e neg_ttl] "
+                    "[-W swr_secs] [-E sie_secs] <port>\n",
+            argv[0]);
     exit(1);
   }
 }
 
+/*
+ * parse_args - parse the command line [argv] into [opts]; sizes take
+ *              a K/M/G/T suffix. Exits with usage on bad input.
+ *   -b         optimize byte hit ratio instead of object hit ratio
+ *   -l         store objects in a log with segment FIFO eviction
+ *   -m bytes   cache budget (default MAX_CACHE_SIZE)
+ *   -o bytes   largest object to cache (default MAX_OBJECT_SIZE)
+ *   -n count   most objects to cache (default: 1 per LINE_AVG_SIZE)
+ *   -d file    spill evicted objects to a disk tier in [file]
+ *   -D bytes   size of the disk tier file (default DISK_SIZE)
+ *   -s file    warm start from snapshot [file] & save one at shutdown
+ *   -S secs    also save a snapshot every [secs] seconds
+ *   -u path    hot upgrade control socket: take over from the proxy
+ *              listening on it (if any), then listen on it ourselves
+ *   -w count   fork [count] (up to PIN_WORKERS) worker processes 
+ *              sharing one cache (no disk tier or hot upgrades then)
+ *   -N         pin threads (or workers) to NUMA nodes round robin and
+ *              give each node a share of the cache in its own memory
+ *   -a         shrink the cache under memory pressure (cgroup v2 &
+ *              PSI) and grow it back up to -m bytes when it eases
+ *   -H         map the cache from hugetlb pages (committed up front,
+ *              so -a can't shrink it) if enough are set aside; without
+ *              it, regular pages are madvised for transparent ones
+ *   -t secs    how long a response without Cache-Control, Expires or
+ *              Last-Modified stays fresh (default HTTP_DEFAULT_TTL)
+ *   -e secs    longest a 404 or 410 is cached, apart from the rest 
+ *              (default HTTP_NEG_TTL; 0: not at all, nor the proxy's
+ *              502 for an origin it can't reach)
+ *   -W secs    serve a stale object while it's refreshed for [secs] if
+ *              its response doesn't give stale-while-revalidate 
+ *              (default HTTP_SWR_DEFAULT: only if it does)
+ *   -E secs    serve a stale object while its origin fails for [secs]
+ *              if its response doesn't give stale-if-error (default
+ *              HTTP_SIE_DEFAULT: only if it does)
+ */
+void parse_args(int argc, char **argv, struct proxy_opts *opts)
+{
+  int opt;
+
+  opts->cfg.capacity = MAX_CACHE_SIZE;
+  opts->cfg.max_object = MAX_OBJECT_SIZE;
+  opts->cfg.max_lines = 0;
+  opts->cfg.store = STORE_SLAB;
+  opts->cfg.hugetlb = 0;
+  opts->cfg.swr = HTTP_SWR_DEFAULT;
+  opts->cfg.sie = HTTP_SIE_DEFAULT;
+  opts->objective = GDSF_OBJ_HIT;
+  opts->disk_path = NULL;
+  opts->disk_size = DISK_SIZE;
+  opts->snap_path = NULL;
+  opts->snap_every = 0;
+  opts->upgrade_path = NULL;
+  opts->workers = 0;
+  opts->numa = 0;
+  opts->autosize = 0;
+  opts->ttl = HTTP_DEFAULT_TTL;
+  opts->neg_ttl = HTTP_NEG_TTL;
+
+  while ((opt = getopt(argc, argv, "blm:o:n:d:D:s:S:u:w:NaHt:e:W:E:"))
+         != -1) {
+    switch (opt) {
+      case 'b': opts->objective = GDSF_BYTE_HIT; break;
+      case 'l': opts->cfg.store = STORE_LOG; break;
+      case 'm': opts->cfg.capacity = parse_size(optarg); break;
+      case 'o': opts->cfg.max_object = parse_size(optarg); break;
+      case 'n': 
+        if ((opts->cfg.max_lines = parse_size(optarg)) == 0)
+          check_argc(0, 1, argv);
+        break;
+      case 'd': opts->disk_path = optarg; break;
+      case 'D':
+        if ((opts->disk_size = parse_size(optarg)) == 0)
+          check_argc(0, 1, argv);
+        break;
+      case 's': opts->snap_path = optarg; break;
+      case 'S': 
+        if ((opts->snap_every = atoi(optarg)) <= 0)
+          check_argc(0, 1, argv);
+        break;
+      case 'u': opts->upgrade_path = optarg; break;
+      case 'w':
+        if ((opts->workers = atoi(optarg)) <= 0 || 
+            opts->workers > PIN_WORKERS)
+          check_argc(0, 1, argv);
+        break;
+      case 'N': opts->numa = 1; break;
+      case 'a': opts->autosize = 1; break;
+      case 'H': opts->cfg.hugetlb = 1; break;
+      case 't':
+        if ((opts->ttl = atol(optarg)) <= 0)
+          check_argc(0, 1, argv);
+        break;
+      case 'e':
+        if ((opts->neg_ttl = atol(optarg)) < 0)
+          check_argc(0, 1, argv);
+        break;
+      case 'W':
+        if ((opts->cfg.swr = atol(optarg)) < 0)
+          check_argc(0, 1, argv);
+        break;
+      case 'E':
+        if ((opts->cfg.sie = atol(optarg)) < 0)
+          check_argc(0, 1, argv);
+        break;
+      default:  check_argc(0, 1, argv);
+    }
+  }
+  /* Budget must hold at least one object */
+  if (opts->cfg.capacity == 0 || opts->cfg.max_object == 0 ||
+      opts->cfg.max_object > opts->cfg.capacity)
+    check_argc(0, 1, argv);
+  /* ...and slab pages for every size class (see slab_init) */
+  if (opts->cfg.store == STORE_SLAB &&
+      opts->cfg.capacity < slab_min_budget(SEG_SIZE - SLAB_CHUNK_HDR)) {
+    fprintf(stderr, "%s: -m: a slab needs at least %lu bytes "
+                    "(a page per size class); use -l below that\n", argv[0],
+            (unsigned long)slab_min_budget(SEG_SIZE - SLAB_CHUNK_HDR));
+    exit(1);
+  }
+  /* The disk tier & hot upgrades live in one process */
+  if (opts->workers > 0 && 
+      (opts->disk_path != NULL || opts->upgrade_path != NULL))
+    check_argc(0, 1, argv);
+  opts->cfg.shared = opts->workers > 0;
+  check_argc(argc - optind, 1, argv);
+  opts->port = argv[optind];
+}
+
+/*
+ * parse_size - parse a byte count with an optional K/M/G/T suffix
+ *              (powers of 1024); returns 0 if [str] is malformed
+ */
+size_t parse_size(char *str)
+{
+  char *end;
+  unsigned long long n;
+
+  errno = 0;
+  n = strtoull(str, &end, 10);
+  if (errno || end == str) return 0;
+  switch (*end) {
+    case 't': case 'T': n <<= 10; /* fall through */
+    case 'g': case 'G': n <<= 10; /* fall through */
+    case 'm': case 'M': n <<= 10; /* fall through */
+    case 'k': case 'K': n <<= 10; end++; break;
+    case '\0': break;
+    default: return 0;
+  }
+  if (*end != '\0') return 0;
+  return (size_t)n;
+}
+
 
 /**********************************
  * Wrappers for robust I/O routines
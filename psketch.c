@@ -0,0 +1,135 @@
+/*
+ * psketch.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is a count-min sketch that spots the cache's hot keys. Every hit
+ * adds to one counter in each row (picked by a different mix of the
+ * key's hash); a key's estimate is the smallest of its counters, which
+ * can overcount but never undercount. Every so many adds the counters
+ * are halved, so the sketch follows what's hot now rather than what
+ * was hot an hour ago. Counters are updated with atomics: there's no
+ * lock, and a few adds lost to a concurrent halving don't matter.
+ */
+
+#include "csapp.h"
+#include "psketch.h"
+
+/* One odd multiplier per row */
+static const unsigned long row_mul[SKETCH_ROWS] = {
+  0x9e3779b97f4a7c15UL, 0xc2b2ae3d27d4eb4fUL,
+  0x165667b19e3779f9UL, 0xd6e8feb86659fd93UL
+};
+
+static size_t row_slot(sketch *sk, unsigned long hash, int row);
+static void sketch_age(sketch *sk);
+
+
+/******************
+ * SKETCH FUNCTIONS
+ ******************/
+
+/*
+ * sketch_init - set up sketch [sk] for about [keys] keys (rows are
+ *               kept between SKETCH_MIN_WIDTH & SKETCH_MAX_WIDTH); if
+ *               [shared], the counters are shared with processes forked
+ *               later on
+ */
+void sketch_init(sketch *sk, size_t keys, int shared)
+{
+  size_t bytes;
+
+  sk->width = SKETCH_MIN_WIDTH;
+  while (sk->width < keys && sk->width < SKETCH_MAX_WIDTH)
+    sk->width *= 2;
+  bytes = SKETCH_ROWS * sk->width * sizeof(unsigned int);
+  if (shared)
+    sk->counts = Mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  else
+    sk->counts = Calloc(1, bytes);
+  sk->window = SKETCH_WINDOW * sk->width;
+  sk->adds = 0;
+  sk->aged = 0;
+}
+
+/*
+ * sketch_add - count [n] hits of the key with [hash] in sketch [sk];
+ *              returns the key's new estimate
+ *
+ * Note: the add that completes a window ages the whole sketch
+ */
+unsigned long sketch_add(sketch *sk, unsigned long hash, unsigned int n)
+{
+  unsigned long est = ~0UL, c, before;
+  int r;
+
+  for (r = 0; r < SKETCH_ROWS; r++) {
+    c = __sync_add_and_fetch(&sk->counts[row_slot(sk, hash, r)], n);
+    if (c < est) est = c;
+  }
+  before = __sync_fetch_and_add(&sk->adds, n);
+  if (before / sk->window != (before + n) / sk->window)
+    sketch_age(sk);
+  return est;
+}
+
+/*
+ * sketch_estimate - estimated recent hits of the key with [hash] in
+ *                   sketch [sk]
+ */
+unsigned long sketch_estimate(sketch *sk, unsigned long hash)
+{
+  unsigned long est = ~0UL, c;
+  int r;
+
+  for (r = 0; r < SKETCH_ROWS; r++) {
+    c = __atomic_load_n(&sk->counts[row_slot(sk, hash, r)], __ATOMIC_RELAXED);
+    if (c < est) est = c;
+  }
+  return est;
+}
+
+/*
+ * row_slot - index of the counter of the key with [hash] in row [row]
+ *            of sketch [sk]
+ */
+static size_t row_slot(sketch *sk, unsigned long hash, int row)
+{
+  unsigned long h = hash * row_mul[row];
+
+  return (size_t)row * sk->width + ((h ^ (h >> 32)) & (sk->width - 1));
+}
+
+/*
+ * sketch_age - halve every counter of sketch [sk]
+ */
+static void sketch_age(sketch *sk)
+{
+  size_t i, n = SKETCH_ROWS * sk->width;
+
+  for (i = 0; i < n; i++)
+    __atomic_store_n(&sk->counts[i],
+                     __atomic_load_n(&sk->counts[i], __ATOMIC_RELAXED) / 2,
+                     __ATOMIC_RELAXED);
+  __sync_fetch_and_add(&sk->aged, 1);
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * sketch_stats - print the geometry & aging of sketch [sk] to [fp]
+ */
+void sketch_stats(sketch *sk, FILE *fp)
+{
+  fprintf(fp, "- HOT KEYS -\n");
+  fprintf(fp, "sketch: %d x %lu counters | aged every %lu hits, %lu times\n",
+          SKETCH_ROWS, (unsigned long)sk->width, sk->window, sk->aged);
+  fprintf(fp, "------------\n");
+}
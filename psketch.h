@@ -0,0 +1,41 @@
+/*
+ * psketch.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for psketch.c (count-min sketch of hot keys)
+ */
+#ifndef __PSKETCH_H__
+#define __PSKETCH_H__
+
+#include <stdio.h>
+
+/* Sketch geometry */
+#define SKETCH_ROWS      4         // counters per key
+#define SKETCH_MIN_WIDTH 1024      // counters per row (power of 2)
+#define SKETCH_MAX_WIDTH 262144
+#define SKETCH_WINDOW    8         // halve the counters every WINDOW*width adds
+
+/* Structure of a sketch consists of its rows of counters, the width
+ * of a row, how many adds it takes to age the counters, the adds so
+ * far and how many times the counters were aged.
+ */
+struct sketch {
+  unsigned int *counts;    // SKETCH_ROWS rows of [width] counters
+  size_t width;            // power of 2
+  unsigned long window;
+  unsigned long adds;
+  unsigned long aged;
+};
+typedef struct sketch sketch;
+
+/* Function prototypes for sketch operations */
+void sketch_init(sketch *sk, size_t keys, int shared);
+unsigned long sketch_add(sketch *sk, unsigned long hash, unsigned int n);
+unsigned long sketch_estimate(sketch *sk, unsigned long hash);
+void sketch_stats(sketch *sk, FILE *fp);
+
+#endif
@@ -0,0 +1,504 @@
+/*
+ * pslab.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the slab allocator behind the web object cache. The whole
+ * cache budget is reserved as one region up front and carved into
+ * fixed-size pages (128 Kb, or smaller for a small budget, so every
+ * class can have one); each page belongs to one size class and is cut
+ * into equal chunks. Classes grow by ~1.5x (64, 96, 128, 192,
+ * ... up to the largest chunk the cache asks for), so a chunk wastes
+ * at most a third of itself, and because pages never go back to
+ * malloc the heap can't fragment past the budget.
+ * On a NUMA host the region can be split into one range per node, so
+ * that a thread pinned to a node carves its chunks out of that node's
+ * memory.
+ */
+
+#include "csapp.h"
+#include "pslab.h"
+#include "phuge.h"
+
+/* Page <-> address conversions */
+#define PAGE_OF(sl, p)    (&(sl)->pages[((char *)(p) - (sl)->base) / \
+                                        (sl)->pgsize])
+#define PAGE_BASE(sl, pg) ((sl)->base + \
+                           (size_t)((pg) - (sl)->pages) * (sl)->pgsize)
+#define PAGE_RANGE(sl, pg) ((size_t)((pg) - (sl)->pages) / (sl)->node_pages)
+#define PAGE_NODE(sl, pg)  (PAGE_RANGE(sl, pg) < (size_t)(sl)->nnodes ? \
+                            (int)PAGE_RANGE(sl, pg) : (sl)->nnodes - 1)
+
+/* NUMA node the calling thread allocates from (see slab_set_node) */
+static __thread int here_node = 0;
+
+static void page_push(spage **list, spage *pg);
+static void page_del(spage **list, spage *pg);
+static spage *page_get(slab *sl, int node);
+static size_t node_npages(slab *sl, int node);
+static int class_sizes(size_t maxsize, size_t *sizes);
+static size_t page_size(size_t top);
+
+
+/****************
+ * SLAB FUNCTIONS
+ ****************/
+
+/*
+ * slab_init - reserve [budget] bytes for slab [sl] & set up classes for
+ *             objects of up to [maxsize] bytes; pages are SLAB_PAGE_SIZE,
+ *             halved while that leaves a class without a page (but never
+ *             smaller than the largest class)
+ *
+ * Note: the region is reserved, not committed; pages only cost memory
+ *       once a class touches them (unless [tlb] got it hugetlb pages,
+ *       see huge_map). If [shared], it's shared with processes forked 
+ *       later on (and so is the page metadata). A budget under
+ *       slab_min_budget leaves classes to fight over too few pages
+ */
+void slab_init(slab *sl, size_t budget, size_t maxsize, int shared,
+               int tlb)
+{
+  size_t sizes[SLAB_MAX_CLASSES], least;
+  sclass *c;
+  int i, n = class_sizes(maxsize, sizes);
+
+  /* Pick the page size */
+  least = page_size(sizes[n - 1]);
+  sl->pgsize = least > SLAB_PAGE_SIZE ? least : SLAB_PAGE_SIZE;
+  while (sl->pgsize > least && budget / sl->pgsize < (size_t)n)
+    sl->pgsize /= 2;
+  /* Reserve the region */
+  sl->npages = budget / sl->pgsize;
+  if (sl->npages == 0) sl->npages = 1;
+  sl->shared = shared;
+  sl->maplen = sl->npages * sl->pgsize;
+  sl->base = huge_map(&sl->maplen, shared, tlb, &sl->huge);
+  if (shared)
+    sl->pages = Mmap(NULL, sl->npages * sizeof(spage), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  else
+    sl->pages = Calloc(sl->npages, sizeof(spage));
+  slab_nodes(sl, 1);
+  sl->maxpages = sl->npages;
+
+  /* Build the size classes */
+  sl->nclasses = n;
+  for (i = 0; i < n; i++) {
+    c = &sl->cls[i];
+    c->size = sizes[i];
+    c->perpage = sl->pgsize / sizes[i];
+    c->pages = c->used = c->reqbytes = 0;
+    memset(c->partial, 0, sizeof(c->partial));
+  }
+}
+
+/*
+ * slab_min_budget - smallest budget that gives every class of a slab
+ *                   for objects of up to [maxsize] bytes a page of its
+ *                   own
+ */
+size_t slab_min_budget(size_t maxsize)
+{
+  size_t sizes[SLAB_MAX_CLASSES];
+  int n = class_sizes(maxsize, sizes);
+
+  return n * page_size(sizes[n - 1]);
+}
+
+/*
+ * class_sizes - put the chunk sizes of the classes for objects of up
+ *               to [maxsize] bytes in [sizes]: alternately x1.5 & x4/3
+ *               (powers of 2 & halves), up to the first that holds
+ *               [maxsize]; returns how many there are
+ */
+static int class_sizes(size_t maxsize, size_t *sizes)
+{
+  size_t size = SLAB_MIN_CHUNK, top = maxsize + SLAB_CHUNK_HDR;
+  int n = 0;
+
+  while (1) {
+    if (n == SLAB_MAX_CLASSES - 1 && size < top)
+      size = top;
+    sizes[n++] = size;
+    if (size >= top)
+      return n;
+    size += (n % 2) ? size / 2 : size / 3;
+  }
+}
+
+/*
+ * page_size - smallest page (a power of 2) that holds a [top]-byte chunk
+ */
+static size_t page_size(size_t top)
+{
+  size_t size = SLAB_MIN_CHUNK;
+
+  while (size < top)
+    size *= 2;
+  return size;
+}
+
+/*
+ * slab_reset - empty slab [sl]: every page goes back to the pool
+ *              untouched & its memory is given back to the system
+ *
+ * Note: whatever was allocated from it is gone
+ */
+void slab_reset(slab *sl)
+{
+  int i;
+
+  madvise(sl->base, sl->maplen, sl->shared ? MADV_REMOVE : MADV_DONTNEED);
+  slab_nodes(sl, sl->nnodes);
+  for (i = 0; i < sl->nclasses; i++) {
+    sl->cls[i].pages = sl->cls[i].used = sl->cls[i].reqbytes = 0;
+    memset(sl->cls[i].partial, 0, sizeof(sl->cls[i].partial));
+  }
+}
+
+/*
+ * slab_nodes - split the pages of slab [sl] into [nnodes] ranges, one
+ *              per NUMA node (at most SLAB_MAX_NODES), each with a pool
+ *              of its own; every page is untouched afterwards
+ *
+ * Note: call it before anything is allocated; binding the ranges to 
+ *       their nodes is up to the caller
+ */
+void slab_nodes(slab *sl, int nnodes)
+{
+  size_t p, per = huge_page_size() / sl->pgsize;
+
+  if (nnodes > SLAB_MAX_NODES) nnodes = SLAB_MAX_NODES;
+  if ((size_t)nnodes > sl->npages) nnodes = (int)sl->npages;
+  if (nnodes < 1) nnodes = 1;
+  sl->nnodes = nnodes;
+  sl->node_pages = sl->npages / nnodes;
+  // Ranges start on a huge page, so none is split between two nodes
+  if (per > 1 && sl->node_pages >= per)
+    sl->node_pages -= sl->node_pages % per;
+  sl->touched = sl->inuse = 0;
+  memset(sl->ntouched, 0, sizeof(sl->ntouched));
+  memset(sl->freepg, 0, sizeof(sl->freepg));
+  sl->local_hits = sl->remote_hits = 0;
+  for (p = 0; p < sl->npages; p++)
+    sl->pages[p].cls = -1;
+}
+
+/*
+ * slab_set_node - make the calling thread allocate from NUMA [node]
+ */
+void slab_set_node(int node)
+{
+  here_node = node;
+}
+
+/*
+ * slab_node - NUMA node (range) of the page holding [ptr] in [sl]
+ */
+int slab_node(slab *sl, void *ptr)
+{
+  return PAGE_NODE(sl, PAGE_OF(sl, ptr));
+}
+
+/*
+ * slab_range - start of the pages of [node] in slab [sl]; their size
+ *              in bytes goes in [len]
+ */
+char *slab_range(slab *sl, int node, size_t *len)
+{
+  *len = node_npages(sl, node) * sl->pgsize;
+  return sl->base + (size_t)node * sl->node_pages * sl->pgsize;
+}
+
+/*
+ * slab_hit - count [n] hits on the object at [ptr] in slab [sl] as
+ *            local or remote to the calling thread's node
+ */
+void slab_hit(slab *sl, void *ptr, unsigned int n)
+{
+  if (slab_node(sl, ptr) == here_node)
+    __sync_fetch_and_add(&sl->local_hits, n);
+  else
+    __sync_fetch_and_add(&sl->remote_hits, n);
+}
+
+/*
+ * slab_class - find the smallest class that fits [size] bytes;
+ *              returns the class, or -1 if nothing is big enough
+ */
+int slab_class(slab *sl, size_t size)
+{
+  int i;
+
+  size += SLAB_CHUNK_HDR;
+  for (i = 0; i < sl->nclasses; i++)
+    if (sl->cls[i].size >= size)
+      return i;
+  return -1;
+}
+
+/*
+ * slab_alloc - take a chunk of class [cls] for an object of [size] bytes
+ *              owned by [owner] (NULL: the chunk owns itself);
+ *              returns the chunk, or NULL if the class & the page pool
+ *              are both exhausted (caller must evict)
+ */
+void *slab_alloc(slab *sl, int cls, size_t size, void *owner)
+{
+  sclass *c = &sl->cls[cls];
+  int node = here_node < sl->nnodes ? here_node : 0, i;
+  spage *pg = c->partial[node];
+  void **chunk;
+
+  /* No page of this class has room here: take one from the pool */
+  if (pg == NULL && (pg = page_get(sl, node)) != NULL) {
+    pg->cls = cls;
+    pg->used = pg->carved = 0;
+    pg->free = NULL;
+    c->pages++;
+    page_push(&c->partial[PAGE_NODE(sl, pg)], pg);
+  }
+  /* Pool is empty: a chunk on another node still beats evicting */
+  for (i = 0; pg == NULL && i < sl->nnodes; i++)
+    pg = c->partial[i];
+  if (pg == NULL)
+    return NULL;
+  /* Reuse a freed chunk, or carve a fresh one off the page */
+  if (pg->free) {
+    chunk = pg->free;
+    pg->free = chunk[1];
+  }
+  else
+    chunk = (void **)(PAGE_BASE(sl, pg) + (size_t)pg->carved++ * c->size);
+  /* A full page leaves the partial list */
+  if (++pg->used == c->perpage)
+    page_del(&c->partial[PAGE_NODE(sl, pg)], pg);
+  c->used++;
+  c->reqbytes += size;
+
+  chunk[0] = owner ? owner : (void *)(chunk + 1);
+  return chunk + 1;
+}
+
+/*
+ * slab_free - give chunk [ptr] (holding [size] bytes) back to its page;
+ *             a page that empties goes back to the pool
+ */
+void slab_free(slab *sl, void *ptr, size_t size)
+{
+  void **chunk = (void **)ptr - 1;
+  spage *pg = PAGE_OF(sl, chunk);
+  sclass *c = &sl->cls[pg->cls];
+
+  /* Push chunk onto the page's free list */
+  chunk[0] = NULL;
+  chunk[1] = pg->free;
+  pg->free = chunk;
+  c->used--;
+  c->reqbytes -= size;
+  /* A full page has room again */
+  if (pg->used-- == c->perpage)
+    page_push(&c->partial[PAGE_NODE(sl, pg)], pg);
+  /* An empty page is released to any class */
+  if (pg->used == 0) {
+    page_del(&c->partial[PAGE_NODE(sl, pg)], pg);
+    c->pages--;
+    pg->cls = -1;
+    page_push(&sl->freepg[PAGE_NODE(sl, pg)], pg);
+    sl->inuse--;
+    // Shrunk: the memory goes back to the system right away
+    if (sl->maxpages < sl->npages &&
+        madvise(PAGE_BASE(sl, pg), sl->pgsize, 
+                sl->shared ? MADV_REMOVE : MADV_DONTNEED) < 0)
+      fprintf(stderr, "slab_free: can't give back a page: %s\n",
+              strerror(errno));
+  }
+}
+
+/*
+ * slab_reassign - free a page for class [cls] by emptying a page of the
+ *                 class holding the most pages; [evict] is called on the
+ *                 owner of every chunk still in use on that page;
+ *                 returns 1 if a page was freed, 0 if not
+ */
+int slab_reassign(slab *sl, int cls,
+                  void (*evict)(void *owner, void *arg), void *arg)
+{
+  int i, victim = -1;
+  size_t p;
+  unsigned int k;
+  spage *pg = NULL;
+  void **chunk;
+
+  /* Pick the class with the most pages */
+  for (i = 0; i < sl->nclasses; i++)
+    if (i != cls && sl->cls[i].pages > 0 &&
+        (victim < 0 || sl->cls[i].pages > sl->cls[victim].pages))
+      victim = i;
+  if (victim < 0) return 0;
+
+  /* Pick its emptiest page */
+  for (p = 0; p < sl->npages; p++)
+    if (sl->pages[p].cls == victim &&
+        (pg == NULL || sl->pages[p].used < pg->used))
+      pg = &sl->pages[p];
+
+  /* Evict the owners of every chunk on it */
+  for (k = 0; k < pg->carved && pg->cls == victim; k++) {
+    chunk = (void **)(PAGE_BASE(sl, pg) + (size_t)k * sl->cls[victim].size);
+    if (chunk[0] != NULL)
+      evict(chunk[0], arg);
+  }
+  return pg->cls == -1;
+}
+
+/*
+ * slab_capacity - bytes of memory slab [sl] may hand out (its limit)
+ */
+size_t slab_capacity(slab *sl)
+{
+  return sl->maxpages * sl->pgsize;
+}
+
+/*
+ * slab_limit - let the classes of slab [sl] hold [bytes] of pages at 
+ *              most (at least a page per class, at most the whole
+ *              region); returns the new limit in bytes
+ *
+ * Note: pages over a lower limit stay with their class until they're
+ *       emptied (see slab_reassign); while the limit is below the 
+ *       region, an emptied page's memory is given back to the system
+ */
+size_t slab_limit(slab *sl, size_t bytes)
+{
+  sl->maxpages = bytes / sl->pgsize;
+  if (sl->maxpages < (size_t)sl->nclasses) sl->maxpages = sl->nclasses;
+  if (sl->maxpages > sl->npages) sl->maxpages = sl->npages;
+  return slab_capacity(sl);
+}
+
+/*
+ * slab_used - bytes of pages the classes of slab [sl] hold
+ */
+size_t slab_used(slab *sl)
+{
+  return sl->inuse * sl->pgsize;
+}
+
+
+/*********************
+ * PAGE LIST FUNCTIONS
+ *********************/
+
+/*
+ * page_push - push page [pg] onto the front of [list]
+ */
+static void page_push(spage **list, spage *pg)
+{
+  pg->prev = NULL;
+  pg->next = *list;
+  if (*list) (*list)->prev = pg;
+  *list = pg;
+}
+
+/*
+ * page_del - unlink page [pg] from [list]
+ */
+static void page_del(spage **list, spage *pg)
+{
+  if (pg->prev) pg->prev->next = pg->next;
+  else          *list = pg->next;
+  if (pg->next) pg->next->prev = pg->prev;
+  pg->prev = pg->next = NULL;
+}
+
+/*
+ * page_get - take a page from the pool, from [node]'s range if it has
+ *            any left (a released page first, then one never touched 
+ *            before); returns NULL if none are left on any node
+ */
+static spage *page_get(slab *sl, int node)
+{
+  spage *pg;
+  int i, n;
+
+  if (sl->inuse >= sl->maxpages)
+    return NULL;
+  for (i = 0; i < sl->nnodes; i++) {
+    n = (node + i) % sl->nnodes;
+    if ((pg = sl->freepg[n]) != NULL) {
+      page_del(&sl->freepg[n], pg);
+      sl->inuse++;
+      return pg;
+    }
+    if (sl->ntouched[n] < node_npages(sl, n)) {
+      sl->touched++;
+      sl->inuse++;
+      return &sl->pages[(size_t)n * sl->node_pages + sl->ntouched[n]++];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * node_npages - pages in the range of [node] of slab [sl]
+ */
+static size_t node_npages(slab *sl, int node)
+{
+  if (node == sl->nnodes - 1)
+    return sl->npages - (size_t)node * sl->node_pages;
+  return sl->node_pages;
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * slab_stats - print occupancy & fragmentation of slab [sl] to [fp];
+ *              internal fragmentation is the share of used chunk bytes
+ *              not requested by objects, and the total also counts the
+ *              unused chunks of pages owned by a class
+ */
+void slab_stats(slab *sl, FILE *fp)
+{
+  int i;
+  sclass *c;
+  unsigned long pages = 0, reqbytes = 0;
+  double chunkbytes;
+
+  fprintf(fp, "- SLAB CLASSES -\n");
+  for (i = 0; i < sl->nclasses; i++) {
+    c = &sl->cls[i];
+    if (c->pages == 0) continue;
+    pages += c->pages;
+    reqbytes += c->reqbytes;
+    chunkbytes = (double)c->used * c->size;
+    fprintf(fp, "class %2d: %6lu byte chunks | %5lu pages | "
+                "%7lu / %7lu chunks | %5.1f%% internal frag\n",
+            i, (unsigned long)c->size, c->pages, c->used,
+            c->pages * c->perpage,
+            chunkbytes ? 100.0 * (1.0 - c->reqbytes / chunkbytes) : 0.0);
+  }
+  fprintf(fp, "pages: %lu used, %lu free, %lu total, %lu allowed "
+              "(%lu byte pages, %d classes)\n",
+          pages, (unsigned long)sl->npages - pages,
+          (unsigned long)sl->npages, (unsigned long)sl->maxpages,
+          (unsigned long)sl->pgsize, sl->nclasses);
+  fprintf(fp, "fragmentation: %.1f%% of %lu bytes in used pages\n",
+          pages ? 100.0 * (1.0 - (double)reqbytes /
+                           ((double)pages * sl->pgsize)) : 0.0,
+          pages * sl->pgsize);
+  fprintf(fp, "huge pages: %lu of %lu bytes (%s)\n",
+          (unsigned long)huge_backed(sl->base, sl->maplen, sl->huge),
+          (unsigned long)sl->maplen, huge_name(sl->huge));
+  if (sl->nnodes > 1)
+    fprintf(fp, "numa: %d nodes | hits: %lu local, %lu remote\n",
+            sl->nnodes, sl->local_hits, sl->remote_hits);
+  fprintf(fp, "---------------\n");
+}
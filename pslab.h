@@ -0,0 +1,106 @@
+/*
+ * pslab.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pslab.c (slab allocator for cache lines)
+ */
+#ifndef __PSLAB_H__
+#define __PSLAB_H__
+
+#include <stdio.h>
+
+/* Slab geometry */
+#define SLAB_PAGE_SIZE   131072 // 128 Kb, unless the budget is too small
+#define SLAB_MIN_CHUNK   64     // smallest chunk size
+#define SLAB_MAX_CLASSES 48     // enough for chunks up to 512 Mb
+#define SLAB_MAX_NODES   8      // NUMA nodes the pages can be split across
+
+/* Every chunk starts with a pointer to the object that owns it
+ * (NULL while the chunk is free), so a page can be emptied by
+ * evicting the owners of its chunks.
+ */
+#define SLAB_CHUNK_HDR sizeof(void *)
+
+/* Structure of a slab page consists of the class it's carved for,
+ * how many chunks are handed out & have been carved so far, a list
+ * of its freed chunks, and links for the partial/free page lists.
+ */
+struct slab_page {
+  int cls;                 // owning class (-1 if page is free)
+  unsigned int used;       // chunks handed out
+  unsigned int carved;     // chunks carved off the page so far
+  void *free;              // freed chunks of this page
+  struct slab_page *prev;
+  struct slab_page *next;
+};
+typedef struct slab_page spage;
+
+/* Structure of a slab class consists of its chunk size, how many
+ * chunks fit in a page, usage counters for statistics and the lists
+ * of its pages that still have room (one per NUMA node).
+ */
+struct slab_class {
+  size_t size;             // chunk size (including owner header)
+  unsigned int perpage;    // chunks per page
+  unsigned long pages;     // pages owned
+  unsigned long used;      // chunks handed out
+  unsigned long reqbytes;  // bytes actually requested for used chunks
+  spage *partial[SLAB_MAX_NODES]; // pages with a free or uncarved chunk
+};
+typedef struct slab_class sclass;
+
+/* Structure of a slab allocator consists of one region reserved up
+ * front for the whole budget, the metadata for each page in it, the
+ * pool of free pages, and the size classes. A page holds at least one
+ * chunk of the largest class, and there are at least as many pages as
+ * classes (see slab_init). The region can be split into one range of
+ * pages per NUMA node (see slab_nodes), each with a pool of its own;
+ * chunks are then taken from the node of the calling thread when
+ * possible, and hits are counted by whether they're on that node.
+ */
+struct slab {
+  char *base;              // start of the reserved region
+  size_t maplen;           // bytes mapped (the pages, rounded up)
+  int huge;                // HUGE_* backing of the region (phuge.c)
+  size_t pgsize;           // page size (power of 2)
+  size_t npages;           // pages in the region
+  size_t touched;          // pages ever handed to a class
+  size_t inuse;            // pages held by a class right now
+  size_t maxpages;         // most pages classes may hold (see slab_limit)
+  int shared;              // mapped shared (prefork workers)
+  spage *pages;            // per-page metadata
+  int nnodes;              // ranges of pages (1 without NUMA)
+  size_t node_pages;       // pages per range (the last one gets the rest)
+  size_t ntouched[SLAB_MAX_NODES];  // pages of a range ever handed out
+  spage *freepg[SLAB_MAX_NODES];    // pages returned by their class
+  unsigned long local_hits, remote_hits;
+  int nclasses;
+  sclass cls[SLAB_MAX_CLASSES];
+};
+typedef struct slab slab;
+
+/* Function prototypes for slab operations */
+void slab_init(slab *sl, size_t budget, size_t maxsize, int shared,
+               int tlb);
+size_t slab_min_budget(size_t maxsize);
+void slab_reset(slab *sl);
+size_t slab_limit(slab *sl, size_t bytes);
+size_t slab_used(slab *sl);
+void slab_nodes(slab *sl, int nnodes);
+void slab_set_node(int node);
+int slab_node(slab *sl, void *ptr);
+char *slab_range(slab *sl, int node, size_t *len);
+void slab_hit(slab *sl, void *ptr, unsigned int n);
+int slab_class(slab *sl, size_t size);
+void *slab_alloc(slab *sl, int cls, size_t size, void *owner);
+void slab_free(slab *sl, void *ptr, size_t size);
+int slab_reassign(slab *sl, int cls,
+                  void (*evict)(void *owner, void *arg), void *arg);
+size_t slab_capacity(slab *sl);
+void slab_stats(slab *sl, FILE *fp);
+
+#endif
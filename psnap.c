@@ -0,0 +1,388 @@
+/*
+ * psnap.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * These are cache snapshots for warm restarts. A snapshot is written
+ * at shutdown (and, optionally, every so often) with every complete
+ * line of the cache, and the records of the snapshot the proxy started
+ * from that are still good & that the cache hasn't got (so objects no
+ * one asked for since aren't lost); the file starts with an open
+ * addressing index so
+ * that a restarted proxy can mmap it and serve from it right away.
+ * Nothing is read up front: pages fault in as objects are requested,
+ * and each record's checksum is checked the first time it's used.
+ */
+
+#include "csapp.h"
+#include "psnap.h"
+
+#define SNAP_ROUND(n) (((n) + SNAP_ALIGN - 1) & ~(size_t)(SNAP_ALIGN - 1))
+
+/* Snapshots are written one at a time (shutdown may race a periodic one) */
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long snap_slot(snap *sn, char *host, char *path);
+static struct snap_rec *slot_rec(snap *sn, unsigned long i);
+static int rec_good(snap *sn, unsigned long i);
+static int rec_cached(struct snap_slot *slots, line **owners,
+                      unsigned long nslots, struct snap_rec *rec);
+static unsigned long snap_sum(unsigned long sum, const char *p, size_t n);
+static unsigned long line_sum(line *lion);
+
+
+/********************
+ * SNAPSHOT FUNCTIONS
+ ********************/
+
+/*
+ * snap_open - map the snapshot at [path] into [sn] if it's there and
+ *             its header & index are sane; if [shared], which records
+ *             were checked or dropped is shared with processes forked
+ *             later on;
+ *             returns 0 on success, -1 if there's no usable snapshot
+ */
+int snap_open(snap *sn, char *path, int shared)
+{
+  struct snap_hdr *hdr;
+  struct stat st;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct snap_hdr)) {
+    close(fd);
+    return -1;
+  }
+  sn->size = st.st_size;
+  sn->map = mmap(NULL, sn->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (sn->map == MAP_FAILED)
+    return -1;
+
+  /* Check the header */
+  hdr = (struct snap_hdr *)sn->map;
+  if (hdr->magic != SNAP_MAGIC || hdr->version != SNAP_VERSION ||
+      hdr->size != sn->size || hdr->nslots == 0 ||
+      (hdr->nslots & (hdr->nslots - 1)) != 0 ||
+      hdr->nslots > (sn->size - sizeof(struct snap_hdr)) /
+                    sizeof(struct snap_slot)) {
+    munmap(sn->map, sn->size);
+    return -1;
+  }
+  sn->slots = (struct snap_slot *)(hdr + 1);
+  sn->nslots = hdr->nslots;
+  sn->count = hdr->count;
+  if (shared)
+    sn->checked = Mmap(NULL, sn->nslots, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  else
+    sn->checked = Calloc(sn->nslots, 1);
+  sn->hits = sn->bad = 0;
+  // Objects are requested in no particular order
+  madvise(sn->map, sn->size, MADV_RANDOM);
+  return 0;
+}
+
+/*
+ * snap_find - look up the object at [host]/[path] in snapshot [sn];
+ *             on a hit, [objp], [lenp], [costp], [expiresp] & [varyp]
+ *             get the object (in the mapping), its size, its fetch 
+ *             cost, its expiry & its variant;
+ *             returns 1 on a hit, 0 on a miss or a corrupt record
+ *
+ * Note: a record's checksum is only computed on its first hit
+ */
+int snap_find(snap *sn, char *host, char *path, char **objp, size_t *lenp,
+              unsigned long *costp, time_t *expiresp, unsigned long *varyp)
+{
+  struct snap_rec *rec;
+  long i;
+
+  if ((i = snap_slot(sn, host, path)) < 0 || !rec_good(sn, i))
+    return 0;
+  rec = (struct snap_rec *)(sn->map + sn->slots[i].off);
+  *objp = (char *)(rec + 1) + rec->keylen;
+  *lenp = rec->len;
+  *costp = rec->cost;
+  *expiresp = rec->expires;
+  *varyp = rec->vary;
+  __sync_fetch_and_add(&sn->hits, 1);
+  return 1;
+}
+
+/*
+ * snap_forget - stop serving the object at [host]/[path] from snapshot
+ *               [sn] (it changed at its origin; the file is read-only,
+ *               so its record is only marked)
+ */
+void snap_forget(snap *sn, char *host, char *path)
+{
+  long i;
+
+  if ((i = snap_slot(sn, host, path)) >= 0)
+    __atomic_store_n(&sn->checked[i], 3, __ATOMIC_RELAXED);
+}
+
+/*
+ * snap_slot - find the index slot of the record of [host]/[path] in
+ *             snapshot [sn], making sure the record lies inside the 
+ *             file & is this object; returns the slot, or -1 if there's
+ *             none
+ */
+static long snap_slot(snap *sn, char *host, char *path)
+{
+  unsigned long hash = loc_hash(host, path), mask = sn->nslots - 1, i, n;
+  size_t hl = strlen(host), keylen = hl + strlen(path);
+  struct snap_rec *rec;
+  char *key;
+
+  for (i = hash & mask, n = 0; n < sn->nslots && sn->slots[i].off != 0;
+       i = (i + 1) & mask, n++) {
+    if (sn->slots[i].hash != hash || (rec = slot_rec(sn, i)) == NULL)
+      continue;
+    /* Record must be this object */
+    key = (char *)(rec + 1);
+    if (rec->keylen != keylen ||
+        memcmp(key, host, hl) || memcmp(key + hl, path, keylen - hl))
+      continue;
+    return i;
+  }
+  return -1;
+}
+
+/*
+ * slot_rec - record of index slot [i] of snapshot [sn], if the slot is
+ *            taken & the record lies inside the file; NULL otherwise
+ */
+static struct snap_rec *slot_rec(snap *sn, unsigned long i)
+{
+  unsigned long off = sn->slots[i].off;
+  struct snap_rec *rec;
+
+  if (off == 0 || off > sn->size - sizeof(struct snap_rec))
+    return NULL;
+  rec = (struct snap_rec *)(sn->map + off);
+  if (rec->magic != SNAP_MAGIC || rec->hash != sn->slots[i].hash ||
+      rec->len > sn->size || rec->keylen > sn->size ||
+      off + sizeof(struct snap_rec) + rec->keylen + rec->len > sn->size)
+    return NULL;
+  return rec;
+}
+
+/*
+ * rec_good - whether the record of index slot [i] of snapshot [sn] (see
+ *            slot_rec) may be served: its checksum is right & it wasn't
+ *            dropped
+ *
+ * Note: the checksum is only computed the first time around
+ */
+static int rec_good(snap *sn, unsigned long i)
+{
+  struct snap_rec *rec = (struct snap_rec *)(sn->map + sn->slots[i].off);
+  unsigned char state;
+
+  if ((state = __atomic_load_n(&sn->checked[i], __ATOMIC_RELAXED)) == 0) {
+    state = snap_sum(14695981039346656037UL, (char *)(rec + 1),
+                     rec->keylen + rec->len) == rec->sum ? 1 : 2;
+    // Unless it was dropped meanwhile
+    if (!__sync_bool_compare_and_swap(&sn->checked[i], 0, state))
+      state = __atomic_load_n(&sn->checked[i], __ATOMIC_RELAXED);
+    else if (state == 2)
+      __sync_fetch_and_add(&sn->bad, 1);
+  }
+  return state == 1;
+}
+
+/*
+ * snap_write - write a snapshot of every complete line of cache [cash]
+ *              to [path], along with the records of snapshot [old] (if
+ *              any) that are fresh, good & not in the cache (through a
+ *              temporary file, so a crash never leaves half a snapshot
+ *              behind);
+ *              returns the number of objects written, or -1 on error
+ *
+ * Note: takes the read lock only to pin the lines; the writing itself
+ *       happens without it. [old] may be the file at [path]: its 
+ *       mapping outlives the rename
+ */
+long snap_write(cache *cash, snap *old, char *path)
+{
+  line **lines, **owners, *lion;
+  struct snap_slot *slots;
+  struct snap_hdr hdr;
+  struct snap_rec rec, *orec;
+  struct segment *seg;
+  size_t count = 0, carry = 0, b, k, pad;
+  unsigned long nslots = 2, off, i, j;
+  char *tmp, zeros[SNAP_ALIGN] = {0};
+  time_t now = time(NULL);
+  FILE *fp;
+  int ok = 1;
+
+  pthread_mutex_lock(&snap_lock);
+  /* Pin every complete line */
+  /* READING */
+  Pthread_rwlock_rdlock(cash->lock);
+  lines = Malloc((cash->nlines + 1) * sizeof(line *));
+  for (b = 0; b < cash->nbuckets; b++)
+    for (lion = cash->buckets[b]; lion != NULL; lion = lion->next)
+      if (__atomic_load_n(&lion->state, __ATOMIC_ACQUIRE) == LINE_READY) {
+        __sync_fetch_and_add(&lion->refcnt, 1);
+        lines[count++] = lion;
+      }
+  Pthread_rwlock_unlock(cash->lock);
+
+  /* Index is at most half full (with every old record carried over) */
+  for (j = 0; old != NULL && j < old->nslots; j++)
+    if (old->slots[j].off != 0) carry++;
+  while (nslots < 2 * (count + carry))
+    nslots *= 2;
+  slots = Calloc(nslots, sizeof(struct snap_slot));
+  owners = Calloc(nslots, sizeof(line *));
+  carry = 0;
+  tmp = Malloc(strlen(path) + 5);
+  sprintf(tmp, "%s.tmp", path);
+
+  /* Records go after the header & index */
+  if ((fp = fopen(tmp, "w")) == NULL)
+    ok = 0;
+  off = sizeof(struct snap_hdr) + nslots * sizeof(struct snap_slot);
+  if (ok && fseek(fp, off, SEEK_SET) < 0)
+    ok = 0;
+  for (k = 0; ok && k < count; k++) {
+    lion = lines[k];
+    rec.magic = SNAP_MAGIC;
+    rec.keylen = strlen(lion->loc);
+    rec.hash = lion->hash;
+    rec.len = lion->size;
+    rec.cost = lion->cost;
+    rec.expires = lion->expires;
+    rec.vary = lion->vary;
+    rec.sum = line_sum(lion);
+    ok = fwrite(&rec, sizeof(rec), 1, fp) == 1 &&
+         fwrite(lion->loc, 1, rec.keylen, fp) == rec.keylen &&
+         fwrite(lion->obj, 1, lion->olen, fp) == lion->olen;
+    for (seg = lion->segs; ok && seg != NULL; seg = seg->next)
+      ok = fwrite(seg->data, 1, seg->len, fp) == seg->len;
+    pad = SNAP_ROUND(sizeof(rec) + rec.keylen + rec.len) -
+          (sizeof(rec) + rec.keylen + rec.len);
+    ok = ok && fwrite(zeros, 1, pad, fp) == pad;
+    // Index it (linear probing)
+    for (i = rec.hash & (nslots - 1); slots[i].off != 0; )
+      i = (i + 1) & (nslots - 1);
+    slots[i].hash = rec.hash;
+    slots[i].off = off;
+    owners[i] = lion;
+    off += sizeof(rec) + rec.keylen + rec.len + pad;
+  }
+  /* Then what's left of the old snapshot */
+  for (j = 0; ok && old != NULL && j < old->nslots; j++) {
+    if ((orec = slot_rec(old, j)) == NULL || orec->expires <= now ||
+        rec_cached(slots, owners, nslots, orec) || !rec_good(old, j))
+      continue;
+    k = sizeof(*orec) + orec->keylen + orec->len;
+    pad = SNAP_ROUND(k) - k;
+    ok = fwrite(orec, 1, k, fp) == k && fwrite(zeros, 1, pad, fp) == pad;
+    for (i = orec->hash & (nslots - 1); slots[i].off != 0; )
+      i = (i + 1) & (nslots - 1);
+    slots[i].hash = orec->hash;
+    slots[i].off = off;
+    off += k + pad;
+    carry++;
+  }
+  /* Index & header last */
+  hdr.magic = SNAP_MAGIC;
+  hdr.version = SNAP_VERSION;
+  hdr.nslots = nslots;
+  hdr.count = count + carry;
+  hdr.size = off;
+  ok = ok && fseek(fp, 0, SEEK_SET) == 0 &&
+       fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+       fwrite(slots, sizeof(struct snap_slot), nslots, fp) == nslots &&
+       fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if (fp != NULL && fclose(fp) != 0)
+    ok = 0;
+  if (ok && rename(tmp, path) < 0)
+    ok = 0;
+  if (!ok) {
+    fprintf(stderr, "snap_write error: %s: %s\n", tmp, strerror(errno));
+    unlink(tmp);
+  }
+
+  /* Clean-up */
+  for (k = 0; k < count; k++)
+    line_put(cash, lines[k]);
+  Free(lines);
+  Free(owners);
+  Free(slots);
+  Free(tmp);
+  pthread_mutex_unlock(&snap_lock);
+  return ok ? (long)(count + carry) : -1;
+}
+
+/*
+ * rec_cached - whether the key of record [rec] is one of the lines in
+ *              index [slots] of [nslots] slots that's being written,
+ *              where [owners] holds each slot's line
+ */
+static int rec_cached(struct snap_slot *slots, line **owners,
+                      unsigned long nslots, struct snap_rec *rec)
+{
+  unsigned long i;
+
+  for (i = rec->hash & (nslots - 1); slots[i].off != 0;
+       i = (i + 1) & (nslots - 1))
+    if (slots[i].hash == rec->hash && owners[i] != NULL &&
+        strlen(owners[i]->loc) == rec->keylen &&
+        memcmp(owners[i]->loc, (char *)(rec + 1), rec->keylen) == 0)
+      return 1;
+  return 0;
+}
+
+/*
+ * snap_sum - continue 64-bit FNV-1a checksum [sum] over [n] bytes of [p]
+ */
+static unsigned long snap_sum(unsigned long sum, const char *p, size_t n)
+{
+  const unsigned char *q = (const unsigned char *)p;
+
+  while (n-- > 0)
+    sum = (sum ^ *q++) * 1099511628211UL;
+  return sum;
+}
+
+/*
+ * line_sum - checksum of the key & object of complete line [lion], as
+ *            they're laid out in a record
+ */
+static unsigned long line_sum(line *lion)
+{
+  unsigned long sum = 14695981039346656037UL;
+  struct segment *seg;
+
+  sum = snap_sum(sum, lion->loc, strlen(lion->loc));
+  sum = snap_sum(sum, lion->obj, lion->olen);
+  for (seg = lion->segs; seg != NULL; seg = seg->next)
+    sum = snap_sum(sum, seg->data, seg->len);
+  return sum;
+}
+
+
+/*********************
+ * DEBUGGING FUNCTIONS
+ *********************/
+
+/*
+ * snap_stats - print usage of snapshot [sn] to [fp]
+ */
+void snap_stats(snap *sn, FILE *fp)
+{
+  fprintf(fp, "- SNAPSHOT -\n");
+  fprintf(fp, "records: %lu | file: %lu bytes | hits: %lu | corrupt: %lu\n",
+          sn->count, (unsigned long)sn->size, sn->hits, sn->bad);
+  fprintf(fp, "------------\n");
+}
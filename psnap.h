@@ -0,0 +1,80 @@
+/*
+ * psnap.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for psnap.c (cache snapshots for warm
+ * restarts)
+ */
+#ifndef __PSNAP_H__
+#define __PSNAP_H__
+
+#include <stdio.h>
+#include "pcache.h"
+
+/* Snapshot format */
+#define SNAP_MAGIC   0x31534e50 // "PNS1"
+#define SNAP_VERSION 2
+#define SNAP_ALIGN   8          // records start on 8 byte boundaries
+
+/* Structure of a snapshot file header; the index (an open addressing
+ * table of [nslots] slots) follows it, then the records.
+ */
+struct snap_hdr {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long nslots;   // power of 2
+  unsigned long count;    // records
+  unsigned long size;     // file bytes
+};
+
+/* Structure of an index slot: hash of a record's key & its offset
+ * (0 if the slot is empty).
+ */
+struct snap_slot {
+  unsigned long hash;
+  unsigned long off;
+};
+
+/* Structure of a record header; the key (host followed by path) and
+ * then the object follow it. The checksum covers key & object.
+ */
+struct snap_rec {
+  unsigned int magic;
+  unsigned int keylen;
+  unsigned long hash;
+  unsigned long len;      // object bytes
+  unsigned long cost;     // origin fetch latency (usec)
+  long expires;           // stale from then on
+  unsigned long vary;     // variant of the object (0: it doesn't vary)
+  unsigned long sum;
+};
+
+/* Structure of a loaded snapshot consists of the file mapped read-only,
+ * its index, which records were checked (0 not yet, 1 good, 2 bad, 3
+ * dropped: see snap_forget; shared with the workers under -w), and
+ * statistics.
+ */
+struct snapshot {
+  char *map;
+  size_t size;
+  struct snap_slot *slots;
+  unsigned long nslots;
+  unsigned long count;
+  unsigned char *checked;
+  unsigned long hits, bad;
+};
+typedef struct snapshot snap;
+
+/* Function prototypes for snapshot operations */
+int snap_open(snap *sn, char *path, int shared);
+int snap_find(snap *sn, char *host, char *path, char **objp, size_t *lenp,
+              unsigned long *costp, time_t *expiresp, unsigned long *varyp);
+void snap_forget(snap *sn, char *host, char *path);
+long snap_write(cache *cash, snap *old, char *path);
+void snap_stats(snap *sn, FILE *fp);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * pupgrade.c
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the hot upgrade handoff. A running proxy listens on a Unix
+ * control socket; a new proxy started with the same control socket
+ * connects to it and asks for an upgrade. The old proxy snapshots its
+ * cache and sends back its listening socket (SCM_RIGHTS) along with
+ * the snapshot's path, so the new proxy accepts on the very same
+ * socket (no connection is refused) and warm-starts from the snapshot
+ * while the old one drains its clients.
+ */
+
+#include "csapp.h"
+#include "pupgrade.h"
+#include <sys/un.h>
+
+static int control_addr(struct sockaddr_un *addr, char *path);
+
+
+/*******************
+ * UPGRADE FUNCTIONS
+ *******************/
+
+/*
+ * upgrade_request - ask the proxy on control socket [path] to hand
+ *                   over; the path of its snapshot (empty if it has
+ *                   none) goes in [snap], [len] bytes at most;
+ *                   returns the listening socket, or -1 if no proxy
+ *                   answered (start from scratch)
+ */
+int upgrade_request(char *path, char *snap, size_t len)
+{
+  struct sockaddr_un addr;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  ssize_t n;
+  int fd, listenfd = -1;
+
+  if (control_addr(&addr, path) < 0 ||
+      (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+  if (connect(fd, (SA *)&addr, sizeof(addr)) < 0 ||
+      rio_writen(fd, UPGRADE_MSG, sizeof(UPGRADE_MSG)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  /* Reply is the snapshot path, with the socket attached */
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = snap;
+  iov.iov_len = len - 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  while ((n = recvmsg(fd, &msg, 0)) < 0 && errno == EINTR)
+    ;
+  close(fd);
+  if (n < 0) return -1;
+  snap[n] = '\0';
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy(&listenfd, CMSG_DATA(cmsg), sizeof(int));
+  return listenfd;
+}
+
+/*
+ * upgrade_listen - take over control socket [path] (a stale one is
+ *                  removed); returns the listening control socket
+ *
+ * Note: exits if the socket can't be set up
+ */
+int upgrade_listen(char *path)
+{
+  struct sockaddr_un addr;
+  int ctl;
+
+  if (control_addr(&addr, path) < 0)
+    app_error("upgrade_listen error: control socket path too long");
+  ctl = Socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  Bind(ctl, (SA *)&addr, sizeof(addr));
+  Listen(ctl, 1);
+  return ctl;
+}
+
+/*
+ * upgrade_wait - wait on control socket [ctl] for a new proxy asking
+ *                for an upgrade; returns the connection to it
+ */
+int upgrade_wait(int ctl)
+{
+  char buf[sizeof(UPGRADE_MSG)];
+  int conn;
+
+  while (1) {
+    if ((conn = accept(ctl, NULL, NULL)) < 0)
+      continue;
+    if (rio_readn(conn, buf, sizeof(buf)) == sizeof(buf) &&
+        !memcmp(buf, UPGRADE_MSG, sizeof(buf)))
+      return conn;
+    close(conn); // not a proxy
+  }
+}
+
+/*
+ * upgrade_send - hand listening socket [listenfd] & the path of
+ *                snapshot [snap] ("" if there's none) to the new proxy
+ *                on [conn]; returns 0 on success, -1 on error
+ */
+int upgrade_send(int conn, int listenfd, char *snap)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  char none = '\0';
+
+  memset(&msg, 0, sizeof(msg));
+  memset(cbuf, 0, sizeof(cbuf));
+  // Always send a byte, or the socket can't ride along
+  iov.iov_base = *snap ? snap : &none;
+  iov.iov_len = *snap ? strlen(snap) : 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &listenfd, sizeof(int));
+  return sendmsg(conn, &msg, 0) < 0 ? -1 : 0;
+}
+
+/*
+ * control_addr - fill in the address of control socket [path];
+ *                returns -1 if the path doesn't fit
+ */
+static int control_addr(struct sockaddr_un *addr, char *path)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return -1;
+  strcpy(addr->sun_path, path);
+  return 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * pupgrade.h
+ *
+ * Made: October 19, 2026
+ * Version: 1.0
+ *
+ * Proxy Lab
+ *
+ * This is the header file for pupgrade.c (hot upgrade handoff)
+ */
+#ifndef __PUPGRADE_H__
+#define __PUPGRADE_H__
+
+#include <stddef.h>
+
+/* Handoff protocol */
+#define UPGRADE_MSG   "upgrade"   // what the new proxy asks with
+#define UPGRADE_DRAIN 30          // seconds the old proxy waits for its clients
+
+/* Function prototypes for upgrade handoff operations */
+int upgrade_request(char *path, char *snap, size_t len);
+int upgrade_listen(char *path);
+int upgrade_wait(int ctl);
+int upgrade_send(int conn, int listenfd, char *snap);
+
+#endif